@@ -0,0 +1,205 @@
+/// @file testBSTCatalog.cpp
+/// @brief Contains unit tests for BSTCatalog
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/BSTCatalog.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const dataDir = kTestDataDir;
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+static Size3 const ascendingImageSize{20, 40, 10};
+static Eigen::Vector3d const ascendingImageResolution{0.25, 0.5, 1.0};
+
+using Img = ::ImageStack::ImageStack<float, HostStorage>;
+using Mask = ::ImageStack::ImageStack<std::uint8_t, HostStorage>;
+using MaskLoader = ImageStackLoaderBST<Mask, true>;
+
+static void copyFile(std::string const &from, std::string const &to) {
+  std::ifstream in(from, std::ios_base::in | std::ios_base::binary);
+  std::ofstream out(to, std::ios_base::out | std::ios_base::binary |
+                            std::ios_base::trunc);
+  out << in.rdbuf();
+}
+
+/// Scans the test data directory and tests if
+///   - all six files are found, sorted by path
+///   - images and masks are detected
+///   - size, resolution, element size and data offset are correct
+TEST(BSTCatalog, ScanDataDirectory) {
+  auto const catalog = BSTCatalog::scan(dataDir);
+
+  ASSERT_EQ(6u, catalog.size());
+  ASSERT_EQ(0u, catalog.numReused());
+  ASSERT_TRUE(std::is_sorted(
+      catalog.entries().cbegin(), catalog.entries().cend(),
+      [](auto const &a, auto const &b) { return a.path < b.path; }));
+
+  for (auto const &entry : catalog.entries()) {
+    ASSERT_TRUE(entry.valid) << entry.path;
+    ASSERT_EQ(ascendingImageSize, entry.size);
+    ASSERT_EQ(entry.isMask, entry.path.find("_Mask") != std::string::npos);
+  }
+
+  auto const *image = catalog.find(ascendingImageFile);
+  ASSERT_NE(nullptr, image);
+  ASSERT_FALSE(image->isMask);
+  ASSERT_EQ(4u, image->elementSize);
+  ASSERT_EQ(ascendingImageResolution, image->resolution);
+  ASSERT_EQ(ImageStackLoaderBST<Img>(ascendingImageFile).dataOffset(),
+            image->dataOffset);
+
+  auto const *mask = catalog.find(ascendingMaskFile);
+  ASSERT_NE(nullptr, mask);
+  ASSERT_TRUE(mask->isMask);
+  ASSERT_EQ(1u, mask->elementSize);
+  ASSERT_EQ(ascendingImageResolution, mask->resolution);
+  ASSERT_EQ(MaskLoader(ascendingMaskFile).dataOffset(),
+            mask->dataOffset);
+
+  ASSERT_EQ(nullptr, catalog.find(dataDir + "/README.md"));
+  ASSERT_THROW(BSTCatalog::scan(dataDir + "/nonexistent"), std::runtime_error);
+}
+
+/// Saves and loads an index, then rescans a directory tree with the index
+/// after modifying, adding and removing files. Tests if
+///   - the loaded index equals the saved catalog
+///   - only changed files are read again
+///   - files with an inconsistent header are marked invalid
+TEST(BSTCatalog, Index) {
+  char tmpl[] = "/tmp/testBSTCatalogXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(tmpl));
+  std::string const dir = tmpl;
+  std::string const sub = dir + "/sub";
+  ASSERT_EQ(0, mkdir(sub.c_str(), 0700));
+  std::string const index = dir + "/index.bin";
+
+  copyFile(ascendingImageFile, dir + "/a.bst");
+  copyFile(ascendingMaskFile, sub + "/b.bst");
+  copyFile(ascendingImageFile, sub + "/c.bst");
+
+  auto const first = BSTCatalog::update(dir, index);
+  ASSERT_EQ(3u, first.size());
+  ASSERT_EQ(0u, first.numReused());
+
+  auto const loaded = BSTCatalog::load(index);
+  ASSERT_EQ(first.size(), loaded.size());
+  for (Size i = 0; i < first.size(); ++i) {
+    auto const &a = first.entries()[i];
+    auto const &b = loaded.entries()[i];
+    ASSERT_EQ(a.path, b.path);
+    ASSERT_EQ(a.fileSize, b.fileSize);
+    ASSERT_EQ(a.modificationTime, b.modificationTime);
+    ASSERT_EQ(a.isMask, b.isMask);
+    ASSERT_EQ(a.valid, b.valid);
+    ASSERT_EQ(a.elementSize, b.elementSize);
+    ASSERT_EQ(a.size, b.size);
+    ASSERT_EQ(a.resolution, b.resolution);
+    ASSERT_EQ(a.dataOffset, b.dataOffset);
+  }
+
+  // truncate c.bst, remove b.bst and add d.bst
+  {
+    std::ofstream out(sub + "/c.bst", std::ios_base::out |
+                                         std::ios_base::binary |
+                                         std::ios_base::app);
+    out << "trailing";
+  }
+  std::remove((sub + "/b.bst").c_str());
+  copyFile(ascendingMaskFile, dir + "/d.bst");
+
+  auto const second = BSTCatalog::update(dir, index);
+  ASSERT_EQ(3u, second.size());
+  ASSERT_EQ(1u, second.numReused());
+  ASSERT_NE(nullptr, second.find(dir + "/d.bst"));
+  ASSERT_EQ(nullptr, second.find(sub + "/b.bst"));
+  ASSERT_FALSE(second.find(sub + "/c.bst")->valid);
+  ASSERT_TRUE(second.find(dir + "/d.bst")->valid);
+
+  auto const third = BSTCatalog::scan(dir, BSTCatalog::load(index));
+  ASSERT_EQ(3u, third.numReused());
+
+  std::remove((sub + "/c.bst").c_str());
+  std::remove((dir + "/a.bst").c_str());
+  std::remove((dir + "/d.bst").c_str());
+  std::remove(index.c_str());
+  rmdir(sub.c_str());
+  rmdir(dir.c_str());
+
+  ASSERT_THROW(BSTCatalog::load(index), std::runtime_error);
+}
+
+/// Scans masks with wider voxels and with trailing bytes. Tests if
+///   - the element size is derived from the size of the data
+///   - files whose data size is not a multiple of the number of voxels are
+///     marked invalid
+TEST(BSTCatalog, MaskElementSize) {
+  char tmpl[] = "/tmp/testBSTCatalogXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(tmpl));
+  std::string const dir = tmpl;
+
+  std::string header;
+  {
+    std::ifstream in(ascendingMaskFile,
+                     std::ios_base::in | std::ios_base::binary);
+    for (int i = 0; i < 4; ++i) {
+      std::string line;
+      std::getline(in, line);
+      header += line + '\n';
+    }
+  }
+  auto const n = indexProduct(ascendingImageSize);
+  {
+    std::ofstream out(dir + "/wide.bst",
+                      std::ios_base::out | std::ios_base::binary);
+    out << header << std::string(2 * n, '\1');
+    std::ofstream trailing(dir + "/trailing.bst",
+                           std::ios_base::out | std::ios_base::binary);
+    trailing << header << std::string(n + 3, '\1');
+  }
+
+  auto const catalog = BSTCatalog::scan(dir);
+  ASSERT_EQ(2u, catalog.size());
+
+  auto const *wide = catalog.find(dir + "/wide.bst");
+  ASSERT_NE(nullptr, wide);
+  ASSERT_TRUE(wide->isMask);
+  ASSERT_TRUE(wide->valid);
+  ASSERT_EQ(2u, wide->elementSize);
+  ASSERT_EQ(header.size(), wide->dataOffset);
+  ASSERT_EQ(ascendingImageSize, wide->size);
+
+  ASSERT_FALSE(catalog.find(dir + "/trailing.bst")->valid);
+
+  std::remove((dir + "/wide.bst").c_str());
+  std::remove((dir + "/trailing.bst").c_str());
+  rmdir(dir.c_str());
+}
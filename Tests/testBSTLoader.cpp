@@ -9,11 +9,16 @@
 
 #include <ImageStack/ImageStack.h>
 #include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/MappedFileStorage.h>
+#include <ImageStack/OriginDecorator.h>
 #include <ImageStack/ResolutionDecorator.h>
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <vector>
 
 #pragma clang diagnostic ignored "-Wcovered-switch-default"
 #pragma clang diagnostic ignored "-Wexit-time-destructors"
@@ -263,3 +268,180 @@ TEST(BSTLoader, AscendingMask) {
     }
   }
 }
+
+/// Reads the ascending test image through a generic output iterator and tests
+/// if the values match the ones read into contiguous memory
+TEST(BSTLoader, ReadDataIterator) {
+  ImgLoader loader(ascendingImageFile);
+  std::vector<double> values;
+  loader.readData<float>(std::back_inserter(values));
+
+  Img const img((ImgLoader(ascendingImageFile)));
+  auto const map = img.map();
+
+  ASSERT_EQ(map.linearSize(), values.size());
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), values.cbegin()));
+}
+
+/// Loads the ascending test image and mask using multiple threads and tests
+/// if the result equals the result of the serial loader
+TEST(BSTLoader, ParallelRead) {
+  {
+    Img const img(ImgLoader(ascendingImageFile), ParallelTag{});
+    Img const ref((ImgLoader(ascendingImageFile)));
+
+    ASSERT_EQ(ascendingImageSize, img.size());
+    ASSERT_EQ(ascendingImageResolution, img.resolution);
+    auto const map = img.map();
+    ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), ref.map().cbegin()));
+  }
+
+  {
+    Mask const mask(MaskLoader(ascendingMaskFile), ParallelTag{});
+    Mask const ref((MaskLoader(ascendingMaskFile)));
+
+    ASSERT_EQ(ascendingImageSize, mask.size());
+    auto const map = mask.map();
+    ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), ref.map().cbegin()));
+  }
+}
+
+/// Loads several regions of the ascending test image, with partial rows, full
+/// rows and full slices, serially, in parallel and through an iterator. Tests
+/// if
+///   - the size, origin and resolution are correct
+///   - all values match the ones of the whole image
+///   - regions exceeding the volume are rejected
+TEST(BSTLoader, Region) {
+  using RegionImg = ::ImageStack::ImageStack<float, HostStorage,
+                                             ResolutionDecorator,
+                                             OriginDecorator>;
+  using RegionLoader = ImageStackLoaderBST<RegionImg>;
+
+  Img const ref((ImgLoader(ascendingImageFile)));
+  auto const refMap = ref.map();
+
+  auto const check = [&refMap](auto const &map, Index3 const &origin,
+                               Size3 const &extent) {
+    for (Size z = 0; z < extent[2]; ++z)
+      for (Size y = 0; y < extent[1]; ++y)
+        for (Size x = 0; x < extent[0]; ++x)
+          ASSERT_EQ(refMap[Size3(origin + Size3(x, y, z))],
+                    map[Size3(x, y, z)]);
+  };
+
+  for (auto const &region :
+       {std::make_pair(Index3(3, 5, 2), Size3(7, 11, 4)),
+        std::make_pair(Index3(0, 5, 2), Size3(20, 11, 4)),
+        std::make_pair(Index3(0, 0, 1), Size3(20, 40, 9)),
+        std::make_pair(Index3(19, 39, 9), Size3(1, 1, 1))}) {
+    auto const &origin = region.first;
+    auto const &extent = region.second;
+
+    RegionLoader loader(ascendingImageFile, origin, extent);
+    ASSERT_EQ(extent, loader.size());
+    ASSERT_EQ(ascendingImageSize, loader.volumeSize());
+    ASSERT_EQ(origin, loader.origin());
+
+    RegionImg const img(loader);
+    ASSERT_EQ(extent, img.size());
+    ASSERT_EQ(origin, img.origin);
+    ASSERT_EQ(ascendingImageResolution, img.resolution);
+    check(img.map(), origin, extent);
+
+    RegionImg const imgPar(RegionLoader(ascendingImageFile, origin, extent),
+                           ParallelTag{});
+    check(imgPar.map(), origin, extent);
+
+    std::vector<float> values;
+    RegionLoader(ascendingImageFile, origin, extent)
+        .readData<float>(std::back_inserter(values));
+    ASSERT_EQ(indexProduct(extent), values.size());
+    check(MappedHostMemory<float, 3>(values.data(), extent), origin, extent);
+  }
+
+  ASSERT_EQ(Index3::Zero(), origin(ref));
+
+  ASSERT_THROW(RegionLoader(ascendingImageFile, Index3(10, 0, 0),
+                            Size3(11, 1, 1))
+                   .size(),
+               std::out_of_range);
+}
+
+/// Loads the ascending test image and mask into stacks of a different voxel
+/// type, with and without scaling, serially, in parallel and as region. Tests
+/// if
+///   - all values equal the converted values of the image loaded without
+///     conversion
+///   - values outside the range of an integral type are clamped
+///   - MappedFileStorage falls back to reading when a conversion is needed
+TEST(BSTLoader, Conversion) {
+  using DoubleImg =
+      ::ImageStack::ImageStack<double, HostStorage, ResolutionDecorator>;
+  using ShortImg = ::ImageStack::ImageStack<std::int16_t, HostStorage>;
+  using CharImg = ::ImageStack::ImageStack<std::int8_t, HostStorage>;
+
+  Img const ref((ImgLoader(ascendingImageFile)));
+  auto const refMap = ref.map();
+
+  {
+    using Loader = ImageStackLoaderBST<DoubleImg, false, float>;
+    DoubleImg const img((Loader(ascendingImageFile)));
+    ASSERT_EQ(ascendingImageSize, img.size());
+    ASSERT_EQ(ascendingImageResolution, img.resolution);
+    ASSERT_TRUE(std::equal(refMap.cbegin(), refMap.cend(),
+                           img.map().cbegin()));
+
+    Loader scaled(ascendingImageFile);
+    scaled.setScaling(0.5, 1000.0);
+    DoubleImg const imgPar(scaled, ParallelTag{});
+    ASSERT_TRUE(std::equal(
+        refMap.cbegin(), refMap.cend(), imgPar.map().cbegin(),
+        [](float a, double b) { return 0.5 * double(a) + 1000.0 == b; }));
+  }
+
+  {
+    // -2000..5999.5 does not fit into int16 after scaling by 10
+    ImageStackLoaderBST<ShortImg, false, float> loader(ascendingImageFile);
+    loader.setScaling(10.0);
+    ShortImg const img(loader);
+    auto const map = img.map();
+    for (Size i = 0; i < map.linearSize(); ++i) {
+      auto const v = std::round(10.0 * double(refMap[i]));
+      ASSERT_EQ(std::max(-32768.0, std::min(32767.0, v)), double(map[i]));
+    }
+  }
+
+  {
+    Mask const mask((MaskLoader(ascendingMaskFile)));
+    auto const maskMap = mask.map();
+
+    ImageStackLoaderBST<Img, true, Mask::StorageType> loader(
+        ascendingMaskFile, Index3(2, 3, 4), Size3(5, 6, 3));
+    loader.setScaling(2.0, 1.0);
+    Img const img(loader);
+    for (Size z = 0; z < 3; ++z)
+      for (Size y = 0; y < 6; ++y)
+        for (Size x = 0; x < 5; ++x)
+          ASSERT_EQ(2.0f * float(maskMap[Size3(x + 2, y + 3, z + 4)]) + 1.0f,
+                    img.map()[Size3(x, y, z)]);
+
+    // Values greater than 127 are clamped
+    CharImg const chars(
+        ImageStackLoaderBST<CharImg, true, Mask::StorageType>(
+            ascendingMaskFile),
+        ParallelTag{});
+    ASSERT_TRUE(std::equal(
+        maskMap.cbegin(), maskMap.cend(), chars.map().cbegin(),
+        [](auto a, std::int8_t b) { return std::min(127, int(a)) == b; }));
+  }
+
+  {
+    using MappedImg = ::ImageStack::ImageStack<float, MappedFileStorage>;
+    ImageStackLoaderBST<MappedImg> loader(ascendingImageFile);
+    loader.setScaling(-1.0);
+    MappedImg const img(loader);
+    ASSERT_TRUE(std::equal(refMap.cbegin(), refMap.cend(), img.map().cbegin(),
+                           [](float a, float b) { return -a == b; }));
+  }
+}
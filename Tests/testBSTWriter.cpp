@@ -0,0 +1,128 @@
+/// @file testBSTWriter.cpp
+/// @brief Contains unit tests for ImageStackWriterBST
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/ImageStackWriterBST.h>
+#include <ImageStack/ResolutionDecorator.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+static Size3 const ascendingImageSize{20, 40, 10};
+static Eigen::Vector3d const ascendingImageResolution{0.25, 0.5, 1.0};
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using Mask =
+    ::ImageStack::ImageStack<std::uint8_t, HostStorage, ResolutionDecorator>;
+
+static std::vector<char> readFile(std::string const &filename) {
+  std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+}
+
+/// Tries to create a writer with an invalid file path and tests if an
+/// exception is thrown
+TEST(BSTWriter, InvalidPath) {
+  ASSERT_THROW(ImageStackWriterBST<Img>("/nonexistent/dir/file.bst"),
+               std::runtime_error);
+}
+
+/// Loads the ascending test image, writes it and tests if
+///   - the written file is identical to the original file
+///   - loading the written file gives the same image
+TEST(BSTWriter, AscendingImage) {
+  auto const filename = ::testing::TempDir() + "ascending_Slices.bst";
+
+  Img const img((ImageStackLoaderBST<Img>(ascendingImageFile)));
+  ImageStackWriterBST<Img>(filename).write(img);
+
+  ASSERT_EQ(readFile(ascendingImageFile), readFile(filename));
+
+  Img const written((ImageStackLoaderBST<Img>(filename)));
+  ASSERT_EQ(ascendingImageSize, written.size());
+  ASSERT_EQ(ascendingImageResolution, written.resolution);
+  ASSERT_TRUE(std::equal(img.map().cbegin(), img.map().cend(),
+                         written.map().cbegin()));
+}
+
+/// Loads the ascending test mask, writes it and tests if
+///   - the written file is identical to the original one, except for the
+///     measurement date
+///   - loading the written file gives the same mask
+TEST(BSTWriter, AscendingMask) {
+  auto const filename = ::testing::TempDir() + "ascending_Mask.bst";
+
+  Mask const mask((ImageStackLoaderBST<Mask, true>(ascendingMaskFile)));
+  ImageStackWriterBST<Mask, true>(filename).write(mask);
+
+  auto const ref = readFile(ascendingMaskFile);
+  auto data = readFile(filename);
+  ASSERT_EQ(ref.size(), data.size());
+
+  // The date has the format YYYY-MM-DD
+  std::string const dateTag = "Measurement date: ";
+  auto const date = std::search(ref.cbegin(), ref.cend(), dateTag.cbegin(),
+                                dateTag.cend()) -
+                    ref.cbegin() + static_cast<long>(dateTag.size());
+  std::copy_n(ref.cbegin() + date, 10, data.begin() + date);
+  ASSERT_EQ(ref, data);
+
+  Mask const written((ImageStackLoaderBST<Mask, true>(filename)));
+  ASSERT_EQ(ascendingImageSize, written.size());
+  ASSERT_EQ(ascendingImageResolution, written.resolution);
+  ASSERT_TRUE(std::equal(mask.map().cbegin(), mask.map().cend(),
+                         written.map().cbegin()));
+}
+
+/// Writes an image larger than the internal block size, loads it serially,
+/// in parallel and through a region and tests if all values are correct
+TEST(BSTWriter, LargeImage) {
+  using BigImg = ::ImageStack::ImageStack<float, HostStorage>;
+  auto const filename = ::testing::TempDir() + "large_Slices.bst";
+
+  Size3 const size{256, 256, 40};
+  BigImg img(size, 0.f);
+  auto map = img.map();
+  std::iota(map.begin(), map.end(), 0.f);
+  ImageStackWriterBST<BigImg>(filename).write(img);
+
+  BigImg const serial((ImageStackLoaderBST<BigImg>(filename)));
+  BigImg const parallel(ImageStackLoaderBST<BigImg>(filename), ParallelTag{});
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), serial.map().cbegin()));
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), parallel.map().cbegin()));
+
+  BigImg const region(ImageStackLoaderBST<BigImg>(filename, Index3(0, 0, 3),
+                                                  Size3(256, 256, 30)));
+  auto const regionMap = region.map();
+  ASSERT_TRUE(std::equal(regionMap.cbegin(), regionMap.cend(),
+                         map.cbegin() + 3 * 256 * 256));
+}
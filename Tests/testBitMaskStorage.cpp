@@ -0,0 +1,171 @@
+/// @file testBitMaskStorage.cpp
+/// @brief Contains unit tests for BitMaskStorage
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/BitMaskStorage.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+static std::string const onesMaskFile = kTestDataDir + "/ones_Mask.bst"s;
+
+using Mask =
+    ::ImageStack::ImageStack<std::uint8_t, HostStorage, ResolutionDecorator>;
+using PackedMask = BitMask<std::uint8_t, ResolutionDecorator>;
+using PlainMask = BitMask<std::uint8_t>;
+
+/// Creates a mask with every third voxel set
+static PlainMask everyThird(Size3 const &size) {
+  std::vector<std::uint8_t> values(indexProduct(size));
+  for (Size i = 0; i < values.size(); ++i) values[i] = i % 3 == 0 ? 7 : 0;
+  return PlainMask(BitMaskStorage<std::uint8_t>(size, values));
+}
+
+/// Creates masks and tests if
+///   - values are packed as 0 and 1
+///   - proxies read and write single bits
+///   - iteration visits the voxels in logical order
+///   - the padding bits of the last word stay 0
+TEST(BitMaskStorage, Access) {
+  Size3 const size(5, 3, 7);
+  auto mask = everyThird(size);
+  ASSERT_EQ(size, mask.size());
+
+  auto map = mask.map();
+  for (Size i = 0; i < map.linearSize(); ++i)
+    ASSERT_EQ(i % 3 == 0 ? 1 : 0, map[i]);
+  ASSERT_EQ(1, map[Index3(4, 1, 2)]);
+  ASSERT_EQ(0, map[Index3(3, 1, 2)]);
+
+  map[Index3(3, 1, 2)] = 42;
+  ASSERT_EQ(1, map[Index3(3, 1, 2)]);
+  map[Size{0}] = 0;
+  ASSERT_EQ(0, map[Size{0}]);
+  map[Size{1}] = map[Index3(3, 1, 2)];
+  ASSERT_EQ(1, map[Size{1}]);
+
+  std::vector<std::uint8_t> values(map.begin(), map.end());
+  ASSERT_EQ(map.linearSize(), values.size());
+  for (Size i = 0; i < values.size(); ++i) ASSERT_EQ(map[i], values[i]);
+
+  *(map.begin() + 2) = 1;
+  ASSERT_EQ(1, map[Size{2}]);
+
+  PlainMask const ones(BitMaskStorage<std::uint8_t>(size, 1));
+  ASSERT_EQ(105u, count(ones));
+  auto const last = ones.map().words()[ones.map().numWords() - 1];
+  ASSERT_EQ(detail::lastWordMask(105), last);
+}
+
+/// Loads masks packed and unpacked and tests if
+///   - both contain the same voxels (non-zero voxels are 1)
+///   - the voxel count matches
+///   - nearest neighbor sampling gives the same results
+TEST(BitMaskStorage, Load) {
+  using MaskLoader = ImageStackLoaderBST<Mask, true>;
+  using PackedMaskLoader = ImageStackLoaderBST<PackedMask, true>;
+
+  for (auto const &file : {ascendingMaskFile, onesMaskFile}) {
+    Mask const ref{MaskLoader(file)};
+    PackedMask const mask{PackedMaskLoader(file)};
+    ASSERT_EQ(ref.size(), mask.size());
+    ASSERT_EQ(ref.resolution, mask.resolution);
+
+    auto const refMap = ref.map();
+    ASSERT_TRUE(std::equal(refMap.begin(), refMap.end(), mask.map().begin(),
+                           [](auto a, auto b) { return (a != 0) == b; }));
+    ASSERT_EQ(static_cast<Size>(std::count_if(
+                  refMap.begin(), refMap.end(), [](auto v) { return v != 0; })),
+              count(mask));
+
+    Sampler::Sampler<> sampler;
+    for (double z = -0.5; z < 11; z += 0.7)
+      for (double y = -0.5; y < 41; y += 1.3)
+        for (double x = -0.5; x < 21; x += 0.9) {
+          Eigen::Vector3d const pos(x, y, z);
+          ASSERT_EQ(sampler(ref, pos) != 0, sampler(mask, pos) != 0);
+        }
+  }
+}
+
+/// Tests the word wise boolean operations against voxel wise results
+TEST(BitMaskStorage, BooleanOps) {
+  Size3 const size(13, 11, 9);
+  auto const a = everyThird(size);
+  PlainMask b(BitMaskStorage<std::uint8_t>(size, 0));
+  auto bMap = b.map();
+  for (Size i = 0; i < bMap.linearSize(); ++i) bMap[i] = i % 2;
+
+  auto const andMask = a & b;
+  auto const orMask = a | b;
+  auto const xorMask = a ^ b;
+  auto const notMask = ~a;
+
+  for (Size i = 0; i < indexProduct(size); ++i) {
+    bool const x = i % 3 == 0, y = i % 2 == 1;
+    ASSERT_EQ(x && y, andMask.map()[i] != 0);
+    ASSERT_EQ(x || y, orMask.map()[i] != 0);
+    ASSERT_EQ(x != y, xorMask.map()[i] != 0);
+    ASSERT_EQ(!x, notMask.map()[i] != 0);
+  }
+
+  auto const n = indexProduct(size);
+  ASSERT_EQ(n, count(a) + count(notMask));
+
+  auto c = a;
+  c |= notMask;
+  ASSERT_EQ(n, count(c));
+  c ^= a;
+  ASSERT_EQ(count(notMask), count(c));
+  c &= a;
+  ASSERT_EQ(0u, count(c));
+}
+
+/// Tests if iterating over set bits visits exactly the set voxels, in order
+/// for the sequential and in any order for the parallel overload
+TEST(BitMaskStorage, ForEachSetBit) {
+  Size3 const size(17, 9, 5);
+  auto const mask = everyThird(size);
+
+  std::vector<Index3> visited;
+  forEachSetBit(mask,
+                [&visited](Index3 const &pos) { visited.push_back(pos); });
+  ASSERT_EQ(count(mask), visited.size());
+  for (Size k = 0; k < visited.size(); ++k)
+    ASSERT_EQ(3 * k, toLinear(visited[k], size));
+
+  std::atomic<Size> sum{0};
+  forEachSetBit(
+      mask, [&sum, &size](Index3 const &pos) { sum += toLinear(pos, size); },
+      ParallelTag{});
+  Size expected = 0;
+  for (auto const &pos : visited) expected += toLinear(pos, size);
+  ASSERT_EQ(expected, sum.load());
+}
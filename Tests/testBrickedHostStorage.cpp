@@ -0,0 +1,155 @@
+/// @file testBrickedHostStorage.cpp
+/// @brief Contains unit tests for BrickedHostStorage and MappedBrickedMemory
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/BrickedHostStorage.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using BrickedImg =
+    ::ImageStack::ImageStack<float, BrickedHostStorage, ResolutionDecorator>;
+using BrickedMask = ::ImageStack::ImageStack<std::uint8_t, BrickedHostStorage16,
+                                             ResolutionDecorator>;
+
+/// Tests that a size that is not a multiple of the brick size round trips
+/// through the bricked layout and that
+///   - multi index and linear index access use logical coordinates
+///   - iteration visits the voxels in logical (x-fastest) order
+///   - @c toLinear() restores the linear layout
+TEST(BrickedHostStorage, LinearRoundTrip) {
+  Size3 const size(19, 10, 17);
+  std::vector<int> linear(indexProduct(size));
+  std::iota(linear.begin(), linear.end(), 0);
+
+  BrickedHostStorage<int> const store(size, linear);
+  ASSERT_EQ(size, store.size());
+  ASSERT_EQ(linear.size(), store.linearSize());
+
+  auto const map = store.map();
+  ASSERT_EQ(linear.size(), map.linearSize());
+  ASSERT_EQ(static_cast<Size>(std::distance(map.begin(), map.end())),
+            linear.size());
+  ASSERT_TRUE(std::equal(map.begin(), map.end(), linear.cbegin()));
+
+  for (Index z = 0; z < size[2]; ++z)
+    for (Index y = 0; y < size[1]; ++y)
+      for (Index x = 0; x < size[0]; ++x) {
+        auto const i = toLinear(Index3(x, y, z), size);
+        ASSERT_EQ(linear[i], map[Index3(x, y, z)]);
+        ASSERT_EQ(linear[i], map[i]);
+      }
+
+  auto it = map.begin() + 1234;
+  ASSERT_EQ(1234, *it);
+  ASSERT_EQ(1233, *--it);
+  ASSERT_EQ(1240, it[7]);
+
+  HostStorage<int> out(size, -1);
+  store.toLinear(out.map());
+  ASSERT_TRUE(std::equal(linear.cbegin(), linear.cend(), out.map().begin()));
+
+  BrickedHostStorage<int> const fromHost(out.map());
+  ASSERT_TRUE(std::equal(fromHost.map().begin(), fromHost.map().end(),
+                         linear.cbegin()));
+}
+
+/// Tests that voxels of the same brick are stored contiguously
+TEST(BrickedHostStorage, Layout) {
+  BrickedHostStorage<int> store(Size3(20, 20, 20), 0);
+  auto map = store.map();
+
+  ASSERT_EQ(8, store.brickSize());
+  ASSERT_EQ(0, map.offset(0, 0, 0));
+  ASSERT_EQ(1, map.offset(1, 0, 0));
+  ASSERT_EQ(8, map.offset(0, 1, 0));
+  ASSERT_EQ(64, map.offset(0, 0, 1));
+  ASSERT_EQ(511, map.offset(7, 7, 7));
+  ASSERT_EQ(512, map.offset(8, 0, 0));
+  ASSERT_EQ(3 * 512, map.offset(0, 8, 0));
+  ASSERT_EQ(9 * 512, map.offset(0, 0, 8));
+
+  map[Index3(9, 1, 2)] = 42;
+  ASSERT_EQ(42, map.bricks()[map.offset(9, 1, 2)]);
+}
+
+/// Loads the ascending image and mask into bricked storage and compares them
+/// to the linear layout. The image loader reads slabs of slices, the loaded
+/// stacks are also compared to a conversion through the cast constructor.
+TEST(BrickedHostStorage, Load) {
+  using ImgLoader = ImageStackLoaderBST<Img, false>;
+  using BrickedImgLoader = ImageStackLoaderBST<BrickedImg, false>;
+  using BrickedMaskLoader = ImageStackLoaderBST<BrickedMask, true>;
+  using Mask =
+      ::ImageStack::ImageStack<std::uint8_t, HostStorage, ResolutionDecorator>;
+  using MaskLoader = ImageStackLoaderBST<Mask, true>;
+
+  static_assert(detail::HasReadSlices<BrickedImgLoader, float>::value,
+                "BST loader must support reading slices");
+
+  Img const ref{ImgLoader(ascendingImageFile)};
+  BrickedImg const img{BrickedImgLoader(ascendingImageFile)};
+  ASSERT_EQ(ref.size(), img.size());
+  ASSERT_EQ(ref.resolution, img.resolution);
+  ASSERT_TRUE(
+      std::equal(ref.map().begin(), ref.map().end(), img.map().begin()));
+
+  BrickedImg const converted(ref);
+  ASSERT_TRUE(
+      std::equal(ref.map().begin(), ref.map().end(), converted.map().begin()));
+
+  Mask const refMask{MaskLoader(ascendingMaskFile)};
+  BrickedMask const mask{BrickedMaskLoader(ascendingMaskFile)};
+  ASSERT_TRUE(std::equal(refMask.map().begin(), refMask.map().end(),
+                         mask.map().begin()));
+}
+
+/// Tests that the sampler gives the same results for bricked and linear
+/// storage
+TEST(BrickedHostStorage, Sampler) {
+  using ImgLoader = ImageStackLoaderBST<Img, false>;
+  using BrickedImgLoader = ImageStackLoaderBST<BrickedImg, false>;
+
+  Img const ref{ImgLoader(ascendingImageFile)};
+  BrickedImg const img{BrickedImgLoader(ascendingImageFile)};
+
+  Sampler::Sampler<Sampler::CoordTransform::Identity,
+                   Sampler::Interpolation::Linear>
+      sampler;
+  for (double z = -0.5; z < 11; z += 0.7)
+    for (double y = -0.5; y < 41; y += 1.3)
+      for (double x = -0.5; x < 21; x += 0.9) {
+        Eigen::Vector3d const pos(x, y, z);
+        ASSERT_DOUBLE_EQ(sampler(ref, pos), sampler(img, pos));
+      }
+}
@@ -0,0 +1,52 @@
+/// @file testByteSwap.cpp
+/// @brief Contains unit tests for the vectorized byte order conversion
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+
+#include <ImageStack/ByteSwap.h>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace ImageStack;
+
+template <class T> class ByteSwapTest : public ::testing::Test {};
+
+using ByteSwapTypes =
+    ::testing::Types<std::uint8_t, std::int16_t, std::uint32_t, float,
+                     std::int64_t, double>;
+
+TYPED_TEST_CASE(ByteSwapTest, ByteSwapTypes);
+
+/// Fills buffers of various lengths (to cover the vectorized part as well as
+/// the scalar tail) with random data and tests if
+///   - `swapBytes` gives the same result as `ChangeEndianness`
+///   - swapping twice restores the original data
+TYPED_TEST(ByteSwapTest, MatchesScalar) {
+  using T = TypeParam;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(0, 255);
+
+  for (std::size_t n : {0, 1, 7, 15, 16, 17, 63, 64, 65, 1000, 4099}) {
+    std::vector<T> values(n);
+    auto *bytes = reinterpret_cast<std::uint8_t *>(values.data());
+    for (std::size_t i = 0; i < n * sizeof(T); ++i)
+      bytes[i] = static_cast<std::uint8_t>(dist(gen));
+
+    auto swapped = values;
+    swapBytes(swapped.data(), swapped.size());
+
+    for (std::size_t i = 0; i < n; ++i) {
+      auto const ref = ChangeEndianness(values[i]);
+      ASSERT_EQ(0, std::memcmp(&ref, &swapped[i], sizeof(T)));
+    }
+
+    swapBytes(swapped.data(), swapped.size());
+    ASSERT_EQ(0, std::memcmp(values.data(), swapped.data(), n * sizeof(T)));
+  }
+}
@@ -0,0 +1,162 @@
+/// @file testConversion.cpp
+/// @brief Contains unit tests for the conversion of image stacks
+
+#include <ImageStack/BitMaskStorage.h>
+#include <ImageStack/BrickedHostStorage.h>
+#include <ImageStack/Conversion.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackView.h>
+#include <ImageStack/ResolutionDecorator.h>
+
+#include <gtest/gtest.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+
+/// @brief Creates an image with the values `start, start + step, ...`
+static Img ramp(Size3 const &size, float start, float step) {
+  Img img(size, 0.0f);
+  img.resolution = Eigen::Vector3d(0.5, 0.25, 2.0);
+  auto map = img.map();
+  float v = start;
+  for (auto &x : map) {
+    x = v;
+    v += step;
+  }
+  return img;
+}
+
+/// Converts a float image to integral types and tests if
+///   - values are rounded to the nearest integer
+///   - values outside of the target range are clamped
+///   - NaN is converted to 0
+///   - the decorators are copied
+TEST(Conversion, Saturate) {
+  auto img = ramp(Size3(13, 7, 5), -300.25f, 1.5f);
+  img.map()[Size{3}] = std::numeric_limits<float>::quiet_NaN();
+
+  auto const u8 = convert<std::uint8_t>(img);
+  auto const i16 = convert<std::int16_t>(img);
+  ASSERT_EQ(img.size(), u8.size());
+  ASSERT_EQ(img.resolution, u8.resolution);
+
+  auto const src = img.map();
+  for (Size i = 0; i < src.linearSize(); ++i) {
+    auto const v = src[i];
+    if (std::isnan(v)) {
+      ASSERT_EQ(0, u8.map()[i]);
+      ASSERT_EQ(0, i16.map()[i]);
+      continue;
+    }
+    auto const rounded = std::round(v);
+    ASSERT_EQ(std::min(std::max(rounded, 0.0f), 255.0f), u8.map()[i]);
+    ASSERT_EQ(rounded, i16.map()[i]);
+  }
+}
+
+/// Converts an int16 image with a slope and intercept and tests if the
+/// values are scaled and converted to the target storage
+TEST(Conversion, Scale) {
+  ::ImageStack::ImageStack<std::int16_t> ct(Size3(20, 11, 9), std::int16_t{0});
+  auto ctMap = ct.map();
+  std::iota(ctMap.begin(), ctMap.end(), std::int16_t{-900});
+
+  auto const hu = convert<float, BrickedHostStorage>(ct, 0.5, -1024.0);
+  auto const ctConst = ct.map();
+  for (Size i = 0; i < ctConst.linearSize(); ++i)
+    ASSERT_FLOAT_EQ(0.5f * ctConst[i] - 1024.0f, hu.map()[i]);
+
+  auto const back = convert<std::int16_t>(hu, 2.0, 2048.0);
+  ASSERT_TRUE(std::equal(ctConst.begin(), ctConst.end(), back.map().begin()));
+}
+
+/// Converts value ranges and tests if
+///   - the source range is mapped linearly to the target range
+///   - values outside of the source range are clamped
+///   - non-contiguous images (views) and bit masks can be converted
+TEST(Conversion, Range) {
+  auto const img = ramp(Size3(10, 10, 10), -1500.0f, 3.0f);
+
+  auto const display = convertRange<std::uint8_t>(img, -1000, 1000);
+  auto const srcMap = img.map();
+  for (Size i = 0; i < srcMap.linearSize(); ++i) {
+    auto const expected =
+        std::round((std::min(std::max(srcMap[i], -1000.0f), 1000.0f) + 1000) *
+                   255.0f / 2000.0f);
+    ASSERT_EQ(expected, display.map()[i]);
+  }
+
+  auto const unit = convertRange<float>(img, -1500, 1497, 0, 1);
+  ASSERT_FLOAT_EQ(0.0f, unit.map()[Size{0}]);
+  ASSERT_FLOAT_EQ(1.0f, unit.map()[Size{999}]);
+
+  auto const sub = subVolume(img, Index3(2, 3, 4), Size3(5, 4, 3));
+  auto const subDisplay = convertRange<std::uint8_t>(sub, -1000, 1000);
+  ASSERT_EQ(Size3(5, 4, 3), subDisplay.size());
+  for (Size z = 0; z < 3; ++z)
+    for (Size y = 0; y < 4; ++y)
+      for (Size x = 0; x < 5; ++x)
+        ASSERT_EQ(display.map()[Index3(x + 2, y + 3, z + 4)],
+                  subDisplay.map()[Index3(x, y, z)]);
+
+  auto const mask = convertRange<std::uint8_t, BitMaskStorage>(img, 0, 1, 0, 1);
+  for (Size i = 0; i < srcMap.linearSize(); ++i)
+    ASSERT_EQ(srcMap[i] >= 0.5f ? 1 : 0, mask.map()[i]);
+}
+
+/// Tests if the cast constructor converts between types and storages
+TEST(Conversion, CastConstructor) {
+  auto const img = ramp(Size3(33, 17, 9), -10.0f, 0.75f);
+
+  ::ImageStack::ImageStack<double, BrickedHostStorage> const bricked(img);
+  ::ImageStack::ImageStack<int> const ints(bricked);
+
+  auto const src = img.map();
+  for (Size i = 0; i < src.linearSize(); ++i) {
+    ASSERT_EQ(static_cast<double>(src[i]), bricked.map()[i]);
+    ASSERT_EQ(static_cast<int>(src[i]), ints.map()[i]);
+  }
+}
+
+/// Converts to bit masks whose slices do not start at word boundaries, using
+/// multiple threads if OpenMP is enabled. Neighboring slices share a word, so
+/// the voxels must not be written by concurrent threads.
+TEST(Conversion, BitMaskUnalignedSlices) {
+#ifdef _OPENMP
+  auto const threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+#endif
+
+  ::ImageStack::ImageStack<std::uint8_t> img(Size3(20, 40, 65),
+                                             std::uint8_t{0});
+  auto map = img.map();
+  for (Size i = 0; i < map.linearSize(); ++i)
+    map[i] = static_cast<std::uint8_t>((i * 7919) % 3 != 0);
+
+  for (int rep = 0; rep < 20; ++rep) {
+    BitMask<> const cast(img);
+    auto const converted = convert<std::uint8_t, BitMaskStorage>(img);
+    for (Size i = 0; i < map.linearSize(); ++i) {
+      ASSERT_EQ(map[i], cast.map()[i]);
+      ASSERT_EQ(map[i], converted.map()[i]);
+    }
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
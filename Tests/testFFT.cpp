@@ -0,0 +1,249 @@
+/// @file testFFT.cpp
+/// @brief Contains unit tests for the FFT and the FFT convolution
+
+#include <ImageStack/FFT.h>
+#include <ImageStack/FFTFilter.h>
+#include <ImageStack/Filter.h>
+#include <ImageStack/GaussFilter.h>
+#include <ImageStack/ImageStack.h>
+
+#include <gtest/gtest.h>
+
+#include "testHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+
+namespace ImageStack {
+namespace Filter {
+
+class RandomFilter;
+
+template <> struct Traits<RandomFilter> { using Scalar = float; };
+
+/// @brief Non-separable filter with random weights
+class RandomFilter : public FilterBase<RandomFilter> {
+public:
+  explicit RandomFilter(Size3 const &size) : size_(size) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    weights_.resize(indexProduct(size));
+    std::generate(weights_.begin(), weights_.end(), [&] { return dist(rng); });
+  }
+
+  inline Size3 size() const { return size_; }
+
+  template <class Idx> inline float const &operator[](Idx &&i) const {
+    SIndex3 const K = halfSize().cast<long>();
+    auto const x = static_cast<Size>(i[0] + K[0]);
+    auto const y = static_cast<Size>(i[1] + K[1]);
+    auto const z = static_cast<Size>(i[2] + K[2]);
+    return weights_[(z * size_[1] + y) * size_[0] + x];
+  }
+
+private:
+  Size3 size_;
+  std::vector<float> weights_;
+};
+
+class SignFilter;
+
+template <> struct Traits<SignFilter> { using Scalar = float; };
+
+/// @brief Non-separable filter whose weights are 0.6 with random signs
+///
+/// Convolving an integral image gives multiples of 0.6, which are never
+/// close to halfway between two integers, so rounding the result is not
+/// affected by the rounding errors of the FFT.
+class SignFilter : public FilterBase<SignFilter> {
+public:
+  explicit SignFilter(Size3 const &size) : size_(size) {
+    std::mt19937 rng(11);
+    std::bernoulli_distribution sign;
+    weights_.resize(indexProduct(size));
+    std::generate(weights_.begin(), weights_.end(),
+                  [&] { return sign(rng) ? 0.6f : -0.6f; });
+  }
+
+  inline Size3 size() const { return size_; }
+
+  template <class Idx> inline float const &operator[](Idx &&i) const {
+    SIndex3 const K = halfSize().cast<long>();
+    auto const x = static_cast<Size>(i[0] + K[0]);
+    auto const y = static_cast<Size>(i[1] + K[1]);
+    auto const z = static_cast<Size>(i[2] + K[2]);
+    return weights_[(z * size_[1] + y) * size_[0] + x];
+  }
+
+private:
+  Size3 size_;
+  std::vector<float> weights_;
+};
+} // namespace Filter
+} // namespace ImageStack
+
+using Img = ::ImageStack::ImageStack<float>;
+
+/// @brief Creates an image with uniformly distributed values
+static Img randomImage(Size3 const &size) {
+  return test::randomImage(size, 3, -10.0f, 10.0f);
+}
+
+/// @brief Convolves the image by summing over all taps of each voxel
+template <class F>
+static Img directConvolution(Img const &img, F const &filter, bool pad) {
+  SIndex3 const K = filter.halfSize().template cast<long>();
+  SIndex3 const shift = pad ? SIndex3::Zero() : K;
+  SIndex3 const size = img.size().cast<long>();
+  Img result(pad ? img.size() : (size - 2 * K).cast<Size>().eval(), 0.0f);
+
+  auto const src = img.map();
+  auto dst = result.map();
+  for (Size k = 0; k < result.size()[2]; ++k)
+    for (Size j = 0; j < result.size()[1]; ++j)
+      for (Size i = 0; i < result.size()[0]; ++i) {
+        SIndex3 const x = Size3(i, j, k).cast<long>() + shift;
+        double sum = 0;
+        for (auto c = -K[2]; c <= K[2]; ++c)
+          for (auto b = -K[1]; b <= K[1]; ++b)
+            for (auto a = -K[0]; a <= K[0]; ++a) {
+              SIndex3 const y(a, b, c);
+              SIndex3 const p = x - y;
+              if ((p.array() >= 0).all() && (p.array() < size.array()).all())
+                sum += double(src[p]) * double(filter[y]);
+            }
+        dst[Index3(i, j, k)] = static_cast<float>(sum);
+      }
+  return result;
+}
+
+/// @brief Tests if two images are equal up to the rounding errors of the FFT
+template <class A, class B> static void expectNear(A const &a, B const &b) {
+  test::expectNear(a, b, 1e-3);
+}
+
+/// Transforms random volumes and tests if
+///   - the spectrum equals the discrete Fourier transform
+///   - the inverse transform gives the volume multiplied by its size
+///   - axes of length 1 are supported
+TEST(FFT, RealFFT3) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  auto const pi = std::acos(-1.0);
+
+  for (auto const &size : {Size3(8, 4, 2), Size3(16, 1, 4), Size3(1, 8, 8),
+                           Size3(2, 2, 1)}) {
+    RealFFT3 const fft(size);
+    auto const s = fft.spectrumSize();
+    ASSERT_EQ(Size3(size[0] / 2 + 1, size[1], size[2]), s);
+
+    std::vector<double> volume(indexProduct(size));
+    std::generate(volume.begin(), volume.end(), [&] { return dist(rng); });
+    std::vector<Complex> spectrum(indexProduct(s));
+    fft.forward(volume.data(), spectrum.data());
+
+    for (Size w = 0; w < s[2]; ++w)
+      for (Size v = 0; v < s[1]; ++v)
+        for (Size u = 0; u < s[0]; ++u) {
+          Complex expected{0, 0};
+          for (Size z = 0; z < size[2]; ++z)
+            for (Size y = 0; y < size[1]; ++y)
+              for (Size x = 0; x < size[0]; ++x) {
+                auto const phi =
+                    -2 * pi *
+                    (double(u * x) / double(size[0]) +
+                     double(v * y) / double(size[1]) +
+                     double(w * z) / double(size[2]));
+                expected += volume[(z * size[1] + y) * size[0] + x] *
+                            Complex(std::cos(phi), std::sin(phi));
+              }
+          auto const &actual = spectrum[(w * s[1] + v) * s[0] + u];
+          ASSERT_NEAR(expected.real(), actual.real(), 1e-9);
+          ASSERT_NEAR(expected.imag(), actual.imag(), 1e-9);
+        }
+
+    std::vector<double> result(volume.size());
+    fft.inverse(spectrum.data(), result.data());
+    auto const n = static_cast<double>(volume.size());
+    for (Size i = 0; i < volume.size(); ++i)
+      ASSERT_NEAR(volume[i] * n, result[i], 1e-9);
+  }
+}
+
+/// Convolves an image with a large filter and tests if
+///   - Filter::filter() chooses the FFT convolution
+///   - the result equals the direct convolution with and without padding
+TEST(FFT, Convolution) {
+  auto const img = randomImage(Size3(23, 19, 17));
+  Filter::RandomFilter const filter(Size3(11, 9, 9));
+  ASSERT_TRUE(Filter::detail::preferFFT(filter.size()));
+  ASSERT_FALSE(Filter::detail::preferFFT(Size3(7, 7, 7)));
+
+  expectNear(directConvolution(img, filter, true),
+             Filter::filter(img, filter));
+  expectNear(directConvolution(img, filter, false),
+             Filter::filter(img, filter, false));
+}
+
+/// Convolves images with FFTFilters and tests if
+///   - small filters are applied using FFTs as well
+///   - images larger than a tile are computed using multiple tiles
+///   - the spectra are cached and reused
+///   - the result equals the separable convolution for a Gauss filter
+TEST(FFT, FFTFilter) {
+  Filter::FFTFilter<Filter::RandomFilter> const filter(
+      Filter::RandomFilter(Size3(41, 3, 5)));
+
+  auto const img = randomImage(Size3(150, 6, 11));
+  ASSERT_EQ(Size3(128, 8, 16),
+            Filter::detail::fftTileSize(filter.size(), img.size()));
+
+  auto const expected = directConvolution(img, filter, true);
+  expectNear(expected, Filter::filter(img, filter));
+  auto const &entry = filter.spectra().get(Size3(128, 8, 16), filter);
+  expectNear(expected, Filter::filter(img, filter));
+  ASSERT_EQ(&entry, &filter.spectra().get(Size3(128, 8, 16), filter));
+
+  expectNear(directConvolution(img, filter, false),
+             Filter::filter(img, filter, false));
+
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.5f, 2.0f, 1.0f));
+  auto const small = randomImage(Size3(20, 18, 9));
+  Filter::FFTFilter<Filter::GaussFilter<float>> const fftGauss(gauss);
+  expectNear(Filter::filter(small, gauss), Filter::filter(small, fftGauss));
+}
+
+/// Convolves an integral image by summing over all taps and using FFTs and
+/// tests if both round and clamp the result to the same voxels
+TEST(FFT, IntegralImage) {
+  Filter::SignFilter const filter(Size3(5, 3, 3));
+  Filter::FFTFilter<Filter::SignFilter> const fft(filter);
+  ASSERT_FALSE(Filter::detail::preferFFT(filter.size()));
+
+  ::ImageStack::ImageStack<std::uint8_t> img(Size3(17, 13, 11), 0);
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> dist(0, 60);
+  auto map = img.map();
+  std::generate(map.begin(), map.end(),
+                [&] { return static_cast<std::uint8_t>(dist(rng)); });
+
+  for (auto const pad : {true, false}) {
+    auto const direct = Filter::filter(img, filter, pad);
+    auto const transformed = Filter::filter(img, fft, pad);
+    auto const mDirect = direct.map();
+    auto const mTransformed = transformed.map();
+    ASSERT_TRUE(std::equal(mDirect.begin(), mDirect.end(),
+                           mTransformed.begin(), mTransformed.end()));
+    ASSERT_NE(mDirect.end(), std::find(mDirect.begin(), mDirect.end(), 0));
+    ASSERT_NE(mDirect.end(), std::find(mDirect.begin(), mDirect.end(), 255));
+  }
+}
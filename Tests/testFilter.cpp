@@ -0,0 +1,250 @@
+/// @file testFilter.cpp
+/// @brief Contains unit tests for Filter::filter and the filters
+
+#include <ImageStack/FFTFilter.h>
+#include <ImageStack/Filter.h>
+#include <ImageStack/GaussFilter.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackView.h>
+
+#include <gtest/gtest.h>
+
+#include "testHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+
+namespace ImageStack {
+namespace Filter {
+
+/// @brief Filter with the weights of another filter, but without the 1D
+/// kernels, so it is applied by the direct convolution
+template <class F> class DenseFilter : public FilterBase<DenseFilter<F>> {
+public:
+  explicit DenseFilter(F const &filter) : filter_(filter) {}
+
+  inline Size3 size() const { return filter_.size(); }
+
+  template <class Idx> inline auto const &operator[](Idx &&i) const {
+    return filter_[std::forward<Idx>(i)];
+  }
+
+private:
+  F const &filter_;
+};
+
+template <class F> struct Traits<DenseFilter<F>> {
+  using Scalar = typename Traits<F>::Scalar;
+};
+
+class ShiftFilter;
+
+template <> struct Traits<ShiftFilter> { using Scalar = float; };
+
+/// @brief Filter of size 3 along x moving the image by @c shift voxels,
+/// i.e. the result at @c x is the voxel at `x - shift`
+class ShiftFilter : public FilterBase<ShiftFilter> {
+public:
+  explicit ShiftFilter(long shift) : shift_(shift) {}
+
+  inline Size3 size() const { return Size3(3, 1, 1); }
+
+  template <class Idx> inline float const &operator[](Idx &&i) const {
+    return i[0] == shift_ ? one_ : zero_;
+  }
+
+private:
+  long shift_;
+  float one_{1}, zero_{0};
+};
+
+} // namespace Filter
+} // namespace ImageStack
+
+using Img = ::ImageStack::ImageStack<float>;
+
+/// @brief Creates an image with uniformly distributed values
+static Img randomImage(Size3 const &size) {
+  return test::randomImage(size, 3, -10.0f, 10.0f);
+}
+
+/// @brief Tests if two images are equal up to rounding errors
+template <class A, class B> static void expectNear(A const &a, B const &b) {
+  test::expectNear(a, b, 1e-4);
+}
+
+/// Creates Gauss filters and tests if
+///   - the 1D kernels are normalized and symmetric
+///   - the 3D weights are the products of the 1D kernels
+///   - a sigma of 0 gives an identity kernel
+TEST(GaussFilter, Kernels) {
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.5f, 0.8f, 0.0f));
+  ASSERT_EQ(Size3(11, 7, 1), gauss.size());
+  ASSERT_TRUE(Filter::detail::IsSeparable<decltype(gauss)>::value);
+
+  for (int a = 0; a < 3; ++a) {
+    auto const &k = gauss.kernel(a);
+    ASSERT_EQ(static_cast<long>(gauss.size()[a]), k.size());
+    ASSERT_NEAR(1.0f, k.sum(), 1e-6f);
+    for (long i = 0; i < k.size(); ++i) ASSERT_EQ(k[i], k[k.size() - 1 - i]);
+  }
+  ASSERT_EQ(1.0f, gauss.kernel(2)[0]);
+
+  float sum = 0;
+  for (long j = -3; j <= 3; ++j)
+    for (long i = -5; i <= 5; ++i) {
+      auto const w = gauss[SIndex3(i, j, 0)];
+      ASSERT_FLOAT_EQ(gauss.kernel(0)[i + 5] * gauss.kernel(1)[j + 3], w);
+      sum += w;
+    }
+  ASSERT_NEAR(1.0f, sum, 1e-5f);
+}
+
+/// Filters an image with a Gauss filter and tests if the separable
+/// convolution gives the same results as the direct convolution
+///   - with and without padding
+///   - for an image and a view of an image
+TEST(Filter, Separable) {
+  auto const img = randomImage(Size3(23, 19, 17));
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.0f, 1.3f, 0.7f));
+  Filter::DenseFilter<Filter::GaussFilter<float>> const dense(gauss);
+  ASSERT_FALSE(Filter::detail::IsSeparable<decltype(dense)>::value);
+
+  expectNear(Filter::filter(img, dense), Filter::filter(img, gauss));
+
+  auto const valid = Filter::filter(img, gauss, false);
+  ASSERT_EQ(Size3(23 - 6, 19 - 8, 17 - 6), valid.size());
+  expectNear(Filter::filter(img, dense, false), valid);
+
+  auto const sub = subVolume(img, Index3(2, 3, 1), Size3(15, 12, 13));
+  expectNear(Filter::filter(sub, dense), Filter::filter(sub, gauss));
+  expectNear(Filter::filter(sub, dense, false),
+             Filter::filter(sub, gauss, false));
+
+  ASSERT_THROW(Filter::filter(sub, Filter::GaussFilter<float>(
+                                       Eigen::Vector3f(3.0f, 1.0f, 1.0f)),
+                              false),
+               Filter::FilterException);
+}
+
+/// Filters an integral image with a Gauss filter and tests if the separable
+/// and the direct convolution round their results to the nearest value
+TEST(Filter, Integral) {
+  auto const real = test::randomImage(Size3(13, 11, 9), 5, 0.0f, 255.0f);
+  ::ImageStack::ImageStack<std::uint8_t> img(real.size(), 0);
+  auto const mReal = real.map();
+  auto mImg = img.map();
+  std::transform(mReal.begin(), mReal.end(), mImg.begin(),
+                 [](float v) { return static_cast<std::uint8_t>(v); });
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.0f, 1.3f, 0.7f));
+  Filter::DenseFilter<Filter::GaussFilter<float>> const dense(gauss);
+  ASSERT_FALSE(Filter::detail::preferFFT(dense.size()));
+
+  Img copy(img.size(), 0.0f);
+  auto mCopy = copy.map();
+  std::copy(mImg.begin(), mImg.end(), mCopy.begin());
+
+  auto const expectRounded = [&](auto const &filter) {
+    auto const exact = Filter::filter(copy, filter);
+    auto const result = Filter::filter(img, filter);
+    auto const mExact = exact.map();
+    auto const mResult = result.map();
+    for (Size i = 0; i < mResult.linearSize(); ++i)
+      ASSERT_EQ(std::lround(mExact[i]), mResult[i]);
+  };
+  expectRounded(gauss);
+  expectRounded(dense);
+}
+
+/// Filters images with different boundary modes and tests if
+///   - the voxels outside of the image are zero, clamped, mirrored or
+///     periodic
+///   - the direct, the separable and the FFT convolution agree
+///   - constant images stay constant unless they are padded with zeros
+TEST(Filter, Boundary) {
+  Img line(Size3(5, 1, 1), 0.0f);
+  for (Size i = 0; i < 5; ++i) line.map()[i] = float(i + 1);
+
+  auto const shifted = [&line](long shift, Filter::Boundary boundary) {
+    auto const result =
+        Filter::filter(line, Filter::ShiftFilter(shift), boundary);
+    std::vector<float> values(result.map().begin(), result.map().end());
+    return values;
+  };
+
+  using B = Filter::Boundary;
+  using V = std::vector<float>;
+  ASSERT_EQ(V({0, 1, 2, 3, 4}), shifted(1, B::Zero));
+  ASSERT_EQ(V({2, 3, 4, 5, 0}), shifted(-1, B::Zero));
+  ASSERT_EQ(V({1, 1, 2, 3, 4}), shifted(1, B::Clamp));
+  ASSERT_EQ(V({2, 3, 4, 5, 5}), shifted(-1, B::Clamp));
+  ASSERT_EQ(V({1, 1, 2, 3, 4}), shifted(1, B::Mirror));
+  ASSERT_EQ(V({2, 3, 4, 5, 5}), shifted(-1, B::Mirror));
+  ASSERT_EQ(V({5, 1, 2, 3, 4}), shifted(1, B::Periodic));
+  ASSERT_EQ(V({2, 3, 4, 5, 1}), shifted(-1, B::Periodic));
+
+  auto const img = randomImage(Size3(21, 17, 12));
+  auto const sub = subVolume(img, Index3(2, 1, 3), Size3(15, 14, 8));
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.2f, 0.9f, 1.6f));
+  Filter::DenseFilter<Filter::GaussFilter<float>> const dense(gauss);
+  Filter::FFTFilter<Filter::GaussFilter<float>> const fft(gauss);
+
+  for (auto const boundary : {B::Zero, B::Clamp, B::Mirror, B::Periodic}) {
+    auto const separable = Filter::filter(img, gauss, boundary);
+    expectNear(separable, Filter::filter(img, dense, boundary));
+    expectNear(separable, Filter::filter(img, fft, boundary));
+
+    auto const separableSub = Filter::filter(sub, gauss, boundary);
+    expectNear(separableSub, Filter::filter(sub, dense, boundary));
+    expectNear(separableSub, Filter::filter(sub, fft, boundary));
+  }
+  expectNear(Filter::filter(img, gauss), Filter::filter(img, gauss, B::Zero));
+
+  Img const constant(Size3(9, 8, 7), 2.0f);
+  for (auto const boundary : {B::Clamp, B::Mirror, B::Periodic})
+    expectNear(constant, Filter::filter(constant, dense, boundary));
+  ASSERT_LT(Filter::filter(constant, dense, B::Zero).map()[0], 1.5f);
+}
+
+/// Runs the convolution kernels of all instruction sets supported by the
+/// host CPU and tests if they give the results of the scalar kernel for
+/// float and double and all row lengths, including the remainders
+template <class T> static void testCorrelateRow() {
+  using Filter::detail::KernelIsa;
+
+  std::mt19937 rng(13);
+  std::uniform_real_distribution<T> dist(-1, 1);
+  std::vector<T> in(100), weights(9);
+  std::generate(in.begin(), in.end(), [&] { return dist(rng); });
+  std::generate(weights.begin(), weights.end(), [&] { return dist(rng); });
+
+  for (auto const isa : {KernelIsa::Scalar, KernelIsa::SSE41, KernelIsa::AVX2,
+                         KernelIsa::AVX512}) {
+    if (!Filter::detail::isSupported(isa)) continue;
+    auto const kernel = Filter::detail::CorrelateRow<T>::select(isa);
+
+    for (Size taps = 1; taps <= weights.size(); ++taps) {
+      for (Size n = 0; n + taps <= in.size(); n += 5) {
+        std::vector<T> expected(n, T(0.5)), actual(n, T(0.5));
+        Filter::detail::correlateRowScalar(in.data(), weights.data(), taps,
+                                           expected.data(), n);
+        kernel(in.data(), weights.data(), taps, actual.data(), n);
+        for (Size x = 0; x < n; ++x) ASSERT_NEAR(expected[x], actual[x], 1e-5);
+      }
+    }
+  }
+}
+
+TEST(Filter, CorrelateRow) {
+  testCorrelateRow<float>();
+  testCorrelateRow<double>();
+}
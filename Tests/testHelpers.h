@@ -0,0 +1,52 @@
+/// @file testHelpers.h
+/// @brief Contains helper functions shared by the unit tests
+
+#pragma once
+
+#include <ImageStack/ImageStack.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+namespace ImageStack {
+namespace test {
+
+/// @brief Creates a float image with values drawn from @c dist
+/// @param seed seed of the random number generator, so the image is the same
+/// in each run
+/// @param dist random number distribution, e.g.
+/// `std::normal_distribution<float>`
+template <class Distribution>
+inline ::ImageStack::ImageStack<float>
+randomImage(Size3 const &size, unsigned seed, Distribution dist) {
+  ::ImageStack::ImageStack<float> img(size, 0.0f);
+  std::mt19937 rng(seed);
+  auto map = img.map();
+  std::generate(map.begin(), map.end(), [&] { return dist(rng); });
+  return img;
+}
+
+/// @brief Creates a float image with values uniformly distributed in
+/// `[lower, upper)`
+inline ::ImageStack::ImageStack<float> randomImage(Size3 const &size,
+                                                   unsigned seed, float lower,
+                                                   float upper) {
+  return randomImage(size, seed,
+                     std::uniform_real_distribution<float>(lower, upper));
+}
+
+/// @brief Tests if two images have the same size and their voxels differ by
+/// at most @c tolerance
+template <class A, class B>
+inline void expectNear(A const &a, B const &b, double tolerance) {
+  ASSERT_EQ(a.size(), b.size());
+  auto const mA = a.map();
+  auto const mB = b.map();
+  for (Size i = 0; i < mA.linearSize(); ++i)
+    ASSERT_NEAR(mA[i], mB[i], tolerance);
+}
+
+} // namespace test
+} // namespace ImageStack
@@ -0,0 +1,168 @@
+/// @file testHostMemoryResource.cpp
+/// @brief Contains unit tests for HostMemoryResource and BufferPool
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+
+#include <ImageStack/HostMemoryResource.h>
+#include <ImageStack/HostStorage.h>
+#include <ImageStack/Numa.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace ImageStack;
+
+using HS = HostStorage<float>;
+
+/// Allocates and frees buffers directly from a pool and tests if
+///   - buffers of the same size are reused
+///   - buffers of other sizes are not
+///   - the statistics are correct
+///   - buffers exceeding the capacity are freed
+TEST(BufferPool, Recycle) {
+  BufferPool pool(900);
+
+  auto *a = pool.allocate(400);
+  auto *b = pool.allocate(400);
+  ASSERT_NE(a, b);
+  ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(a) % 64);
+  pool.deallocate(a, 400);
+  pool.deallocate(b, 400);
+
+  auto stats = pool.statistics();
+  ASSERT_EQ(0u, stats.hits);
+  ASSERT_EQ(2u, stats.misses);
+  ASSERT_EQ(800u, stats.cachedBytes);
+  ASSERT_EQ(0u, stats.usedBytes);
+
+  auto *c = pool.allocate(400);
+  ASSERT_TRUE(c == a || c == b);
+  auto *d = pool.allocate(200);
+  stats = pool.statistics();
+  ASSERT_EQ(1u, stats.hits);
+  ASSERT_EQ(3u, stats.misses);
+  ASSERT_EQ(400u, stats.cachedBytes);
+  ASSERT_EQ(600u, stats.usedBytes);
+
+  // 400 + 200 + 400 exceeds the capacity
+  pool.deallocate(d, 200);
+  pool.deallocate(c, 400);
+  stats = pool.statistics();
+  ASSERT_EQ(1u, stats.evictions);
+  ASSERT_EQ(600u, stats.cachedBytes);
+
+  pool.release();
+  ASSERT_EQ(0u, pool.statistics().cachedBytes);
+  pool.resetStatistics();
+  ASSERT_EQ(0u, pool.statistics().hits);
+}
+
+/// Sets a pool as the memory resource and creates and destroys storage
+/// objects of equal size. Tests if
+///   - the memory of a destroyed storage is reused by the next one
+///   - storage objects return their memory to the resource they were
+///     allocated from, even after the resource was changed
+TEST(BufferPool, HostStorage) {
+  BufferPool pool;
+  auto *const previous = setHostMemoryResource(&pool);
+  ASSERT_EQ(&pool, hostMemoryResource());
+
+  float const *address;
+  {
+    HS store(Size3(32, 32, 8), 1.0f);
+    address = &*store.map().begin();
+  }
+  for (int i = 0; i < 10; ++i) {
+    HS store(Size3(32, 32, 8));
+    ASSERT_EQ(address, &*store.map().begin());
+    HS const cpy(store);
+  }
+  auto const stats = pool.statistics();
+  ASSERT_EQ(2u, stats.misses);
+  ASSERT_EQ(19u, stats.hits);
+
+  {
+    HS store(Size3(4, 4, 4));
+    setHostMemoryResource(previous);
+    ASSERT_EQ(32u * 32 * 8 * 2 * sizeof(float), pool.statistics().cachedBytes);
+  }
+  ASSERT_EQ(0u, pool.statistics().usedBytes);
+
+  setHostMemoryResource(nullptr);
+  ASSERT_NE(&pool, hostMemoryResource());
+  ASSERT_EQ(previous, hostMemoryResource());
+}
+
+/// Allocates and frees buffers from several threads and tests if all buffers
+/// are accounted
+TEST(BufferPool, Threads) {
+  BufferPool pool;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&pool, t] {
+      for (int i = 0; i < 1000; ++i) {
+        auto const bytes = static_cast<std::size_t>(64 * (1 + (i + t) % 3));
+        auto *ptr = pool.allocate(bytes);
+        pool.deallocate(ptr, bytes);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  auto const stats = pool.statistics();
+  ASSERT_EQ(4000u, stats.hits + stats.misses);
+  ASSERT_EQ(0u, stats.usedBytes);
+  ASSERT_LE(stats.misses, 12u);
+}
+
+/// Allocates storage objects from NUMA memory resources with each policy and
+/// tests if
+///   - the memory is page aligned and usable
+///   - the policy could be applied, if the system supports NUMA
+///   - allocations smaller than a page, including empty ones, are page
+///     aligned
+///   - a pool with a NUMA upstream resource recycles the buffers
+TEST(NumaMemoryResource, Policies) {
+  ASSERT_GE(numaNodeCount(), 1u);
+
+  for (auto const policy : {NumaPolicy::FirstTouch, NumaPolicy::Interleave,
+                            NumaPolicy::Bind}) {
+    NumaMemoryResource numa(policy, 0);
+    ASSERT_EQ(policy, numa.policy());
+
+    auto *const previous = setHostMemoryResource(&numa);
+    {
+      HS const store(Size3(64, 64, 70), 2.0f);
+      auto const address =
+          reinterpret_cast<std::uintptr_t>(&*store.map().begin());
+      ASSERT_EQ(0u, address % detail::pageSize());
+      ASSERT_TRUE(std::all_of(store.map().begin(), store.map().end(),
+                              [](float v) { return v == 2.0f; }));
+    }
+    setHostMemoryResource(previous);
+
+    if (policy == NumaPolicy::FirstTouch) {
+      ASSERT_TRUE(numa.applied());
+    }
+  }
+
+  NumaMemoryResource numa(NumaPolicy::Interleave);
+  for (std::size_t const bytes : {0, 1, 100}) {
+    auto *const p = static_cast<unsigned char *>(numa.allocate(bytes));
+    ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(p) % detail::pageSize());
+    std::fill_n(p, bytes, 1);
+    numa.deallocate(p, bytes);
+  }
+
+  BufferPool pool(std::size_t{1} << 30, &numa);
+  auto *const a = pool.allocate(1 << 20);
+  pool.deallocate(a, 1 << 20);
+  ASSERT_EQ(a, pool.allocate(1 << 20));
+  pool.deallocate(a, 1 << 20);
+}
@@ -9,7 +9,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
 #include <random>
+#include <string>
+#include <vector>
 
 using namespace ImageStack;
 
@@ -181,3 +186,64 @@ TEST(HostStorage, Move) {
   
   ASSERT_TRUE(std::equal(src.cbegin(), src.cend(), dstMap.begin()));
 }
+
+/// Creates HostStorage objects of several sizes and tests if the memory is
+/// aligned to 64 bytes
+TEST(HostStorage, Alignment) {
+  for (auto const &size : {Size3(1, 1, 1), Size3(3, 5, 7), Size3(512, 512, 9)}) {
+    HS store(size);
+    auto const address = reinterpret_cast<std::uintptr_t>(&*store.map().begin());
+    ASSERT_EQ(0u, address % 64);
+
+    HostStorage<double> const init(size, 1.0);
+    auto const initAddress =
+        reinterpret_cast<std::uintptr_t>(&*init.map().begin());
+    ASSERT_EQ(0u, initAddress % 64);
+  }
+}
+
+/// Creates, copies and moves HostStorage objects of a type that is not
+/// trivially constructible and tests if
+///   - storage created without an initial value is default constructed
+///   - all elements are copied
+TEST(HostStorage, NonTrivialType) {
+  using SS = HostStorage<std::string>;
+  SS store(Size3(4, 3, 2));
+  for (auto const &s : store.map()) ASSERT_TRUE(s.empty());
+
+  auto map = store.map();
+  for (Size i = 0; i < map.linearSize(); ++i)
+    map[i] = "voxel " + std::to_string(i);
+
+  SS const cpy(store);
+  SS moved(std::move(store));
+  ASSERT_TRUE(store.empty());
+  ASSERT_TRUE(std::equal(moved.map().cbegin(), moved.map().cend(),
+                         cpy.map().cbegin()));
+  ASSERT_EQ("voxel 23", cpy.map()[23]);
+
+  SS const init(Size3(2, 2, 2), std::string("init"));
+  for (auto const &s : init.map()) ASSERT_EQ("init", s);
+}
+
+/// Creates and copies storage objects large enough to be initialized with
+/// multiple threads and tests if
+///   - all elements are initialized with the given value
+///   - content given as a container and copies match element by element
+TEST(HostStorage, ParallelInit) {
+  Size3 const size(128, 64, 37);
+  ASSERT_GE(indexProduct(size), detail::kParallelInitThreshold);
+
+  HS const init(size, 7);
+  ASSERT_TRUE(std::all_of(init.map().begin(), init.map().end(),
+                          [](int v) { return v == 7; }));
+
+  std::vector<int> content(indexProduct(size));
+  std::iota(content.begin(), content.end(), 0);
+  HS const store(size, content);
+  ASSERT_TRUE(std::equal(content.cbegin(), content.cend(),
+                         store.map().begin()));
+
+  HS const cpy(store);
+  ASSERT_TRUE(std::equal(content.cbegin(), content.cend(), cpy.map().begin()));
+}
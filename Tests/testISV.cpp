@@ -0,0 +1,202 @@
+/// @file testISV.cpp
+/// @brief Contains unit tests for ImageStackWriterISV and ImageStackLoaderISV
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/ImageStackLoaderISV.h>
+#include <ImageStack/ImageStackWriterISV.h>
+#include <ImageStack/LazySliceStorage.h>
+#include <ImageStack/ResolutionDecorator.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+static Eigen::Vector3d const ascendingImageResolution{0.25, 0.5, 1.0};
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using Mask =
+    ::ImageStack::ImageStack<std::uint8_t, HostStorage, ResolutionDecorator>;
+using LazyImg =
+    ::ImageStack::ImageStack<float, LazySliceStorage, ResolutionDecorator>;
+
+static std::size_t fileSize(std::string const &filename) {
+  std::ifstream in(filename, std::ios_base::in | std::ios_base::binary |
+                                 std::ios_base::ate);
+  return static_cast<std::size_t>(in.tellg());
+}
+
+/// Loads the ascending test image, writes it using bricks that do not divide
+/// the image size and tests if loading the written file gives the same image
+/// and resolution
+TEST(ISV, AscendingImage) {
+  Img const img(ImageStackLoaderBST<Img>(ascendingImageFile), ParallelTag{});
+  auto const filename = "testISV_image.isv"s;
+
+  ImageStackWriterISV<Img>(filename, Size3(8, 16, 3)).write(img);
+  Img const loaded(ImageStackLoaderISV<Img>{filename});
+
+  ASSERT_EQ(img.size(), loaded.size());
+  ASSERT_EQ(ascendingImageResolution, resolution(loaded));
+  auto const a = img.map();
+  auto const b = loaded.map();
+  ASSERT_TRUE(std::equal(a.cbegin(), a.cend(), b.cbegin()));
+
+  std::remove(filename.c_str());
+}
+
+/// Writes the ascending test mask and an all zero mask and tests if
+///   - both round trip
+///   - the all zero mask compresses to a small fraction of its raw size
+TEST(ISV, Mask) {
+  Mask const mask{ImageStackLoaderBST<Mask, true>(ascendingMaskFile)};
+  auto const filename = "testISV_mask.isv"s;
+
+  ImageStackWriterISV<Mask>(filename).write(mask);
+  Mask const loaded(ImageStackLoaderISV<Mask>{filename});
+  ASSERT_EQ(mask.size(), loaded.size());
+  ASSERT_TRUE(
+      std::equal(mask.map().cbegin(), mask.map().cend(), loaded.map().cbegin()));
+
+  Mask const zeros(Size3(100, 100, 100), std::uint8_t{0});
+  ImageStackWriterISV<Mask>(filename).write(zeros);
+  ASSERT_LT(fileSize(filename), std::size_t{100 * 100 * 100 / 100});
+
+  Mask const loadedZeros(ImageStackLoaderISV<Mask>{filename});
+  ASSERT_EQ(zeros.size(), loadedZeros.size());
+  auto const map = loadedZeros.map();
+  ASSERT_TRUE(std::all_of(map.cbegin(), map.cend(),
+                          [](auto v) { return v == 0; }));
+
+  std::remove(filename.c_str());
+}
+
+/// Writes an image and reads single bricks on demand, including clipped
+/// bricks at the border
+TEST(ISV, ReadBrick) {
+  using IntImg = ::ImageStack::ImageStack<std::int32_t, HostStorage>;
+  Size3 const size(21, 13, 7);
+  IntImg img(size, 0);
+  auto map = img.map();
+  std::iota(map.begin(), map.end(), -100);
+
+  auto const filename = "testISV_bricks.isv"s;
+  ImageStackWriterISV<IntImg>(filename, Size3(8, 8, 4)).write(img);
+  ImageStackLoaderISV<IntImg> loader(filename);
+
+  ASSERT_EQ(Size3(3, 2, 2), loader.gridSize());
+  for (Size bz = 0; bz < 2; ++bz) {
+    for (Size by = 0; by < 2; ++by) {
+      for (Size bx = 0; bx < 3; ++bx) {
+        Index3 const brick(bx, by, bz);
+        auto const origin = loader.brickOrigin(brick);
+        auto const extent = loader.brickExtent(brick);
+        std::vector<std::int32_t> data(indexProduct(extent));
+        loader.readBrick(brick, data.data());
+
+        auto it = data.cbegin();
+        for (Size z = 0; z < extent[2]; ++z)
+          for (Size y = 0; y < extent[1]; ++y)
+            for (Size x = 0; x < extent[0]; ++x, ++it)
+              ASSERT_EQ(map[Index3(origin + Index3(x, y, z))], *it);
+      }
+    }
+  }
+
+  std::remove(filename.c_str());
+}
+
+/// Tests if invalid files and voxel type mismatches are detected
+TEST(ISV, InvalidFiles) {
+  ASSERT_THROW(ImageStackLoaderISV<Img>{ascendingImageFile},
+               std::runtime_error);
+
+  Mask const mask(Size3(4, 4, 4), std::uint8_t{1});
+  auto const filename = "testISV_invalid.isv"s;
+  ImageStackWriterISV<Mask>(filename).write(mask);
+  ASSERT_THROW(ImageStackLoaderISV<Img>{filename}, std::runtime_error);
+  ASSERT_NO_THROW(ImageStackLoaderISV<Mask>{filename});
+
+  // Brick sizes beyond the end of the file or the raw size of the brick
+  for (auto const size : {std::uint64_t{65}, ~std::uint64_t{0}}) {
+    std::fstream file(filename, std::ios_base::in | std::ios_base::out |
+                                    std::ios_base::binary);
+    file.seekp(ISVHeader::kSize + 8);
+    detail::writeLE(file, size);
+    file.close();
+    ASSERT_THROW(ImageStackLoaderISV<Mask>{filename}, std::runtime_error);
+  }
+
+  std::remove(filename.c_str());
+}
+
+/// Writes an image whose slices can no longer be read and tests if the error
+/// of the parallel brick compression is thrown by the writer
+TEST(ISV, ReadError) {
+  auto const source = "testISV_source.bst"s;
+  {
+    std::ifstream in(ascendingImageFile,
+                     std::ios_base::in | std::ios_base::binary);
+    std::ofstream out(source, std::ios_base::out | std::ios_base::binary);
+    out << in.rdbuf();
+  }
+  LazyImg const img((ImageStackLoaderBST<LazyImg>(source)));
+  std::remove(source.c_str());
+
+  auto const filename = "testISV_error.isv"s;
+  {
+    ImageStackWriterISV<LazyImg> writer(filename, Size3(8, 8, 2));
+    ASSERT_THROW(writer.write(img), std::runtime_error);
+  }
+  std::remove(filename.c_str());
+}
+
+/// Tests the brick codec with compressible and incompressible data and if
+/// corrupt data is detected
+TEST(ISV, Codec) {
+  std::vector<std::uint16_t> data(1000);
+  std::iota(data.begin(), data.end(), std::uint16_t{0});
+
+  auto const compressed = ISVCodec::compress(data.data(), data.size(), 2);
+  ASSERT_FALSE(compressed.empty());
+  ASSERT_LT(compressed.size(), data.size() * 2);
+
+  std::vector<std::uint16_t> decompressed(data.size());
+  ISVCodec::decompress(compressed.data(), compressed.size(),
+                       decompressed.data(), decompressed.size(), 2);
+  ASSERT_EQ(data, decompressed);
+
+  ASSERT_THROW(ISVCodec::decompress(compressed.data(), compressed.size() - 1,
+                                    decompressed.data(), decompressed.size(),
+                                    2),
+               std::runtime_error);
+
+  std::vector<std::uint8_t> noise(256);
+  std::iota(noise.begin(), noise.end(), std::uint8_t{0});
+  ASSERT_TRUE(ISVCodec::compress(noise.data(), noise.size(), 1).empty());
+}
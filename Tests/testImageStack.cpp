@@ -6,7 +6,12 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <random>
 
 #pragma clang diagnostic ignored "-Wglobal-constructors"
 #pragma clang diagnostic ignored "-Wmissing-variable-declarations"
@@ -123,3 +128,53 @@ TYPED_TEST(ImageStackTest, CreateWithLoader) {
   ASSERT_TRUE(std::equal(map.cbegin(), map.cend(),
                          DummyLoader{}.storedValues<T>().cbegin()));
 }
+
+/// @brief Fills an image with random values drawn from @c values and tests
+/// if `uniqueValues()` and `uniqueValuesWithCounts()` match a reference
+/// computed with @c std::map
+template <class T> static void testUniqueValues(std::vector<T> const &values) {
+  ::ImageStack::ImageStack<T> img(Size3(64, 64, 40), T{0});
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<std::size_t> pick(0, values.size() - 1);
+  auto map = img.map();
+  std::generate(map.begin(), map.end(), [&] { return values[pick(rng)]; });
+
+  std::map<T, Size> ref;
+  for (auto const v : map) ++ref[v];
+
+  auto const unique = img.uniqueValues();
+  ASSERT_EQ(ref.size(), unique.size());
+  ASSERT_TRUE(std::equal(unique.cbegin(), unique.cend(), ref.cbegin(),
+                         [](auto a, auto const &b) { return a == b.first; }));
+
+  auto const counts = img.uniqueValuesWithCounts();
+  ASSERT_EQ(ref.size(), counts.size());
+  ASSERT_TRUE(std::equal(counts.cbegin(), counts.cend(), ref.cbegin(),
+                         [](auto const &a, auto const &b) {
+                           return a.first == b.first && a.second == b.second;
+                         }));
+}
+
+/// Tests `uniqueValues()` and `uniqueValuesWithCounts()` for
+///   - labels with a small range (flag and count tables)
+///   - the full range of a byte
+///   - integers with a huge range (sorting)
+///   - floating point values (sorting)
+TEST(ImageStack, UniqueValues) {
+  testUniqueValues<std::int16_t>({-3, 0, 1, 2, 7, 100, 1000});
+  testUniqueValues<std::int32_t>({5, 17});
+
+  std::vector<std::uint8_t> bytes(256);
+  std::iota(bytes.begin(), bytes.end(), 0);
+  testUniqueValues(bytes);
+
+  using Limits64 = std::numeric_limits<std::int64_t>;
+  testUniqueValues<std::int64_t>({Limits64::min(), -1, 0, 1, Limits64::max()});
+  testUniqueValues<std::uint64_t>({0, 1, std::uint64_t{1} << 40,
+                                   std::numeric_limits<std::uint64_t>::max()});
+
+  std::vector<float> floats(1000);
+  std::generate(floats.begin(), floats.end(),
+                [i = 0]() mutable { return 0.37f * static_cast<float>(i++); });
+  testUniqueValues(floats);
+}
@@ -0,0 +1,161 @@
+/// @file testImageStackView.cpp
+/// @brief Contains unit tests for MappedStridedMemory and image stack views
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/GaussFilter.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/ImageStackView.h>
+#include <ImageStack/OriginDecorator.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator,
+                                     OriginDecorator>;
+using ImgLoader = ImageStackLoaderBST<Img, false>;
+
+/// Creates an image with ascending values
+static ::ImageStack::ImageStack<int> ascending(Size3 const &size) {
+  std::vector<int> values(indexProduct(size));
+  std::iota(values.begin(), values.end(), 0);
+  return ::ImageStack::ImageStack<int>(HostStorage<int>(size, values));
+}
+
+/// Tests sub-volume, slice, permuted and subsampled mappings against the
+/// linear index of the underlying volume
+TEST(MappedStridedMemory, Views) {
+  Size3 const size(7, 5, 6);
+  auto img = ascending(size);
+  MappedStridedMemory<int> const map(img.map());
+  ASSERT_TRUE(map.isContiguous());
+  ASSERT_TRUE(std::equal(map.begin(), map.end(), img.map().begin()));
+
+  auto const sub = map.subVolume(Index3(1, 2, 3), Size3(4, 3, 2));
+  ASSERT_FALSE(sub.isContiguous());
+  ASSERT_EQ(24u, sub.linearSize());
+  for (Index z = 0; z < 2; ++z)
+    for (Index y = 0; y < 3; ++y)
+      for (Index x = 0; x < 4; ++x)
+        ASSERT_EQ(narrow<int>(toLinear(Index3(x + 1, y + 2, z + 3), size)),
+                  sub[Index3(x, y, z)]);
+  ASSERT_EQ(sub[Index3(1, 2, 1)], sub[Size{1 + 2 * 4 + 1 * 12}]);
+
+  std::vector<int> visited(sub.begin(), sub.end());
+  ASSERT_EQ(24u, visited.size());
+  ASSERT_EQ(sub[Index3(3, 2, 1)], visited.back());
+  ASSERT_EQ(sub[Index3(0, 1, 0)], *(sub.begin() + 4));
+
+  auto const slice = map.slice(4);
+  ASSERT_EQ(Size3(7, 5, 1), slice.extent());
+  ASSERT_EQ(narrow<int>(toLinear(Index3(6, 4, 4), size)),
+            slice[Index3(6, 4, 0)]);
+
+  auto const permuted = map.permute(Index3(2, 0, 1));
+  ASSERT_EQ(Size3(6, 7, 5), permuted.extent());
+  ASSERT_EQ(narrow<int>(toLinear(Index3(3, 4, 5), size)),
+            permuted[Index3(5, 3, 4)]);
+
+  auto const sampled = map.subsample(Size3(2, 2, 2));
+  ASSERT_EQ(Size3(4, 3, 3), sampled.extent());
+  ASSERT_EQ(narrow<int>(toLinear(Index3(6, 4, 2), size)),
+            sampled[Index3(3, 2, 1)]);
+}
+
+/// Creates views of an image stack and tests if
+///   - writing through a view modifies the image
+///   - decorators are copied and adjusted
+///   - views can be copied into owning image stacks
+///   - unique values of a view only contain the viewed voxels
+TEST(ImageStackView, Decorators) {
+  Img img{ImgLoader(ascendingImageFile)};
+  img.origin = Index3(10, 20, 30);
+
+  auto sub = subVolume(img, Index3(2, 4, 6), Size3(3, 2, 1));
+  static_assert(std::is_same<decltype(sub),
+                             ImageStackView<float, ResolutionDecorator,
+                                            OriginDecorator>>::value,
+                "View of a mutable image must be mutable");
+  ASSERT_EQ(Size3(3, 2, 1), sub.size());
+  ASSERT_EQ(Index3(12, 24, 36), sub.origin);
+  ASSERT_EQ(img.resolution, sub.resolution);
+
+  sub.map()[Index3(1, 1, 0)] = -1.0f;
+  ASSERT_EQ(-1.0f, img.map()[Index3(3, 5, 6)]);
+
+  Img const &cimg = img;
+  auto const permuted = permute(cimg, Index3(2, 1, 0));
+  static_assert(std::is_same<std::decay_t<decltype(permuted)>,
+                             ConstImageStackView<float, ResolutionDecorator,
+                                                 OriginDecorator>>::value,
+                "View of a const image must be read only");
+  ASSERT_EQ(Size3(10, 40, 20), permuted.size());
+  ASSERT_EQ(Eigen::Vector3d(1.0, 0.5, 0.25), permuted.resolution);
+  ASSERT_EQ(Index3(30, 20, 10), permuted.origin);
+  ASSERT_EQ(-1.0f, permuted.map()[Index3(6, 5, 3)]);
+
+  auto const sampled = subsample(cimg, Size3(2, 2, 2));
+  ASSERT_EQ(Size3(10, 20, 5), sampled.size());
+  ASSERT_EQ(Eigen::Vector3d(0.5, 1.0, 2.0), sampled.resolution);
+
+  auto const slice3 = slice(cimg, 3);
+  Img const copy(slice3);
+  ASSERT_EQ(Size3(20, 40, 1), copy.size());
+  ASSERT_TRUE(std::equal(copy.map().begin(), copy.map().end(),
+                         img.map().begin() + 3 * 20 * 40));
+
+  auto const values = sub.uniqueValues();
+  ASSERT_EQ(6u, sub.map().linearSize());
+  ASSERT_LE(values.size(), 6u);
+  ASSERT_EQ(-1.0f, *values.begin());
+}
+
+/// Tests that the sampler and the filter give the same results for a view
+/// and for a copy of the viewed region
+TEST(ImageStackView, SamplerAndFilter) {
+  Img const img{ImgLoader(ascendingImageFile)};
+  auto const sub = subVolume(img, Index3(3, 5, 2), Size3(12, 20, 6));
+  Img const copy(sub);
+
+  Sampler::Sampler<Sampler::CoordTransform::Identity,
+                   Sampler::Interpolation::Linear>
+      sampler;
+  for (double z = -0.5; z < 7; z += 0.7)
+    for (double y = -0.5; y < 21; y += 1.3)
+      for (double x = -0.5; x < 13; x += 0.9) {
+        Eigen::Vector3d const pos(x, y, z);
+        ASSERT_DOUBLE_EQ(sampler(copy, pos), sampler(sub, pos));
+      }
+
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1.0f, 1.0f, 0.5f));
+  auto const filteredView = Filter::filter(sub, gauss);
+  auto const filteredCopy = Filter::filter(copy, gauss);
+  ASSERT_EQ(filteredCopy.size(), filteredView.size());
+  ASSERT_TRUE(std::equal(filteredCopy.map().begin(), filteredCopy.map().end(),
+                         filteredView.map().begin()));
+}
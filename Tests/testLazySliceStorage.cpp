@@ -0,0 +1,172 @@
+/// @file testLazySliceStorage.cpp
+/// @brief Contains unit tests for LazySliceStorage class
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/LazySliceStorage.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static Size3 const ascendingImageSize{20, 40, 10};
+static Eigen::Vector3d const ascendingImageResolution{0.25, 0.5, 1.0};
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using LazyImg =
+    ::ImageStack::ImageStack<float, LazySliceStorage, ResolutionDecorator>;
+
+/// Creates a constant LazySliceStorage<int> and tests if
+///   - `empty()` and `size()` return the correct values
+///   - all values equal the initialization value
+TEST(LazySliceStorage, CreateConstant) {
+  LazySliceStorage<int> const empty(Size3::Zero());
+  ASSERT_TRUE(empty.empty());
+
+  LazySliceStorage<int> const store(Size3(23, 42, 5), 123);
+  ASSERT_FALSE(store.empty());
+  ASSERT_EQ(Size3(23, 42, 5), store.size());
+  ASSERT_EQ(4830, store.linearSize());
+
+  for (auto const x : store.map()) ASSERT_EQ(123, x);
+  ASSERT_EQ(123, store.map()[Size3(22, 41, 4)]);
+}
+
+/// Opens the ascending test image lazily and tests if
+///   - opening the image does not read any slice
+///   - the size and resolution are correct
+///   - all values equal the values of the eagerly loaded image
+TEST(LazySliceStorage, AscendingImage) {
+  LazyImg const img((ImageStackLoaderBST<LazyImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  ASSERT_EQ(ascendingImageSize, img.size());
+  ASSERT_EQ(ascendingImageResolution, img.resolution);
+
+  auto const map = img.map();
+  ASSERT_EQ(0, map.cache().statistics().misses);
+
+  auto const refMap = ref.map();
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), refMap.cbegin()));
+  ASSERT_EQ(refMap[Size3(3, 17, 8)], map[Size3(3, 17, 8)]);
+}
+
+/// Limits the cache capacity to three slices, accesses slices in a fixed
+/// pattern and tests if the hit, miss and eviction counters are correct
+TEST(LazySliceStorage, Cache) {
+  LazyImg const img((ImageStackLoaderBST<LazyImg>(ascendingImageFile)));
+  auto const map = img.map();
+  auto &cache = map.cache();
+
+  cache.setCapacity(3 * 20 * 40 * sizeof(float));
+
+  for (Size z : {0, 1, 2, 0, 3, 1}) map[Size3(0, 0, z)];
+
+  // 0 1 2 are misses, 0 is a hit, 3 evicts 1, 1 evicts 2
+  auto const stats = cache.statistics();
+  ASSERT_EQ(1, stats.hits);
+  ASSERT_EQ(5, stats.misses);
+  ASSERT_EQ(2, stats.evictions);
+  ASSERT_EQ(3, cache.numCachedSlices());
+
+  cache.setCapacity(0);
+  ASSERT_EQ(1, cache.numCachedSlices());
+}
+
+/// Samples a lazily opened image in parallel and tests if the values match
+/// the ones of an eagerly loaded image
+TEST(LazySliceStorage, Sampler) {
+  LazyImg const img((ImageStackLoaderBST<LazyImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  std::vector<Eigen::Vector3d> positions;
+  for (double z = -1; z < 11; z += 0.7)
+    for (double y = 0; y < 40; y += 3.3)
+      for (double x = 0; x < 20; x += 2.1) positions.emplace_back(x, y, z);
+
+  ::ImageStack::Sampler::Sampler<Sampler::CoordTransform::Identity,
+                                 Sampler::Interpolation::Linear>
+      sampler;
+  std::vector<double> values(positions.size());
+  std::vector<double> refValues(positions.size());
+  sampler(img, positions.begin(), positions.end(), values.begin(),
+          ParallelTag{});
+  sampler(ref, positions.begin(), positions.end(), refValues.begin());
+
+  ASSERT_EQ(refValues, values);
+}
+
+/// Reads different slices from multiple threads and tests if
+///   - the cache does not serialize the reads of missing slices
+///   - slices read concurrently from a file have the correct values
+///   - mappings of the storage are not writable
+TEST(LazySliceStorage, ConcurrentReads) {
+  std::atomic<int> active{0};
+  std::atomic<int> maxActive{0};
+  SliceCache<int> cache(1, 1 << 20, [&](Size z, int *out) {
+    auto const n = ++active;
+    auto m = maxActive.load();
+    while (n > m && !maxActive.compare_exchange_weak(m, n)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    *out = static_cast<int>(z);
+    --active;
+  });
+
+  std::vector<std::thread> threads;
+  for (Size t = 0; t < 4; ++t)
+    threads.emplace_back([&cache, t] { cache.slice(t); });
+  for (auto &thread : threads) thread.join();
+  ASSERT_GT(maxActive.load(), 1);
+  for (Size z = 0; z < 4; ++z)
+    ASSERT_EQ(static_cast<int>(z), (*cache.slice(z))[0]);
+
+  LazyImg const img((ImageStackLoaderBST<LazyImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+  auto const map = img.map();
+  auto const refMap = ref.map();
+
+  std::atomic<int> mismatches{0};
+  threads.clear();
+  for (Size t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      for (Size z = t; z < ascendingImageSize[2]; z += 4)
+        for (Size y = 0; y < ascendingImageSize[1]; ++y)
+          for (Size x = 0; x < ascendingImageSize[0]; ++x)
+            if (map[Size3(x, y, z)] != refMap[Size3(x, y, z)]) ++mismatches;
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  ASSERT_EQ(0, mismatches.load());
+
+  static_assert(!detail::IsWritableMapping<MappedLazySlices<float>>::value,
+                "Lazy slices must be read only");
+  static_assert(detail::IsWritableMapping<MappedHostMemory<float, 3>>::value,
+                "Host memory must be writable");
+}
@@ -0,0 +1,153 @@
+/// @file testMappedFileStorage.cpp
+/// @brief Contains unit tests for MappedFileStorage class
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/MappedFileStorage.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <string>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static std::string const ascendingMaskFile =
+    kTestDataDir + "/ascending_Mask.bst"s;
+static Size3 const ascendingImageSize{20, 40, 10};
+static Eigen::Vector3d const ascendingImageResolution{0.25, 0.5, 1.0};
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using Mask =
+    ::ImageStack::ImageStack<std::uint8_t, HostStorage, ResolutionDecorator>;
+using MappedImg =
+    ::ImageStack::ImageStack<float, MappedFileStorage, ResolutionDecorator>;
+using MappedMask = ::ImageStack::ImageStack<std::uint8_t, MappedFileStorage,
+                                            ResolutionDecorator>;
+
+using MFS = MappedFileStorage<int>;
+
+/// Creates an empty and a constant initialized MappedFileStorage<int> object
+/// and tests if
+///   - `empty()` returns the right value
+///   - @c size() returns the correct value
+///   - all values of the initialized storage are correct
+TEST(MappedFileStorage, CreateAnonymous) {
+  MFS const empty(Size3::Zero());
+  ASSERT_TRUE(empty.empty());
+  ASSERT_EQ(0, empty.linearSize());
+
+  MFS const store(Size3(23, 42, 5), 123);
+  ASSERT_FALSE(store.empty());
+  ASSERT_FALSE(store.zeroCopy());
+  ASSERT_EQ(Size3(23, 42, 5), store.size());
+  ASSERT_EQ(4830, store.linearSize());
+
+  for (auto const x : store.map()) ASSERT_EQ(123, x);
+}
+
+/// Creates a MappedFileStorage<int> object, modifies it and creates a copy.
+/// Tests if the copy contains the same data and is independent of the source.
+TEST(MappedFileStorage, Copy) {
+  MFS store(Size3(5, 23, 42));
+  std::iota(store.map().begin(), store.map().end(), 0);
+
+  MFS cpy(store);
+  auto const srcMap = store.map();
+  auto cpyMap = cpy.map();
+  ASSERT_TRUE(std::equal(srcMap.cbegin(), srcMap.cend(), cpyMap.begin()));
+
+  cpyMap[Size3(0, 0, 0)] = -1;
+  ASSERT_EQ(0, srcMap[Size3(0, 0, 0)]);
+}
+
+/// Maps the ascending test image and tests if
+///   - the size and resolution are correct
+///   - all values equal the values loaded into a HostStorage
+TEST(MappedFileStorage, AscendingImage) {
+  MappedImg const img((ImageStackLoaderBST<MappedImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  ASSERT_EQ(ascendingImageSize, img.size());
+  ASSERT_EQ(ascendingImageResolution, img.resolution);
+
+  auto const map = img.map();
+  auto const refMap = ref.map();
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), refMap.cbegin()));
+}
+
+/// Maps the ascending test mask and tests if
+///   - the mapping is zero copy
+///   - all values equal the values loaded into a HostStorage
+///   - modifying the mapping does not affect other mappings of the same file
+TEST(MappedFileStorage, AscendingMask) {
+  using Loader = ImageStackLoaderBST<MappedMask, true>;
+  Loader loader(ascendingMaskFile);
+  MappedFileStorage<std::uint8_t> store(loader);
+  Mask const ref((ImageStackLoaderBST<Mask, true>(ascendingMaskFile)));
+
+  ASSERT_TRUE(store.zeroCopy());
+  ASSERT_EQ(ascendingImageSize, store.size());
+
+  auto map = store.map();
+  auto const refMap = ref.map();
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), refMap.cbegin()));
+
+  map[Size3(1, 2, 3)] = 42;
+  MappedMask const other((Loader(ascendingMaskFile)));
+  ASSERT_EQ(refMap[Size3(1, 2, 3)], other.map()[Size3(1, 2, 3)]);
+}
+
+/// Samples a mapped image and tests if the values match the ones of an image
+/// loaded into a HostStorage
+TEST(MappedFileStorage, Sampler) {
+  MappedImg const img((ImageStackLoaderBST<MappedImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  ::ImageStack::Sampler::Sampler<> sampler;
+  for (long z = 0; z < 10; z += 3) {
+    for (long y = 0; y < 40; y += 7) {
+      for (long x = 0; x < 20; x += 5) {
+        ASSERT_EQ(sampler(ref, SIndex3(x, y, z)),
+                  sampler(img, SIndex3(x, y, z)));
+      }
+    }
+  }
+}
+
+/// Maps a region of the ascending test image and tests if the values match
+/// the ones of the whole image
+TEST(MappedFileStorage, Region) {
+  ImageStackLoaderBST<MappedImg> loader(ascendingImageFile, Index3(2, 3, 4),
+                                        Size3(5, 6, 3));
+  MappedImg const img(loader);
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  ASSERT_EQ(Size3(5, 6, 3), img.size());
+
+  auto const map = img.map();
+  auto const refMap = ref.map();
+  for (Size z = 0; z < 3; ++z)
+    for (Size y = 0; y < 6; ++y)
+      for (Size x = 0; x < 5; ++x)
+        ASSERT_EQ(refMap[Size3(x + 2, y + 3, z + 4)], map[Size3(x, y, z)]);
+}
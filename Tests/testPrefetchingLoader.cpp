@@ -0,0 +1,129 @@
+/// @file testPrefetchingLoader.cpp
+/// @brief Contains unit tests for PrefetchingLoader
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/PrefetchingLoader.h>
+#include <ImageStack/ResolutionDecorator.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const zeroImageFile = kTestDataDir + "/zero_Slices.bst"s;
+static std::string const onesImageFile = kTestDataDir + "/ones_Slices.bst"s;
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+static Size const imageBytes = 20 * 40 * 10 * sizeof(float);
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using ImgLoader = ImageStackLoaderBST<Img>;
+
+static bool equal(Img const &a, Img const &b) {
+  auto const ma = a.map();
+  auto const mb = b.map();
+  return a.size() == b.size() && a.resolution == b.resolution &&
+         std::equal(ma.cbegin(), ma.cend(), mb.cbegin());
+}
+
+/// Waits until the I/O thread accounted the given number of bytes, or a
+/// timeout is reached
+static Size waitForBytes(PrefetchingLoader<Img> const &loader, Size bytes) {
+  for (int i = 0; i < 500 && loader.bytesInFlight() < bytes; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  // give the I/O thread the chance to exceed the limit if it was buggy
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  return loader.bytesInFlight();
+}
+
+/// Enqueues several files and tests if the stacks are returned in order and
+/// equal the stacks loaded directly
+TEST(PrefetchingLoader, LoadInOrder) {
+  std::vector<std::string> const files{ascendingImageFile, zeroImageFile,
+                                       onesImageFile, ascendingImageFile};
+
+  PrefetchingLoader<Img> prefetcher(2);
+  std::vector<PrefetchingLoader<Img>::Future> futures;
+  for (auto const &file : files) futures.push_back(prefetcher.enqueue(file));
+
+  for (Size i = 0; i < files.size(); ++i) {
+    ASSERT_TRUE(futures[i].valid());
+    auto const img = futures[i].get();
+    ASSERT_FALSE(futures[i].valid());
+    ASSERT_TRUE(equal(Img(ImgLoader(files[i])), img));
+  }
+  ASSERT_EQ(0u, prefetcher.bytesInFlight());
+}
+
+/// Tests if the prefetch depth and the memory budget bound the number of
+/// stacks loaded ahead
+TEST(PrefetchingLoader, Bounds) {
+  {
+    PrefetchingLoader<Img> prefetcher(2);
+    auto f0 = prefetcher.enqueue(ascendingImageFile);
+    auto f1 = prefetcher.enqueue(zeroImageFile);
+    auto f2 = prefetcher.enqueue(onesImageFile);
+
+    ASSERT_EQ(2 * imageBytes, waitForBytes(prefetcher, 2 * imageBytes));
+    ASSERT_FALSE(f2.ready());
+
+    f0.get();
+    ASSERT_EQ(2 * imageBytes, waitForBytes(prefetcher, 2 * imageBytes));
+    f2.wait();
+    ASSERT_TRUE(f2.ready());
+  }
+
+  {
+    // the budget fits one and a half stacks
+    PrefetchingLoader<Img> prefetcher(10, imageBytes * 3 / 2);
+    auto f0 = prefetcher.enqueue(ascendingImageFile);
+    auto f1 = prefetcher.enqueue(zeroImageFile);
+
+    ASSERT_EQ(imageBytes, waitForBytes(prefetcher, imageBytes));
+    ASSERT_FALSE(f1.ready());
+
+    // dropping a future releases its budget
+    f0 = PrefetchingLoader<Img>::Future();
+    f1.wait();
+    ASSERT_EQ(imageBytes, prefetcher.bytesInFlight());
+  }
+
+  {
+    // a stack larger than the budget is loaded if nothing else is in flight
+    PrefetchingLoader<Img> prefetcher(1, imageBytes / 2);
+    ASSERT_TRUE(equal(Img(ImgLoader(onesImageFile)),
+                      prefetcher.enqueue(onesImageFile).get()));
+  }
+}
+
+/// Tests if errors are forwarded to the future and do not stop the I/O
+/// thread
+TEST(PrefetchingLoader, Errors) {
+  PrefetchingLoader<Img> prefetcher(2);
+  auto f0 = prefetcher.enqueue("nonexistent.bst");
+  auto f1 = prefetcher.enqueue(onesImageFile);
+
+  ASSERT_THROW(f0.get(), std::runtime_error);
+  ASSERT_TRUE(equal(Img(ImgLoader(onesImageFile)), f1.get()));
+  ASSERT_EQ(0u, prefetcher.bytesInFlight());
+}
@@ -0,0 +1,142 @@
+/// @file testRecursiveGaussFilter.cpp
+/// @brief Contains unit tests for the recursive Gaussian filter
+
+#include <ImageStack/GaussFilter.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackView.h>
+#include <ImageStack/RecursiveGaussFilter.h>
+#include <ImageStack/ResolutionDecorator.h>
+
+#include <gtest/gtest.h>
+
+#include "testHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+
+using Img = ::ImageStack::ImageStack<float>;
+
+/// @brief Creates an image with uniformly distributed values
+static Img randomImage(Size3 const &size) {
+  return test::randomImage(size, 5, 0.0f, 1.0f);
+}
+
+/// @brief Convolves all lines along @c axis with a sampled Gaussian,
+/// replicating the border voxels
+static Img gaussLines(Img const &img, int axis, double sigma) {
+  auto const K = static_cast<long>(std::ceil(6 * sigma));
+  std::vector<double> kernel;
+  for (auto i = -K; i <= K; ++i)
+    kernel.push_back(std::exp(-0.5 * double(i * i) / (sigma * sigma)));
+  auto const sum = std::accumulate(kernel.begin(), kernel.end(), 0.0);
+
+  Img result(img.size(), 0.0f);
+  auto const src = img.map();
+  auto dst = result.map();
+  auto const n = static_cast<long>(img.size()[axis]);
+  for (Size k = 0; k < img.size()[2]; ++k)
+    for (Size j = 0; j < img.size()[1]; ++j)
+      for (Size i = 0; i < img.size()[0]; ++i) {
+        Index3 const x(i, j, k);
+        auto pos = x;
+        double value = 0;
+        for (auto t = -K; t <= K; ++t) {
+          auto const p = static_cast<long>(x[axis]) + t;
+          pos[axis] = static_cast<Size>(std::min(std::max(p, 0l), n - 1));
+          value += kernel[static_cast<Size>(t + K)] * double(src[pos]);
+        }
+        dst[x] = static_cast<float>(value / sum);
+      }
+  return result;
+}
+
+/// @brief Returns the maximum absolute difference of two images
+template <class A, class B>
+static double maxDifference(A const &a, B const &b) {
+  EXPECT_EQ(a.size(), b.size());
+  auto const mA = a.map();
+  auto const mB = b.map();
+  double diff = 0;
+  for (Size i = 0; i < mA.linearSize(); ++i)
+    diff = std::max(diff, std::abs(double(mA[i]) - double(mB[i])));
+  return diff;
+}
+
+/// Filters images and tests if
+///   - the result approximates a Gaussian convolution with replicated borders
+///   - a sigma of 0 leaves the axis unfiltered
+///   - constant images stay constant, also for integral voxel types
+TEST(RecursiveGaussFilter, Gaussian) {
+  auto const img = randomImage(Size3(37, 29, 24));
+  Eigen::Vector3d const sigma(1.5, 3.0, 6.0);
+
+  auto const expected =
+      gaussLines(gaussLines(gaussLines(img, 0, 1.5), 1, 3.0), 2, 6.0);
+  auto const result = Filter::filter(img, Filter::RecursiveGaussFilter(sigma));
+  ASSERT_LT(maxDifference(expected, result), 1e-2);
+
+  auto const lines = Filter::filter(
+      img, Filter::RecursiveGaussFilter(Eigen::Vector3d(0, 2, 0)));
+  ASSERT_LT(maxDifference(gaussLines(img, 1, 2.0), lines), 1e-2);
+
+  Img const constant(Size3(20, 5, 3), 3.25f);
+  auto const smooth = Filter::filter(constant, Filter::RecursiveGaussFilter(
+                                                   Eigen::Vector3d(4, 1, 9)));
+  ASSERT_LT(maxDifference(constant, smooth), 1e-5);
+
+  ::ImageStack::ImageStack<std::uint8_t> const labels(Size3(9, 8, 7), 200);
+  auto const smoothLabels = Filter::filter(
+      labels, Filter::RecursiveGaussFilter(Eigen::Vector3d(2, 2, 2)));
+  auto const m = smoothLabels.map();
+  ASSERT_TRUE(std::all_of(m.begin(), m.end(),
+                          [](std::uint8_t v) { return v == 200; }));
+}
+
+/// Tests if the border handling is exact, i.e. filtering an image gives the
+/// same result as filtering a larger image with replicated borders and
+/// cropping it
+TEST(RecursiveGaussFilter, Border) {
+  auto const img = randomImage(Size3(12, 7, 5));
+  Eigen::Vector3d const sigma(4, 2.5, 0.8);
+  Size const P = 80;
+
+  Img padded(img.size() + 2 * P * Size3::Ones(), 0.0f);
+  auto const src = img.map();
+  auto dst = padded.map();
+  for (Size k = 0; k < padded.size()[2]; ++k)
+    for (Size j = 0; j < padded.size()[1]; ++j)
+      for (Size i = 0; i < padded.size()[0]; ++i) {
+        Index3 x(i, j, k);
+        for (int a = 0; a < 3; ++a)
+          x[a] = std::min(std::max(x[a], P), P + img.size()[a] - 1) - P;
+        dst[Index3(i, j, k)] = src[x];
+      }
+
+  auto const expected =
+      Filter::filter(padded, Filter::RecursiveGaussFilter(sigma));
+  auto const result = Filter::filter(img, Filter::RecursiveGaussFilter(sigma));
+  ASSERT_LT(maxDifference(subVolume(expected, P * Size3::Ones(), img.size()),
+                          result),
+            1e-5);
+}
+
+/// Tests if recursiveGauss() converts sigma to voxels using the resolution
+TEST(RecursiveGaussFilter, Resolution) {
+  auto const random = randomImage(Size3(17, 21, 13));
+  ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator> img(
+      random.size(), 0.0f);
+  std::copy(random.map().begin(), random.map().end(), img.map().begin());
+  img.resolution = Eigen::Vector3d(1.0, 0.5, 2.0);
+
+  auto const result = Filter::recursiveGauss(img, Eigen::Vector3d(2, 2, 2));
+  auto const expected = Filter::filter(
+      random, Filter::RecursiveGaussFilter(Eigen::Vector3d(2, 4, 1)));
+  ASSERT_EQ(0.0, maxDifference(expected, result));
+}
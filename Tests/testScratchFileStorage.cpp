@@ -0,0 +1,188 @@
+/// @file testScratchFileStorage.cpp
+/// @brief Contains unit tests for ScratchFileStorage class
+
+// clang-format off
+#ifndef XCODE_BUILD
+#  include "config.h"
+#else
+  static constexpr char kTestDataDir[] = TEST_DATA_DIR;
+#endif
+// clang-format on
+
+#include <ImageStack/Filter.h>
+#include <ImageStack/GaussFilter.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoaderBST.h>
+#include <ImageStack/RecursiveGaussFilter.h>
+#include <ImageStack/ResolutionDecorator.h>
+#include <ImageStack/Sampler.h>
+#include <ImageStack/ScratchFileStorage.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <type_traits>
+
+#pragma clang diagnostic ignored "-Wcovered-switch-default"
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+using namespace std::literals;
+
+static std::string const ascendingImageFile =
+    kTestDataDir + "/ascending_Slices.bst"s;
+
+using Img = ::ImageStack::ImageStack<float, HostStorage, ResolutionDecorator>;
+using ScratchImg =
+    ::ImageStack::ImageStack<float, ScratchFileStorage, ResolutionDecorator>;
+
+using SFS = ScratchFileStorage<int>;
+
+/// Creates an empty and a constant initialized ScratchFileStorage<int> object
+/// and tests if
+///   - `empty()` returns the right value
+///   - @c size() returns the correct value
+///   - all values of the initialized storage are correct
+///   - writes through the mapping are visible
+///   - flushing and access hints work
+TEST(ScratchFileStorage, CreateScratch) {
+  SFS const empty(Size3::Zero());
+  ASSERT_TRUE(empty.empty());
+  ASSERT_EQ(0, empty.linearSize());
+
+  SFS store(Size3(23, 42, 5), 123);
+  ASSERT_FALSE(store.empty());
+  ASSERT_TRUE(store.filename().empty());
+  ASSERT_EQ(Size3(23, 42, 5), store.size());
+  ASSERT_EQ(4830, store.linearSize());
+
+  for (auto const x : static_cast<SFS const &>(store).map()) ASSERT_EQ(123, x);
+
+  store.advise(AccessPattern::Sequential);
+  std::iota(store.map().begin(), store.map().end(), 0);
+  store.flush();
+  store.advise(AccessPattern::Random);
+
+  auto const map = static_cast<SFS const &>(store).map();
+  for (Size i = 0; i < map.linearSize(); ++i)
+    ASSERT_EQ(static_cast<int>(i), map[i]);
+}
+
+/// Creates a ScratchFileStorage<int> object, modifies it and creates a copy.
+/// Tests if the copy contains the same data and is independent of the source.
+TEST(ScratchFileStorage, Copy) {
+  SFS store(Size3(5, 23, 42));
+  std::iota(store.map().begin(), store.map().end(), 0);
+
+  SFS cpy(store);
+  auto const srcMap = static_cast<SFS const &>(store).map();
+  auto cpyMap = cpy.map();
+  ASSERT_TRUE(std::equal(srcMap.cbegin(), srcMap.cend(), cpyMap.begin()));
+
+  cpyMap[Size3(0, 0, 0)] = -1;
+  ASSERT_EQ(0, srcMap[Size3(0, 0, 0)]);
+}
+
+/// Writes a storage backed by a named file with an offset and tests if
+///   - the file contains the data after the storage is destroyed
+///   - reopening the file gives the same data
+///   - offsets that would misalign the voxels are rejected
+TEST(ScratchFileStorage, NamedFile) {
+  auto const filename = ::testing::TempDir() + "ScratchFileStorage.raw";
+  std::remove(filename.c_str());
+  Size3 const size(7, 5, 3);
+
+  {
+    SFS store(filename, size, 16);
+    ASSERT_EQ(filename, store.filename());
+    std::iota(store.map().begin(), store.map().end(), 0);
+    store.flush();
+  }
+
+  auto *file = std::fopen(filename.c_str(), "rb");
+  ASSERT_NE(nullptr, file);
+  std::fseek(file, 0, SEEK_END);
+  ASSERT_EQ(16 + 105 * sizeof(int), static_cast<Size>(std::ftell(file)));
+  std::vector<int> values(105);
+  std::fseek(file, 16, SEEK_SET);
+  ASSERT_EQ(values.size(),
+            std::fread(values.data(), sizeof(int), values.size(), file));
+  std::fclose(file);
+  for (Size i = 0; i < values.size(); ++i)
+    ASSERT_EQ(static_cast<int>(i), values[i]);
+
+  SFS const reopened(filename, size, 16);
+  ASSERT_TRUE(std::equal(values.cbegin(), values.cend(),
+                         reopened.map().cbegin()));
+
+  // The voxels would not be aligned
+  ASSERT_DEATH(SFS(filename, size, 18), "");
+  std::remove(filename.c_str());
+}
+
+/// Loads the ascending test image into a scratch file and tests if
+///   - the values equal the values loaded into a HostStorage
+///   - sampling gives the same values
+///   - filtering gives the same values and the result is stored in a scratch
+///     file as well
+TEST(ScratchFileStorage, FilterAndSampler) {
+  ScratchImg const img((ImageStackLoaderBST<ScratchImg>(ascendingImageFile)));
+  Img const ref((ImageStackLoaderBST<Img>(ascendingImageFile)));
+
+  ASSERT_EQ(ref.size(), img.size());
+  ASSERT_EQ(ref.resolution, img.resolution);
+  auto const map = img.map();
+  auto const refMap = ref.map();
+  ASSERT_TRUE(std::equal(map.cbegin(), map.cend(), refMap.cbegin()));
+
+  ::ImageStack::Sampler::Sampler<> sampler;
+  for (double z = 0; z < 10; z += 1.7)
+    for (double y = 0; y < 40; y += 3.3)
+      for (double x = 0; x < 20; x += 2.1)
+        ASSERT_EQ(sampler(ref, Eigen::Vector3d(x, y, z)),
+                  sampler(img, Eigen::Vector3d(x, y, z)));
+
+  Filter::GaussFilter<float> const gauss(Eigen::Vector3f(1, 1, 0.5f));
+  auto const result = Filter::filter(img, gauss);
+  auto const refResult = Filter::filter(ref, gauss);
+  static_assert(std::is_same<std::decay_t<decltype(result)>, ScratchImg>::value,
+                "Filter result must be stored in a scratch file");
+
+  auto const resultMap = result.map();
+  auto const refResultMap = refResult.map();
+  ASSERT_TRUE(std::equal(resultMap.cbegin(), resultMap.cend(),
+                         refResultMap.cbegin()));
+  result.storage().flush(true);
+}
+
+/// Filters an integral image in a scratch file with a recursive Gaussian and
+/// tests if the result equals the result for a HostStorage image and is
+/// stored in a scratch file as well
+TEST(ScratchFileStorage, RecursiveGauss) {
+  using ScratchLabels =
+      ::ImageStack::ImageStack<std::uint16_t, ScratchFileStorage>;
+  ScratchLabels img(Size3(20, 40, 10), 0);
+  ::ImageStack::ImageStack<std::uint16_t> ref(img.size(), 0);
+  auto map = img.map();
+  auto refMap = ref.map();
+  std::iota(map.begin(), map.end(), std::uint16_t{0});
+  std::iota(refMap.begin(), refMap.end(), std::uint16_t{0});
+
+  Filter::RecursiveGaussFilter const gauss(Eigen::Vector3d(2, 3, 1));
+  auto const result = Filter::filter(img, gauss);
+  auto const refResult = Filter::filter(ref, gauss);
+  static_assert(
+      std::is_same<std::decay_t<decltype(result)>, ScratchLabels>::value,
+      "Filter result must be stored in a scratch file");
+
+  auto const resultMap = result.map();
+  auto const refResultMap = refResult.map();
+  ASSERT_TRUE(std::equal(resultMap.cbegin(), resultMap.cend(),
+                         refResultMap.cbegin()));
+}
@@ -0,0 +1,188 @@
+/// @file testStatistics.cpp
+/// @brief Contains unit tests for the statistics of image stacks
+
+#include <ImageStack/BitMaskStorage.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackView.h>
+#include <ImageStack/Statistics.h>
+
+#include <gtest/gtest.h>
+
+#include "testHelpers.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#pragma clang diagnostic ignored "-Wglobal-constructors"
+#pragma clang diagnostic ignored "-Wmissing-variable-declarations"
+#pragma clang diagnostic ignored "-Wused-but-marked-unused"
+
+using namespace ImageStack;
+
+using Img = ::ImageStack::ImageStack<float>;
+
+/// @brief Creates an image with normally distributed values
+static Img randomImage(Size3 const &size) {
+  return test::randomImage(size, 7,
+                           std::normal_distribution<float>(100.0f, 25.0f));
+}
+
+/// @brief Computes the statistics of the given values with separate serial
+/// passes
+static Statistics reference(std::vector<std::pair<double, Index3>> const &v,
+                            Size bins, double lower, double upper) {
+  Statistics s;
+  s.count = v.size();
+  s.min = std::numeric_limits<double>::infinity();
+  s.max = -s.min;
+  for (auto const &x : v) {
+    s.sum += x.first;
+    if (x.first < s.min) {
+      s.min = x.first;
+      s.minPosition = x.second;
+    }
+    if (x.first > s.max) {
+      s.max = x.first;
+      s.maxPosition = x.second;
+    }
+  }
+  s.mean = s.sum / static_cast<double>(s.count);
+
+  double m2 = 0, m3 = 0, m4 = 0;
+  for (auto const &x : v) {
+    auto const d = x.first - s.mean;
+    m2 += d * d;
+    m3 += d * d * d;
+    m4 += d * d * d * d;
+  }
+  auto const n = static_cast<double>(s.count);
+  s.variance = m2 / n;
+  s.skewness = (m3 / n) / std::pow(s.variance, 1.5);
+  s.kurtosis = (m4 / n) / (s.variance * s.variance) - 3;
+
+  s.histogram.bins.assign(bins, 0);
+  for (auto const &x : v) {
+    if (x.first < lower) {
+      ++s.histogram.below;
+    } else if (x.first > upper) {
+      ++s.histogram.above;
+    } else {
+      auto const bin = static_cast<Size>((x.first - lower) /
+                                         (upper - lower) *
+                                         static_cast<double>(bins));
+      ++s.histogram.bins[std::min(bin, bins - 1)];
+    }
+  }
+  return s;
+}
+
+/// @brief Tests if two statistics match
+static void expectEqual(Statistics const &ref, Statistics const &s) {
+  ASSERT_EQ(ref.count, s.count);
+  EXPECT_NEAR(ref.sum, s.sum, 1e-9 * std::abs(ref.sum));
+  EXPECT_NEAR(ref.mean, s.mean, 1e-9 * std::abs(ref.mean));
+  EXPECT_NEAR(ref.variance, s.variance, 1e-9 * ref.variance);
+  EXPECT_NEAR(ref.skewness, s.skewness, 1e-6);
+  EXPECT_NEAR(ref.kurtosis, s.kurtosis, 1e-6);
+  EXPECT_EQ(ref.min, s.min);
+  EXPECT_EQ(ref.max, s.max);
+  EXPECT_EQ(ref.minPosition, s.minPosition);
+  EXPECT_EQ(ref.maxPosition, s.maxPosition);
+  EXPECT_EQ(ref.histogram.bins, s.histogram.bins);
+  EXPECT_EQ(ref.histogram.below, s.histogram.below);
+  EXPECT_EQ(ref.histogram.above, s.histogram.above);
+}
+
+/// @brief Returns all values of an image with their positions
+template <class Img>
+static auto values(Img const &img) {
+  std::vector<std::pair<double, Index3>> v;
+  auto const map = img.map();
+  auto const size = img.size();
+  for (Size z = 0; z < size[2]; ++z)
+    for (Size y = 0; y < size[1]; ++y)
+      for (Size x = 0; x < size[0]; ++x)
+        v.emplace_back(map[Index3(x, y, z)], Index3(x, y, z));
+  return v;
+}
+
+/// Computes the statistics of a random image and tests if
+///   - all moments, extrema and positions match a serial reference
+///   - the histogram matches, including values outside of its range
+///   - percentiles are approximated by the histogram
+///   - NaN values are ignored
+TEST(Statistics, Image) {
+  auto img = randomImage(Size3(67, 45, 31));
+
+  auto const ref = reference(values(img), 64, 50, 150);
+  expectEqual(ref, statistics(img, 64, 50, 150));
+
+  auto const noHistogram = statistics(img);
+  ASSERT_TRUE(noHistogram.histogram.bins.empty());
+  EXPECT_NEAR(ref.mean, noHistogram.mean, 1e-9 * ref.mean);
+  EXPECT_NEAR(std::sqrt(ref.variance), noHistogram.standardDeviation(), 1e-6);
+
+  auto const full = statistics(img, 1000);
+  ASSERT_EQ(ref.min, full.histogram.lower);
+  ASSERT_EQ(ref.max, full.histogram.upper);
+  ASSERT_EQ(0u, full.histogram.below + full.histogram.above);
+  ASSERT_EQ(ref.count, full.histogram.count());
+  // Median and quartiles of N(100, 25)
+  EXPECT_NEAR(100.0, full.histogram.percentile(50), 1.0);
+  EXPECT_NEAR(100.0 - 0.6745 * 25, full.histogram.percentile(25), 1.0);
+  EXPECT_NEAR(100.0 + 0.6745 * 25, full.histogram.percentile(75), 1.0);
+  EXPECT_EQ(ref.min, full.histogram.percentile(0));
+  EXPECT_EQ(ref.max, full.histogram.percentile(100));
+
+  img.map()[Index3(3, 4, 5)] = std::numeric_limits<float>::quiet_NaN();
+  ASSERT_EQ(ref.count - 1, statistics(img).count);
+}
+
+/// Computes masked statistics and tests if
+///   - only voxels inside of the mask are counted
+///   - bit masks and byte masks give the same results
+///   - an empty mask gives empty statistics
+TEST(Statistics, Mask) {
+  Size3 const size(40, 30, 20);
+  auto const img = randomImage(size);
+
+  ::ImageStack::ImageStack<std::uint8_t> mask(size, std::uint8_t{0});
+  auto maskMap = mask.map();
+  for (Size i = 0; i < maskMap.linearSize(); ++i)
+    maskMap[i] = (i % 7 == 0 || i % 11 == 3) ? 5 : 0;
+  BitMask<> const bits(mask);
+
+  std::vector<std::pair<double, Index3>> masked;
+  for (auto const &v : values(img))
+    if (mask.map()[v.second] != 0) masked.push_back(v);
+
+  auto const ref = reference(masked, 16, 60, 140);
+  expectEqual(ref, statistics(img, mask, 16, 60, 140));
+  expectEqual(ref, statistics(img, bits, 16, 60, 140));
+
+  BitMask<> const empty(BitMaskStorage<std::uint8_t>(size, 0));
+  auto const none = statistics(img, empty, 8);
+  ASSERT_EQ(0u, none.count);
+  ASSERT_EQ(8u, none.histogram.bins.size());
+  ASSERT_EQ(0u, none.histogram.count());
+}
+
+/// Computes the statistics of integral images and views and tests if they
+/// match a serial reference
+TEST(Statistics, TypesAndViews) {
+  ::ImageStack::ImageStack<std::int16_t> labels(Size3(50, 41, 33),
+                                                std::int16_t{0});
+  auto map = labels.map();
+  for (Size i = 0; i < map.linearSize(); ++i)
+    map[i] = static_cast<std::int16_t>((i * 7919) % 301) - 150;
+
+  expectEqual(reference(values(labels), 301, -150.5, 150.5),
+              statistics(labels, 301, -150.5, 150.5));
+
+  auto const sub = subVolume(labels, Index3(5, 6, 7), Size3(20, 10, 15));
+  expectEqual(reference(values(sub), 10, -100, 100),
+              statistics(sub, 10, -100, 100));
+}
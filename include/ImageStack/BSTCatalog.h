@@ -0,0 +1,427 @@
+#pragma once
+
+#include "BinaryStream.h"
+#include "ByteSwap.h"
+#include "MultiIndex.h"
+#include "Types.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Header information of a single .bst file
+struct BSTCatalogEntry {
+  /// @brief Path of the file
+  std::string path;
+  /// @brief Size of the file in bytes
+  std::uint64_t fileSize{0};
+  /// @brief Last modification time in nanoseconds since the epoch
+  std::int64_t modificationTime{0};
+  /// @brief True if the file is a mask, false if it is an image
+  bool isMask{false};
+  /// @brief True if the header is consistent with the file size, i.e. the
+  /// file can be read by ImageStackLoaderBST with a voxel type of size
+  /// @c elementSize
+  bool valid{false};
+  /// @brief Size of a voxel in bytes, derived from the file size
+  std::uint32_t elementSize{0};
+  Size3 size{Size3::Zero()};
+  Eigen::Vector3d resolution{Eigen::Vector3d::Zero()};
+  /// @brief Offset of the voxel data from the beginning of the file in bytes
+  std::uint64_t dataOffset{0};
+};
+
+/// @brief Catalog of the headers of all .bst files in a directory tree
+///
+/// Scanning only reads the first bytes of each file with a single @c pread
+/// and parses them without streams. The files are processed in parallel.
+/// A catalog can be saved to a compact binary index file. Passing the loaded
+/// index to @c scan() reuses all entries whose file size and modification
+/// time did not change, so only new or modified files are read.
+///
+/// Images and masks are distinguished by their first byte: the header of an
+/// image starts with a big endian 32 bit integer 1, the header of a mask
+/// with an ASCII digit. An image header with the wrong byte order results in
+/// sizes that do not match the file size, such entries are marked invalid.
+///
+/// Unit tests are in \ref testBSTCatalog.cpp
+class BSTCatalog {
+public:
+  using Entries = std::vector<BSTCatalogEntry>;
+
+  BSTCatalog() = default;
+
+  /// @brief Scans the given directory recursively for .bst files and reads
+  /// their headers
+  /// @param directory root of the directory tree to scan
+  /// @throw std::runtime_error if @c directory could not be opened
+  static BSTCatalog scan(std::string const &directory) {
+    return scan(directory, BSTCatalog());
+  }
+
+  /// @brief Scans the given directory recursively for .bst files and reads
+  /// the headers of all files that are new or changed since @c previous
+  /// @param directory root of the directory tree to scan
+  /// @param previous catalog of a previous scan, entries of unchanged files
+  /// are reused
+  /// @throw std::runtime_error if @c directory could not be opened
+  static BSTCatalog scan(std::string const &directory,
+                         BSTCatalog const &previous) {
+    std::vector<std::string> paths;
+    listFiles(directory, paths);
+    std::sort(paths.begin(), paths.end());
+
+    std::unordered_map<std::string, BSTCatalogEntry const *> known;
+    for (auto const &entry : previous.entries_) known[entry.path] = &entry;
+
+    auto const n = paths.size();
+    Entries entries(n);
+    std::vector<char> found(n, 0);
+    std::vector<char> reused(n, 0);
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (long i = 0; i < narrow<long>(n); ++i) {
+      auto const idx = static_cast<Size>(i);
+      auto &entry = entries[idx];
+      entry.path = paths[idx];
+      if (!stat(entry)) continue;
+      found[idx] = 1;
+
+      auto const it = known.find(entry.path);
+      if (it != known.end() && it->second->fileSize == entry.fileSize &&
+          it->second->modificationTime == entry.modificationTime) {
+        entry = *it->second;
+        reused[idx] = 1;
+        continue;
+      }
+
+      parseHeader(entry);
+    }
+
+    BSTCatalog catalog;
+    for (Size i = 0; i < n; ++i) {
+      if (!found[i]) continue;
+      catalog.entries_.push_back(std::move(entries[i]));
+      if (reused[i]) ++catalog.numReused_;
+    }
+
+    return catalog;
+  }
+
+  /// @brief Loads the index at @c indexFile if it exists, scans the given
+  /// directory reusing the loaded entries and saves the result to
+  /// @c indexFile
+  /// @throw std::runtime_error if @c directory could not be opened or the
+  /// index could not be written
+  static BSTCatalog update(std::string const &directory,
+                           std::string const &indexFile) {
+    BSTCatalog previous;
+    try {
+      previous = load(indexFile);
+    } catch (std::runtime_error const &) {
+      // no or outdated index, scan all files
+    }
+
+    auto catalog = scan(directory, previous);
+    catalog.save(indexFile);
+
+    return catalog;
+  }
+
+  /// @brief Reads the header of a single file
+  /// @throw std::runtime_error if the file could not be accessed
+  static BSTCatalogEntry readHeader(std::string const &path) {
+    BSTCatalogEntry entry;
+    entry.path = path;
+    if (!stat(entry))
+      throw std::runtime_error("Failed to access file '" + path + "'");
+    parseHeader(entry);
+
+    return entry;
+  }
+
+  /// @brief Loads a catalog from an index file written by @c save()
+  /// @throw std::runtime_error if the file could not be read or is not a
+  /// valid index file
+  static BSTCatalog load(std::string const &indexFile) {
+    std::ifstream in(indexFile, std::ios_base::in | std::ios_base::binary);
+    if (!in)
+      throw std::runtime_error("Failed to open file '" + indexFile + "'");
+
+    std::array<char, 4> magic;
+    in.read(magic.data(), magic.size());
+    if (!in || magic != kMagic() ||
+        detail::readLE<std::uint32_t>(in) != kVersion)
+      throw std::runtime_error("Invalid catalog index '" + indexFile + "'");
+
+    BSTCatalog catalog;
+    auto const n = detail::readLE<std::uint64_t>(in);
+    for (std::uint64_t i = 0; i < n && in; ++i) {
+      BSTCatalogEntry entry;
+      entry.path.resize(detail::readLE<std::uint32_t>(in));
+      in.read(&entry.path[0], static_cast<std::streamsize>(entry.path.size()));
+      entry.fileSize = detail::readLE<std::uint64_t>(in);
+      entry.modificationTime = detail::readLE<std::int64_t>(in);
+      auto const flags = detail::readLE<std::uint8_t>(in);
+      entry.isMask = flags & 1;
+      entry.valid = flags & 2;
+      entry.elementSize = detail::readLE<std::uint32_t>(in);
+      for (int d = 0; d < 3; ++d)
+        entry.size[d] = narrow<Size>(detail::readLE<std::uint64_t>(in));
+      for (int d = 0; d < 3; ++d)
+        entry.resolution[d] = detail::readLE<double>(in);
+      entry.dataOffset = detail::readLE<std::uint64_t>(in);
+      catalog.entries_.push_back(std::move(entry));
+    }
+
+    if (!in)
+      throw std::runtime_error("Invalid catalog index '" + indexFile + "'");
+
+    return catalog;
+  }
+
+  /// @brief Saves the catalog to a binary index file
+  /// @throw std::runtime_error if the file could not be written
+  void save(std::string const &indexFile) const {
+    std::ofstream out(indexFile, std::ios_base::out | std::ios_base::binary |
+                                     std::ios_base::trunc);
+    if (!out)
+      throw std::runtime_error("Failed to open file '" + indexFile + "'");
+
+    auto const magic = kMagic();
+    out.write(magic.data(), magic.size());
+    detail::writeLE(out, kVersion);
+    detail::writeLE(out, static_cast<std::uint64_t>(entries_.size()));
+    for (auto const &entry : entries_) {
+      detail::writeLE(out, narrow<std::uint32_t>(entry.path.size()));
+      out.write(entry.path.data(),
+                static_cast<std::streamsize>(entry.path.size()));
+      detail::writeLE(out, entry.fileSize);
+      detail::writeLE(out, entry.modificationTime);
+      detail::writeLE(out, static_cast<std::uint8_t>((entry.isMask ? 1 : 0) |
+                                                     (entry.valid ? 2 : 0)));
+      detail::writeLE(out, entry.elementSize);
+      for (int d = 0; d < 3; ++d)
+        detail::writeLE(out, static_cast<std::uint64_t>(entry.size[d]));
+      for (int d = 0; d < 3; ++d) detail::writeLE(out, entry.resolution[d]);
+      detail::writeLE(out, entry.dataOffset);
+    }
+
+    out.flush();
+    if (!out)
+      throw std::runtime_error("Failed to write file '" + indexFile + "'");
+  }
+
+  /// @brief Returns all entries, sorted by path
+  inline Entries const &entries() const noexcept { return entries_; }
+
+  /// @brief Returns the number of entries
+  inline Size size() const noexcept { return entries_.size(); }
+
+  /// @brief Returns the entry of the given path or nullptr if there is none
+  BSTCatalogEntry const *find(std::string const &path) const {
+    auto const it = std::lower_bound(
+        entries_.cbegin(), entries_.cend(), path,
+        [](auto const &entry, auto const &p) { return entry.path < p; });
+    return it != entries_.cend() && it->path == path ? &*it : nullptr;
+  }
+
+  /// @brief Returns the number of entries reused from the previous catalog
+  /// during the last scan
+  inline Size numReused() const noexcept { return numReused_; }
+
+private:
+  static constexpr std::array<char, 4> kMagic() noexcept {
+    return {{'B', 'S', 'T', 'C'}};
+  }
+  static constexpr std::uint32_t kVersion = 1;
+  /// @brief Size of the header of an image in bytes
+  static constexpr std::size_t kImageHeaderSize = 64;
+  /// @brief Maximum size of the header of a mask in bytes
+  static constexpr std::size_t kMaxMaskHeaderSize = 1024;
+
+  /// @brief Collects the paths of all .bst files below @c directory
+  static void listFiles(std::string const &directory,
+                        std::vector<std::string> &paths) {
+    auto *dir = ::opendir(directory.c_str());
+    if (!dir)
+      throw std::runtime_error("Failed to open directory '" + directory + "'");
+    auto const closeDir = finally([dir] { ::closedir(dir); });
+
+    std::vector<std::string> subdirs;
+    while (auto const *ent = ::readdir(dir)) {
+      std::string const name = ent->d_name;
+      if (name == "." || name == "..") continue;
+      auto const path = directory + '/' + name;
+
+      bool isDir = ent->d_type == DT_DIR;
+      bool isFile = ent->d_type == DT_REG;
+      if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+        struct ::stat st;
+        if (::stat(path.c_str(), &st) != 0) continue;
+        isDir = S_ISDIR(st.st_mode);
+        isFile = S_ISREG(st.st_mode);
+      }
+
+      if (isDir) {
+        subdirs.push_back(path);
+      } else if (isFile && name.size() > 4 &&
+                 name.compare(name.size() - 4, 4, ".bst") == 0) {
+        paths.push_back(path);
+      }
+    }
+
+    for (auto const &subdir : subdirs) {
+      try {
+        listFiles(subdir, paths);
+      } catch (std::runtime_error const &) {
+        // unreadable subdirectories are skipped
+      }
+    }
+  }
+
+  /// @brief Sets file size and modification time of the given entry
+  /// @return false if the file does not exist
+  static bool stat(BSTCatalogEntry &entry) {
+    struct ::stat st;
+    if (::stat(entry.path.c_str(), &st) != 0) return false;
+
+    entry.fileSize = static_cast<std::uint64_t>(st.st_size);
+#ifdef __APPLE__
+    auto const &mtime = st.st_mtimespec;
+#else
+    auto const &mtime = st.st_mtim;
+#endif
+    entry.modificationTime =
+        static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+
+    return true;
+  }
+
+  /// @brief Reads and parses the header of the file of the given entry
+  ///
+  /// Files that can not be read or parsed are marked invalid.
+  static void parseHeader(BSTCatalogEntry &entry) {
+    std::array<char, kMaxMaskHeaderSize> buffer;
+    auto const fd = ::open(entry.path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    auto const bytes = ::pread(fd, buffer.data(), buffer.size(), 0);
+    ::close(fd);
+    if (bytes <= 0) return;
+
+    auto const length = static_cast<std::size_t>(bytes);
+    entry.isMask = buffer[0] >= '0' && buffer[0] <= '9';
+    if (entry.isMask) {
+      parseMaskHeader(entry, buffer.data(), length);
+    } else {
+      parseImageHeader(entry, buffer.data(), length);
+    }
+  }
+
+  static void parseImageHeader(BSTCatalogEntry &entry, char const *data,
+                               std::size_t length) {
+    if (length < kImageHeaderSize) return;
+
+    auto const int32 = [data](std::size_t i) {
+      std::int32_t v;
+      std::memcpy(&v, data + i * sizeof(v), sizeof(v));
+      convertByteOrder(&v, 1, Endianness::BigEndian);
+      return v;
+    };
+
+    bool plausible = int32(9) == 1;
+    for (int d = 0; d < 3; ++d) {
+      auto const s = int32(6 + static_cast<std::size_t>(d));
+      plausible = plausible && s > 0;
+      entry.size[d] = static_cast<Size>(std::max(0, s));
+
+      double r;
+      std::memcpy(&r, data + 40 + static_cast<std::size_t>(d) * sizeof(r),
+                  sizeof(r));
+      convertByteOrder(&r, 1, Endianness::BigEndian);
+      entry.resolution[d] = r;
+    }
+    if (!plausible) return;
+
+    auto const n = indexProduct(entry.size);
+    auto const dataBytes = entry.fileSize - kImageHeaderSize;
+    if (entry.fileSize < kImageHeaderSize || dataBytes % n != 0) return;
+
+    auto const elementSize = dataBytes / n;
+    entry.elementSize = static_cast<std::uint32_t>(elementSize);
+    entry.dataOffset = kImageHeaderSize;
+    entry.valid = (elementSize == 1 || elementSize == 2 || elementSize == 4 ||
+                   elementSize == 8) &&
+                  validResolution(entry.resolution);
+  }
+
+  static void parseMaskHeader(BSTCatalogEntry &entry, char const *data,
+                              std::size_t length) {
+    // Find the ends of the four header lines
+    std::array<std::size_t, 4> lineEnd;
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < length && line < 4; ++i)
+      if (data[i] == '\n') lineEnd[line++] = i;
+    if (line < 4) return;
+
+    std::string const header(data, lineEnd[3] + 1);
+    auto const parseLine = [&header](std::size_t begin, auto parse) {
+      auto const *p = header.c_str() + begin;
+      for (int d = 0; d < 3; ++d) {
+        char *end;
+        parse(d, p, &end);
+        if (end == p) return false;
+        p = *end == ';' ? end + 1 : end;
+      }
+      return true;
+    };
+
+    bool const ok =
+        parseLine(lineEnd[0] + 1,
+                  [&entry](int d, char const *p, char **end) {
+                    entry.size[d] = std::strtoull(p, end, 10);
+                  }) &&
+        parseLine(lineEnd[2] + 1, [&entry](int d, char const *p, char **end) {
+          entry.resolution[d] = std::strtod(p, end);
+        });
+    if (!ok || entry.size.minCoeff() == 0) return;
+
+    auto const n = indexProduct(entry.size);
+    auto const dataBytes = entry.fileSize - header.size();
+    if (entry.fileSize < header.size() || dataBytes % n != 0) return;
+
+    auto const elementSize = dataBytes / n;
+    entry.elementSize = static_cast<std::uint32_t>(elementSize);
+    entry.dataOffset = header.size();
+    entry.valid = (elementSize == 1 || elementSize == 2 || elementSize == 4 ||
+                   elementSize == 8) &&
+                  validResolution(entry.resolution);
+  }
+
+  static bool validResolution(Eigen::Vector3d const &resolution) {
+    return resolution.allFinite() && (resolution.array() > 0).all();
+  }
+
+  Entries entries_;
+  Size numReused_{0};
+};
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -37,11 +37,21 @@ template <> struct ChangeEndianness<4> {
     return b;
   }
 };
+
+template <> struct ChangeEndianness<8> {
+  template <class T> inline T operator()(T a) const {
+    T b;
+    for (int i = 0; i < 8; ++i)
+      reinterpret_cast<std::uint8_t *>(&b)[i] =
+          reinterpret_cast<std::uint8_t const *>(&a)[7 - i];
+    return b;
+  }
+};
 } // namespace detail
 
 /// @brief Changes the endianness of the given value.
 /// @note Currently only Big- and Little-Endian is supported.
-/// also note that currently there is no support for 64bit or larger types.
+/// also note that currently there is no support for types larger than 64bit.
 template <class T> inline T ChangeEndianness(T const &a) {
   return detail::ChangeEndianness<sizeof(T)>()(a);
 }
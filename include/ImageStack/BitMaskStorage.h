@@ -0,0 +1,625 @@
+#pragma once
+
+#include <ImageStack/HostStorage.h>
+#include <ImageStack/ImageStack.h>
+#include <ImageStack/ImageStackLoader.h>
+#include <ImageStack/MultiIndex.h>
+#include <ImageStack/Types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ImageStack {
+
+namespace detail {
+
+using BitWord = std::uint64_t;
+
+/// @brief Number of bits of a BitWord
+constexpr Size kWordBits = 64;
+
+/// @brief Returns the number of set bits of @c word
+inline Size popcount(BitWord word) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<Size>(__builtin_popcountll(word));
+#elif defined(_MSC_VER)
+  return static_cast<Size>(__popcnt64(word));
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ull);
+  word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return static_cast<Size>((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/// @brief Returns the index of the lowest set bit of @c word
+/// @pre `word != 0`
+inline Size countTrailingZeros(BitWord word) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<Size>(__builtin_ctzll(word));
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return index;
+#else
+  Size n = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+/// @brief Returns the number of words needed to store @c n bits
+constexpr Size numWords(Size n) noexcept {
+  return (n + kWordBits - 1) / kWordBits;
+}
+
+/// @brief Returns the mask of the valid bits of the last word of a mask of
+/// @c n bits
+constexpr BitWord lastWordMask(Size n) noexcept {
+  return n % kWordBits == 0 ? ~BitWord{0}
+                            : (BitWord{1} << (n % kWordBits)) - 1;
+}
+
+/// @brief Number of slices read at once by the BitMaskStorage loader
+/// constructor
+constexpr Size kMaskLoadSlabSize = 8;
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Proxy referencing a single bit of a bit mask
+///
+/// Converts to @c T (0 or 1), assigning a value sets the bit if the value is
+/// not 0.
+template <class T> class BitReference {
+public:
+  inline operator T() const noexcept {
+    return static_cast<T>((*word_ & mask_) != 0);
+  }
+
+  inline BitReference &operator=(T value) noexcept {
+    if (value != T{0}) {
+      *word_ |= mask_;
+    } else {
+      *word_ &= ~mask_;
+    }
+    return *this;
+  }
+
+  inline BitReference &operator=(BitReference const &other) noexcept {
+    return *this = static_cast<T>(other);
+  }
+
+  BitReference(BitReference const &) = default;
+
+private:
+  template <class, bool> friend class MappedBitMask;
+
+  inline BitReference(detail::BitWord *word, detail::BitWord mask) noexcept
+      : word_(word), mask_(mask) {}
+
+  detail::BitWord *word_;
+  detail::BitWord mask_;
+};
+
+/// @brief Mapping of a bit packed mask
+///
+/// Voxels are stored as single bits in x-fastest order. Const access returns
+/// values of type @c T, mutable access returns a BitReference proxy, so
+/// existing code using @c operator[] works unchanged. Iteration visits the
+/// voxels in logical order.
+///
+/// The bits of the last word beyond the last voxel are always 0.
+///
+/// Test cases are in \ref testBitMaskStorage.cpp
+///
+/// @tparam T value type of the voxels
+/// @tparam IsConst true for read only mappings
+template <class T, bool IsConst> class MappedBitMask {
+  using Word = std::conditional_t<IsConst, detail::BitWord const,
+                                  detail::BitWord>;
+
+  template <bool ConstIter> class Iterator;
+
+public:
+  using value_type = T;
+  using reference = std::conditional_t<IsConst, T, BitReference<T>>;
+  using const_reference = T;
+  using iterator = Iterator<IsConst>;
+  using const_iterator = Iterator<true>;
+  using difference_type = std::ptrdiff_t;
+  using size_type = std::size_t;
+
+  /// @brief Creates a mapping of the given words
+  inline MappedBitMask(not_null<Word *> words, Size3 const &size) noexcept
+      : words_(words.get()), size_(size) {}
+
+  /// @brief Converts a mutable mapping to a read only mapping
+  template <bool C, typename = std::enable_if_t<IsConst && !C>>
+  inline MappedBitMask(MappedBitMask<T, C> const &other) noexcept
+      : words_(other.words()), size_(other.extent()) {}
+
+  /// @brief Returns the value of the voxel at the given multi index or linear
+  /// index
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T operator[](Idx const &i) const {
+    auto const bit = toLinear(i, size_);
+    Expects(bit < linearSize());
+    return static_cast<T>((words_[bit / detail::kWordBits] >>
+                           (bit % detail::kWordBits)) &
+                          1);
+  }
+
+  /// @brief Returns a proxy of the voxel at the given multi index or linear
+  /// index
+  template <class Idx, bool C = IsConst,
+            typename = std::enable_if_t<
+                !C && (isModelOfMultiIndex_v<Idx> ||
+                       std::is_convertible<Idx, Size>::value)>>
+  inline BitReference<T> operator[](Idx const &i) {
+    auto const bit = toLinear(i, size_);
+    Expects(bit < linearSize());
+    return BitReference<T>(words_ + bit / detail::kWordBits,
+                           detail::BitWord{1} << (bit % detail::kWordBits));
+  }
+
+  /// @brief Returns the number of voxels
+  inline size_type linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns the size of the volume
+  inline auto size() const noexcept {
+    return std::array<size_type, 3>{{size_[0], size_[1], size_[2]}};
+  }
+
+  /// @brief Returns the size of the volume as Size3
+  inline Size3 const &extent() const noexcept { return size_; }
+
+  /// @brief Returns a pointer to the packed words
+  inline Word *words() const noexcept { return words_; }
+
+  /// @brief Returns the number of packed words
+  inline Size numWords() const noexcept {
+    return detail::numWords(linearSize());
+  }
+
+  /// @brief Returns the number of set voxels
+  Size count() const noexcept {
+    auto const n = narrow<long>(numWords());
+    Size total = 0;
+#pragma omp parallel for reduction(+ : total) schedule(static)
+    for (long w = 0; w < n; ++w) total += detail::popcount(words_[w]);
+    return total;
+  }
+
+  inline const_iterator begin() const noexcept { return cbegin(); }
+  inline const_iterator cbegin() const noexcept {
+    return const_iterator(words_, 0);
+  }
+  inline const_iterator end() const noexcept { return cend(); }
+  inline const_iterator cend() const noexcept {
+    return const_iterator(words_, linearSize());
+  }
+
+  inline iterator begin() noexcept { return iterator(words_, 0); }
+  inline iterator end() noexcept { return iterator(words_, linearSize()); }
+
+private:
+  /// @brief Random access iterator over the voxels in logical order
+  template <bool ConstIter> class Iterator {
+    using IterWord = std::conditional_t<ConstIter, detail::BitWord const,
+                                        detail::BitWord>;
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = std::conditional_t<ConstIter, T, BitReference<T>>;
+
+    Iterator() = default;
+
+    inline reference operator*() const noexcept {
+      return deref(std::integral_constant<bool, ConstIter>{});
+    }
+    inline reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
+
+    inline Iterator &operator++() noexcept {
+      ++i_;
+      return *this;
+    }
+    inline Iterator operator++(int) noexcept {
+      auto tmp = *this;
+      ++i_;
+      return tmp;
+    }
+    inline Iterator &operator--() noexcept {
+      --i_;
+      return *this;
+    }
+    inline Iterator operator--(int) noexcept {
+      auto tmp = *this;
+      --i_;
+      return tmp;
+    }
+    inline Iterator &operator+=(difference_type n) noexcept {
+      i_ = static_cast<Size>(static_cast<difference_type>(i_) + n);
+      return *this;
+    }
+    inline Iterator &operator-=(difference_type n) noexcept {
+      return *this += -n;
+    }
+    inline Iterator operator+(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp += n;
+    }
+    inline friend Iterator operator+(difference_type n,
+                                     Iterator const &it) noexcept {
+      return it + n;
+    }
+    inline Iterator operator-(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp -= n;
+    }
+    inline difference_type operator-(Iterator const &other) const noexcept {
+      return static_cast<difference_type>(i_) -
+             static_cast<difference_type>(other.i_);
+    }
+
+    inline bool operator==(Iterator const &other) const noexcept {
+      return i_ == other.i_;
+    }
+    inline bool operator!=(Iterator const &other) const noexcept {
+      return i_ != other.i_;
+    }
+    inline bool operator<(Iterator const &other) const noexcept {
+      return i_ < other.i_;
+    }
+    inline bool operator>(Iterator const &other) const noexcept {
+      return i_ > other.i_;
+    }
+    inline bool operator<=(Iterator const &other) const noexcept {
+      return i_ <= other.i_;
+    }
+    inline bool operator>=(Iterator const &other) const noexcept {
+      return i_ >= other.i_;
+    }
+
+  private:
+    friend class MappedBitMask;
+
+    inline Iterator(IterWord *words, Size i) noexcept : words_(words), i_(i) {}
+
+    inline T deref(std::true_type) const noexcept {
+      return static_cast<T>(
+          (words_[i_ / detail::kWordBits] >> (i_ % detail::kWordBits)) & 1);
+    }
+
+    inline BitReference<T> deref(std::false_type) const noexcept {
+      return BitReference<T>(words_ + i_ / detail::kWordBits,
+                             detail::BitWord{1} << (i_ % detail::kWordBits));
+    }
+
+    IterWord *words_{nullptr};
+    Size i_{0};
+  };
+
+  Word *words_;
+  Size3 size_;
+};
+
+/// @brief Storage policy packing one bit per voxel
+///
+/// Intended for binary masks, e.g. loaded by ImageStackLoaderBST with
+/// @c IsMask set: every voxel that is not 0 is stored as 1. Compared to one
+/// byte per voxel, this reduces the memory by a factor of 8 and lets boolean
+/// operations and counting work on 64 voxels at once (see the free functions
+/// below).
+///
+/// Unit tests are in \ref testBitMaskStorage.cpp
+/// @tparam T value type of the voxels, e.g. @c std::uint8_t or @c bool
+template <class T> class BitMaskStorage {
+  static_assert(std::is_integral<T>::value,
+                "BitMaskStorage requires an integral value type");
+
+public:
+  using ValueType = T;
+  using Mapping = MappedBitMask<T, false>;
+  using ConstMapping = MappedBitMask<T, true>;
+
+  /// @brief Creates a storage with all voxels set to 0
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline explicit BitMaskStorage(Size size)
+      : BitMaskStorage(size, T{0}) {}
+
+  /// @brief Creates a storage with all voxels set to @c init
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline BitMaskStorage(Size size, T const &init)
+      : size_(size[0], size[1], size[2]),
+        words_(wordsSize(size_), init != T{0} ? ~detail::BitWord{0}
+                                               : detail::BitWord{0}) {
+    clearPadding();
+  }
+
+  /// @brief Creates a storage from the given content in linear (x-fastest)
+  /// order
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @tparam Container model of ContiguousContainer
+  template <class Size, class Container,
+            typename = std::enable_if_t<
+                std::is_convertible<decltype(std::declval<Container>().data()),
+                                    T const *>::value &&
+                isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline BitMaskStorage(Size size, Container const &init)
+      : BitMaskStorage(size) {
+    Expects(indexProduct(size_) == init.size());
+    pack(init.data(), 0, init.size());
+  }
+
+  /// @brief Loads a mask using the given loader
+  ///
+  /// Loaders that can read ranges of slices (e.g. ImageStackLoaderBST) are
+  /// read in slabs, so only a slab of a few slices is buffered unpacked.
+  template <class Loader, typename = std::enable_if_t<isLoader_v<Loader>>>
+  inline explicit BitMaskStorage(Loader &loader)
+      : BitMaskStorage(loader.size()) {
+    Expects(!empty());
+    load(loader, detail::HasReadSlices<Loader, T>{});
+  }
+
+  BitMaskStorage(BitMaskStorage const &) = default;
+  BitMaskStorage &operator=(BitMaskStorage const &) = default;
+
+  inline BitMaskStorage(BitMaskStorage &&other) noexcept
+      : size_(other.size_), words_(std::move(other.words_)) {
+    other.size_.setZero();
+  }
+
+  inline BitMaskStorage &operator=(BitMaskStorage &&other) noexcept {
+    size_ = other.size_;
+    words_ = std::move(other.words_);
+    other.size_.setZero();
+    return *this;
+  }
+
+  /// @brief Returns the size of the storage
+  inline auto size() const noexcept { return size_; }
+
+  /// @brief Returns the number of voxels
+  inline Size linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns true if the storage is empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+  /// @brief Maps the storage to host memory
+  /// @pre The storage object must not be empty
+  inline auto map() noexcept {
+    Expects(!empty());
+    return Mapping(not_null<detail::BitWord *>(words_.map().data()), size_);
+  }
+
+  /// @brief Maps the storage to host memory and returns a const mapping
+  inline auto map() const noexcept {
+    Expects(!empty());
+    return ConstMapping(not_null<detail::BitWord const *>(words_.map().data()),
+                        size_);
+  }
+
+private:
+  /// @brief Returns the size of the word buffer, one word per slice of the
+  /// buffer so large masks are initialized in parallel
+  static Size3 wordsSize(Size3 const &size) {
+    return Size3(1, 1, detail::numWords(indexProduct(size)));
+  }
+
+  /// @brief Sets the unused bits of the last word to 0
+  inline void clearPadding() noexcept {
+    if (empty()) return;
+    auto const n = detail::numWords(linearSize());
+    words_.map().data()[n - 1] &= detail::lastWordMask(linearSize());
+  }
+
+  /// @brief Packs @c count values into the bits starting at bit @c first
+  void pack(T const *src, Size first, Size count) {
+    if (count == 0) return;
+    auto *words = words_.map().data();
+    auto const last = first + count;
+    auto const firstWord = narrow<long>(first / detail::kWordBits);
+    auto const endWord = narrow<long>(detail::numWords(last));
+
+#pragma omp parallel for schedule(static)
+    for (long w = firstWord; w < endWord; ++w) {
+      auto const wordBegin = static_cast<Size>(w) * detail::kWordBits;
+      auto const begin = std::max(first, wordBegin);
+      auto const end = std::min(last, wordBegin + detail::kWordBits);
+      detail::BitWord bits = 0, mask = 0;
+      for (Size i = begin; i < end; ++i) {
+        auto const bit = detail::BitWord{1} << (i % detail::kWordBits);
+        mask |= bit;
+        if (src[i - first] != T{0}) bits |= bit;
+      }
+      words[w] = (words[w] & ~mask) | bits;
+    }
+  }
+
+  /// @brief Reads slabs of slices and packs them
+  template <class Loader> void load(Loader &loader, std::true_type) {
+    auto const slice = size_[0] * size_[1];
+    auto const slab = std::min(size_[2], detail::kMaskLoadSlabSize);
+    HostStorage<T> buffer(Size3(size_[0], size_[1], slab));
+    for (Size z = 0; z < size_[2]; z += slab) {
+      auto const count = std::min(slab, size_[2] - z);
+      loader.template readSlices<T>(z, count, buffer.map().data());
+      pack(buffer.map().data(), z * slice, count * slice);
+    }
+  }
+
+  /// @brief Reads the whole volume and packs it
+  template <class Loader> void load(Loader &loader, std::false_type) {
+    HostStorage<T> buffer(size_);
+    loader.template readData<T>(buffer.map().data());
+    pack(buffer.map().data(), 0, linearSize());
+  }
+
+  Size3 size_;
+  HostStorage<detail::BitWord> words_;
+};
+#pragma clang diagnostic pop
+
+template <> struct IsHostStorage<BitMaskStorage> : public std::true_type {};
+
+/// @brief Bit packed mask image stack
+template <class T = std::uint8_t, class... Decorators>
+using BitMask = ImageStack<T, BitMaskStorage, Decorators...>;
+
+namespace detail {
+
+/// @brief Applies @c op to all words of @c a and @c b and stores the result
+/// in @c a
+template <class T, class... DA, class... DB, class Op>
+inline void bitMaskWordOp(BitMask<T, DA...> &a, BitMask<T, DB...> const &b,
+                          Op op) {
+  Expects(a.size() == b.size());
+  auto dst = a.map();
+  auto const src = b.map();
+  auto *out = dst.words();
+  auto const *in = src.words();
+  auto const n = narrow<long>(dst.numWords());
+
+#pragma omp parallel for schedule(static)
+  for (long w = 0; w < n; ++w) out[w] = op(out[w], in[w]);
+}
+
+} // namespace detail
+
+/// @name Boolean operations on bit masks
+/// The operations work on 64 voxels at once.
+/// @pre both masks must have the same size
+/// @{
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> &operator&=(BitMask<T, DA...> &a,
+                                     BitMask<T, DB...> const &b) {
+  detail::bitMaskWordOp(a, b, [](auto x, auto y) { return x & y; });
+  return a;
+}
+
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> &operator|=(BitMask<T, DA...> &a,
+                                     BitMask<T, DB...> const &b) {
+  detail::bitMaskWordOp(a, b, [](auto x, auto y) { return x | y; });
+  return a;
+}
+
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> &operator^=(BitMask<T, DA...> &a,
+                                     BitMask<T, DB...> const &b) {
+  detail::bitMaskWordOp(a, b, [](auto x, auto y) { return x ^ y; });
+  return a;
+}
+
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> operator&(BitMask<T, DA...> a,
+                                   BitMask<T, DB...> const &b) {
+  a &= b;
+  return a;
+}
+
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> operator|(BitMask<T, DA...> a,
+                                   BitMask<T, DB...> const &b) {
+  a |= b;
+  return a;
+}
+
+template <class T, class... DA, class... DB>
+inline BitMask<T, DA...> operator^(BitMask<T, DA...> a,
+                                   BitMask<T, DB...> const &b) {
+  a ^= b;
+  return a;
+}
+
+/// @brief Inverts all voxels of the mask in place
+template <class T, class... D> inline void invert(BitMask<T, D...> &mask) {
+  if (mask.empty()) return;
+  auto map = mask.map();
+  auto *words = map.words();
+  auto const n = narrow<long>(map.numWords());
+
+#pragma omp parallel for schedule(static)
+  for (long w = 0; w < n; ++w) words[w] = ~words[w];
+  words[n - 1] &= detail::lastWordMask(map.linearSize());
+}
+
+template <class T, class... D>
+inline BitMask<T, D...> operator~(BitMask<T, D...> mask) {
+  invert(mask);
+  return mask;
+}
+/// @}
+
+/// @brief Returns the number of set voxels of the mask
+template <class T, class... D> inline Size count(BitMask<T, D...> const &mask) {
+  return mask.empty() ? 0 : mask.map().count();
+}
+
+/// @brief Calls @c f with the position (Index3) of each set voxel, in
+/// logical order
+///
+/// Words without set bits are skipped as a whole.
+template <class T, class... D, class F>
+void forEachSetBit(BitMask<T, D...> const &mask, F &&f) {
+  if (mask.empty()) return;
+  auto const map = mask.map();
+  auto const *words = map.words();
+  auto const size = map.extent();
+  auto const slice = size[0] * size[1];
+
+  for (Size w = 0; w < map.numWords(); ++w) {
+    for (auto word = words[w]; word != 0; word &= word - 1) {
+      auto const i = w * detail::kWordBits + detail::countTrailingZeros(word);
+      f(Index3(i % size[0], (i % slice) / size[0], i / slice));
+    }
+  }
+}
+
+/// @brief Calls @c f with the position (Index3) of each set voxel using
+/// multiple threads
+///
+/// The order of the calls is unspecified, @c f must be thread safe.
+template <class T, class... D, class F>
+void forEachSetBit(BitMask<T, D...> const &mask, F &&f, ParallelTag) {
+  if (mask.empty()) return;
+  auto const map = mask.map();
+  auto const *words = map.words();
+  auto const size = map.extent();
+  auto const slice = size[0] * size[1];
+  auto const n = narrow<long>(map.numWords());
+
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (long w = 0; w < n; ++w) {
+    for (auto word = words[w]; word != 0; word &= word - 1) {
+      auto const i = static_cast<Size>(w) * detail::kWordBits +
+                     detail::countTrailingZeros(word);
+      f(Index3(i % size[0], (i % slice) / size[0], i / slice));
+    }
+  }
+}
+
+} // namespace ImageStack
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Types.h"
+
+#include <algorithm>
+
+namespace ImageStack {
+namespace Filter {
+
+/// @brief Continuation of an image beyond its border used by
+/// Filter::filter()
+enum class Boundary {
+  /// @brief Voxels outside of the image are zero
+  Zero,
+  /// @brief Voxels outside of the image have the value of the nearest border
+  /// voxel
+  Clamp,
+  /// @brief The image is reflected at its border, the border voxel is
+  /// repeated, e.g. `b a | a b c`
+  Mirror,
+  /// @brief The image is repeated periodically
+  Periodic
+};
+
+namespace detail {
+
+/// @brief Returns the index of the voxel providing the value at index @c i
+/// of an axis of length @c n, or -1 if the value is zero
+/// @pre `n > 0`
+inline long boundaryIndex(long i, long n, Boundary boundary) noexcept {
+  if (i >= 0 && i < n) return i;
+
+  switch (boundary) {
+  case Boundary::Zero:
+    return -1;
+  case Boundary::Clamp:
+    return std::min(std::max(i, 0l), n - 1);
+  case Boundary::Mirror: {
+    auto const m = ((i % (2 * n)) + 2 * n) % (2 * n);
+    return m < n ? m : 2 * n - 1 - m;
+  }
+  case Boundary::Periodic:
+    return ((i % n) + n) % n;
+  }
+  return -1;
+}
+
+/// @brief Returns the voxel providing the value at @c x of an image of size
+/// @c size, or a negative index if the value is zero
+inline SIndex3 boundaryIndex(SIndex3 const &x, SIndex3 const &size,
+                             Boundary boundary) noexcept {
+  SIndex3 result;
+  for (int a = 0; a < 3; ++a) {
+    result[a] = boundaryIndex(x[a], size[a], boundary);
+    if (result[a] < 0) return SIndex3::Constant(-1);
+  }
+  return result;
+}
+
+} // namespace detail
+} // namespace Filter
+} // namespace ImageStack
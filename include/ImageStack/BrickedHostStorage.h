@@ -0,0 +1,489 @@
+#pragma once
+
+#include <ImageStack/HostStorage.h>
+#include <ImageStack/ImageStackLoader.h>
+#include <ImageStack/MappedMemory.h>
+#include <ImageStack/Types.h>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <type_traits>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Mapping of a 3D volume stored as cubic bricks
+///
+/// The volume is divided into bricks of @c 2^BrickShift voxels along each
+/// axis. The bricks are stored one after another in x-fastest order, the
+/// voxels inside of a brick are stored x-fastest as well. Voxels that are
+/// close to each other in any direction therefore share cache lines and
+/// pages.
+///
+/// Multi index access and iteration work in logical (x-fastest) order, like
+/// MappedHostMemory, so code written against MappedHostMemory that does not
+/// use @c data() works unchanged. A linear index passed to @c operator[]
+/// refers to the logical order as well.
+///
+/// Test cases are in \ref testBrickedHostStorage.cpp
+///
+/// @tparam T type of elements stored in the memory region
+/// @tparam BrickShift base 2 logarithm of the edge length of a brick
+template <class T, Size BrickShift> class MappedBrickedMemory {
+  template <class V> class Iterator;
+
+public:
+  using value_type = T;
+  using reference = T &;
+  using const_reference = T const &;
+  using iterator = Iterator<T>;
+  using const_iterator = Iterator<T const>;
+  using difference_type = std::ptrdiff_t;
+  using size_type = std::size_t;
+  using pointer = T *;
+  using const_pointer = T const *;
+
+  /// @brief Edge length of a brick
+  static constexpr Size brickSize() noexcept { return Size{1} << BrickShift; }
+
+  /// @brief Number of voxels of a brick
+  static constexpr Size brickVolume() noexcept {
+    return Size{1} << (3 * BrickShift);
+  }
+
+  /// @brief Creates a mapping of bricked memory
+  /// @param bricks pointer to the first brick
+  /// @param size logical size of the volume
+  inline MappedBrickedMemory(not_null<T *> bricks, Size3 const &size) noexcept
+      : bricks_(bricks.get()), size_(size),
+        gridX_((size[0] + brickSize() - 1) >> BrickShift),
+        gridXY_(gridX_ * ((size[1] + brickSize() - 1) >> BrickShift)) {}
+
+  /// @brief Const access the mapped memory using a multi index or a linear
+  /// index in logical order
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T const &operator[](Idx const &i) const {
+    return bricks_[offset(i)];
+  }
+
+  /// @brief Access the mapped memory using a multi index or a linear index in
+  /// logical order
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T &operator[](Idx const &i) {
+    return bricks_[offset(i)];
+  }
+
+  /// @brief Returns the number of voxels of the volume
+  inline size_type linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns the size of the volume
+  inline auto size() const noexcept {
+    return std::array<size_type, 3>{{size_[0], size_[1], size_[2]}};
+  }
+
+  /// @brief Returns the offset of the voxel at the given position from the
+  /// beginning of the brick data
+  inline Size offset(Size x, Size y, Size z) const noexcept {
+    Expects(x < size_[0] && y < size_[1] && z < size_[2]);
+    constexpr auto mask = brickSize() - 1;
+    auto const brick = (z >> BrickShift) * gridXY_ +
+                       (y >> BrickShift) * gridX_ + (x >> BrickShift);
+    return (brick << (3 * BrickShift)) +
+           ((((z & mask) << BrickShift) + (y & mask)) << BrickShift) +
+           (x & mask);
+  }
+
+  /// @brief Returns an iterator to the first voxel in logical order
+  inline const_iterator begin() const noexcept { return cbegin(); }
+  inline const_iterator cbegin() const noexcept {
+    return const_iterator(this, 0);
+  }
+  /// @brief Returns an iterator past the last voxel in logical order
+  inline const_iterator end() const noexcept { return cend(); }
+  inline const_iterator cend() const noexcept {
+    return const_iterator(this, linearSize());
+  }
+
+  inline iterator begin() noexcept { return iterator(this, 0); }
+  inline iterator end() noexcept { return iterator(this, linearSize()); }
+
+  /// @brief Returns a const pointer to the first brick
+  inline T const *bricks() const noexcept { return bricks_; }
+  /// @brief Returns a pointer to the first brick
+  inline T *bricks() noexcept { return bricks_; }
+
+private:
+  template <class Idx>
+  inline std::enable_if_t<isModelOfMultiIndex_v<Idx>, Size>
+  offset(Idx const &i) const noexcept {
+    static_assert(dims_v<Idx> == 3, "Multi index must be 3 dimensional");
+    return offset(static_cast<Size>(i[0]), static_cast<Size>(i[1]),
+                  static_cast<Size>(i[2]));
+  }
+
+  template <class Idx>
+  inline std::enable_if_t<!isModelOfMultiIndex_v<Idx>, Size>
+  offset(Idx const &i) const noexcept {
+    auto const idx = static_cast<Size>(i);
+    auto const slice = size_[0] * size_[1];
+    return offset(idx % size_[0], (idx % slice) / size_[0], idx / slice);
+  }
+
+  /// @brief Random access iterator visiting the voxels in logical order
+  ///
+  /// Incrementing follows the brick layout and only recomputes the brick
+  /// offset when crossing a brick boundary.
+  template <class V> class Iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::remove_const_t<V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = V *;
+    using reference = V &;
+
+    Iterator() = default;
+
+    inline reference operator*() const noexcept { return *ptr_; }
+    inline pointer operator->() const noexcept { return ptr_; }
+    inline reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
+
+    inline Iterator &operator++() noexcept {
+      ++i_;
+      if (++x_ == map_->size_[0]) {
+        x_ = 0;
+        if (++y_ == map_->size_[1]) {
+          y_ = 0;
+          ++z_;
+        }
+        update();
+      } else if ((x_ & (brickSize() - 1)) == 0) {
+        update();
+      } else {
+        ++ptr_;
+      }
+      return *this;
+    }
+
+    inline Iterator operator++(int) noexcept {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    inline Iterator &operator--() noexcept { return *this -= 1; }
+
+    inline Iterator operator--(int) noexcept {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    inline Iterator &operator+=(difference_type n) noexcept {
+      seek(static_cast<Size>(static_cast<difference_type>(i_) + n));
+      return *this;
+    }
+
+    inline Iterator &operator-=(difference_type n) noexcept {
+      return *this += -n;
+    }
+
+    inline Iterator operator+(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp += n;
+    }
+
+    inline friend Iterator operator+(difference_type n,
+                                     Iterator const &it) noexcept {
+      return it + n;
+    }
+
+    inline Iterator operator-(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp -= n;
+    }
+
+    inline difference_type operator-(Iterator const &other) const noexcept {
+      return static_cast<difference_type>(i_) -
+             static_cast<difference_type>(other.i_);
+    }
+
+    inline bool operator==(Iterator const &other) const noexcept {
+      return i_ == other.i_;
+    }
+    inline bool operator!=(Iterator const &other) const noexcept {
+      return i_ != other.i_;
+    }
+    inline bool operator<(Iterator const &other) const noexcept {
+      return i_ < other.i_;
+    }
+    inline bool operator>(Iterator const &other) const noexcept {
+      return i_ > other.i_;
+    }
+    inline bool operator<=(Iterator const &other) const noexcept {
+      return i_ <= other.i_;
+    }
+    inline bool operator>=(Iterator const &other) const noexcept {
+      return i_ >= other.i_;
+    }
+
+  private:
+    friend class MappedBrickedMemory;
+
+    inline Iterator(MappedBrickedMemory const *map, Size i) noexcept
+        : map_(map) {
+      seek(i);
+    }
+
+    inline void seek(Size i) noexcept {
+      i_ = i;
+      auto const slice = map_->size_[0] * map_->size_[1];
+      if (slice == 0) return;
+      x_ = i % map_->size_[0];
+      y_ = (i % slice) / map_->size_[0];
+      z_ = i / slice;
+      update();
+    }
+
+    /// @brief Recomputes the pointer from the position, the past-the-end
+    /// position has no valid pointer
+    inline void update() noexcept {
+      ptr_ = z_ < map_->size_[2] ? const_cast<pointer>(map_->bricks_) +
+                                       map_->offset(x_, y_, z_)
+                                 : nullptr;
+    }
+
+    MappedBrickedMemory const *map_{nullptr};
+    pointer ptr_{nullptr};
+    Size i_{0}, x_{0}, y_{0}, z_{0};
+  };
+
+  T *bricks_;
+  Size3 size_;
+  Size gridX_;
+  Size gridXY_;
+};
+
+/// @brief Class representing a 3D data storage in host memory, with the
+/// voxels grouped into cubic bricks
+///
+/// Filters and samplers accessing 3D neighborhoods touch far fewer cache
+/// lines and pages than with the x-fastest layout of HostStorage, where
+/// neighbors in z are a whole slice apart. The volume is padded to a multiple
+/// of the brick size, padding voxels are never visited by iterators.
+///
+/// Conversion from and to the linear layout copies whole rows of a brick at
+/// once and runs in parallel.
+///
+/// Use BrickedHostStorage or BrickedHostStorage16 as the @c Storage parameter
+/// of ImageStack.
+///
+/// Unit tests are in \ref testBrickedHostStorage.cpp
+/// @tparam T type of stored elements
+/// @tparam BrickShift base 2 logarithm of the edge length of a brick
+template <class T, Size BrickShift> class BasicBrickedHostStorage {
+public:
+  using ValueType = T;
+  using Pointer = T *;
+  using ConstPointer = T const *;
+  using Mapping = MappedBrickedMemory<T, BrickShift>;
+  using ConstMapping = MappedBrickedMemory<T const, BrickShift>;
+
+  /// @brief Edge length of a brick
+  static constexpr Size brickSize() noexcept { return Mapping::brickSize(); }
+
+  /// @brief Create storage, the memory is default initialized
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline explicit BasicBrickedHostStorage(Size size)
+      : size_(size[0], size[1], size[2]), bricks_(bricksSize(size_)) {}
+
+  /// @brief Create storage and initialize all voxels with the given value
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline BasicBrickedHostStorage(Size size, T const &init)
+      : size_(size[0], size[1], size[2]), bricks_(bricksSize(size_), init) {}
+
+  /// @brief Create storage and initialize it with the given content in linear
+  /// (x-fastest) order
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @tparam Container model of ContiguousContainer
+  template <
+      class Size, class Container,
+      typename = std::enable_if_t<
+          std::is_convertible<typename Container::const_pointer,
+                              ConstPointer>::value &&
+          isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline BasicBrickedHostStorage(Size size, Container const &init)
+      : BasicBrickedHostStorage(size) {
+    Expects(indexProduct(size_) == init.size());
+    fromLinear(init.data(), 0, size_[2]);
+  }
+
+  /// @brief Create storage from a volume in linear (x-fastest) layout, e.g.
+  /// the mapping of a HostStorage
+  inline explicit BasicBrickedHostStorage(
+      MappedHostMemory<T const, 3> const &linear)
+      : BasicBrickedHostStorage(linear.size()) {
+    fromLinear(linear.data(), 0, size_[2]);
+  }
+
+  inline explicit BasicBrickedHostStorage(MappedHostMemory<T, 3> const &linear)
+      : BasicBrickedHostStorage(linear.size()) {
+    fromLinear(linear.data(), 0, size_[2]);
+  }
+
+  /// @brief Loads the data using the given loader
+  ///
+  /// Loaders that can read ranges of slices (e.g. ImageStackLoaderBST) are
+  /// read one layer of bricks at a time, so only a slab of @c brickSize()
+  /// slices is buffered in linear layout. Other loaders read the whole
+  /// volume into a temporary linear buffer first.
+  template <class Loader, typename = std::enable_if_t<isLoader_v<Loader>>>
+  inline explicit BasicBrickedHostStorage(Loader &loader)
+      : BasicBrickedHostStorage(loader.size()) {
+    Expects(!empty());
+    load(loader, detail::HasReadSlices<Loader, T>{});
+  }
+
+  BasicBrickedHostStorage(BasicBrickedHostStorage const &) = default;
+  BasicBrickedHostStorage &operator=(BasicBrickedHostStorage const &) = default;
+
+  inline BasicBrickedHostStorage(BasicBrickedHostStorage &&other) noexcept
+      : size_(other.size_), bricks_(std::move(other.bricks_)) {
+    other.size_.setZero();
+  }
+
+  inline BasicBrickedHostStorage &
+  operator=(BasicBrickedHostStorage &&other) noexcept {
+    size_ = other.size_;
+    bricks_ = std::move(other.bricks_);
+    other.size_.setZero();
+    return *this;
+  }
+
+  /// @brief Returns the size of the storage
+  inline auto size() const noexcept { return size_; }
+
+  /// @brief Returns the number of voxels, excluding padding
+  inline Size linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns true if the storage is empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+  /// @brief Maps the storage to host memory
+  /// @pre The storage object must not be empty
+  inline auto map() noexcept {
+    Expects(!empty());
+    return Mapping(not_null<Pointer>(bricks_.map().data()), size_);
+  }
+
+  /// @brief Maps the storage to host memory and returns a const mapping
+  inline auto map() const noexcept {
+    Expects(!empty());
+    return ConstMapping(not_null<ConstPointer>(bricks_.map().data()), size_);
+  }
+
+  /// @brief Copies the volume to a buffer in linear (x-fastest) layout
+  /// @param linear mapping of the destination, must have the same size
+  void toLinear(MappedHostMemory<T, 3> linear) const {
+    Expects(linear.linearSize() == linearSize());
+
+    auto const src = map();
+    auto *dst = linear.data();
+    auto const sx = size_[0];
+    auto const rows = narrow<long>(size_[1] * size_[2]);
+
+#pragma omp parallel for schedule(static)
+    for (long r = 0; r < rows; ++r) {
+      auto const row = static_cast<Size>(r);
+      auto const y = row % size_[1], z = row / size_[1];
+      auto *out = dst + row * sx;
+      for (Size x = 0; x < sx; x += brickSize())
+        std::copy_n(src.bricks() + src.offset(x, y, z),
+                    std::min(brickSize(), sx - x), out + x);
+    }
+  }
+
+private:
+  /// @brief Returns the size of the brick buffer, one brick per row and one
+  /// layer of bricks per slice, so the buffer is initialized in z slabs
+  static Size3 bricksSize(Size3 const &size) {
+    if (indexProduct(size) == 0) return Size3::Zero();
+    auto const grid = [&size](int d) {
+      return (size[d] + brickSize() - 1) >> BrickShift;
+    };
+    return Size3(Mapping::brickVolume(), grid(0) * grid(1), grid(2));
+  }
+
+  /// @brief Copies @c count slices in linear layout, starting at slice
+  /// @c first, into the bricks
+  void fromLinear(T const *src, Size first, Size count) {
+    auto dst = map();
+    auto const sx = size_[0];
+    auto const rows = narrow<long>(size_[1] * count);
+
+#pragma omp parallel for schedule(static)
+    for (long r = 0; r < rows; ++r) {
+      auto const row = static_cast<Size>(r);
+      auto const y = row % size_[1], z = first + row / size_[1];
+      auto const *in = src + row * sx;
+      for (Size x = 0; x < sx; x += brickSize())
+        std::copy_n(in + x, std::min(brickSize(), sx - x),
+                    dst.bricks() + dst.offset(x, y, z));
+    }
+  }
+
+  /// @brief Reads one layer of bricks at a time
+  template <class Loader> void load(Loader &loader, std::true_type) {
+    auto const slab = std::min(brickSize(), size_[2]);
+    HostStorage<T> buffer(Size3(size_[0], size_[1], slab));
+    for (Size z = 0; z < size_[2]; z += slab) {
+      auto const count = std::min(slab, size_[2] - z);
+      loader.template readSlices<T>(z, count, buffer.map().data());
+      fromLinear(buffer.map().data(), z, count);
+    }
+  }
+
+  /// @brief Reads the whole volume into a linear buffer
+  template <class Loader> void load(Loader &loader, std::false_type) {
+    HostStorage<T> buffer(size_);
+    loader.template readData<T>(buffer.map().data());
+    fromLinear(buffer.map().data(), 0, size_[2]);
+  }
+
+  Size3 size_;
+  HostStorage<T> bricks_;
+};
+#pragma clang diagnostic pop
+
+/// @brief Bricked host storage with bricks of 8x8x8 voxels
+template <class T>
+class BrickedHostStorage : public BasicBrickedHostStorage<T, 3> {
+public:
+  using BasicBrickedHostStorage<T, 3>::BasicBrickedHostStorage;
+};
+
+/// @brief Bricked host storage with bricks of 16x16x16 voxels
+template <class T>
+class BrickedHostStorage16 : public BasicBrickedHostStorage<T, 4> {
+public:
+  using BasicBrickedHostStorage<T, 4>::BasicBrickedHostStorage;
+};
+
+template <>
+struct IsHostStorage<BrickedHostStorage> : public std::true_type {};
+
+template <>
+struct IsHostStorage<BrickedHostStorage16> : public std::true_type {};
+
+} // namespace ImageStack
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "BinaryStream.h"
+#include "CpuFeatures.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#ifdef IMAGESTACK_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace ImageStack {
+
+namespace detail {
+
+/// @brief Scalar fallback, reverses the bytes of each element
+template <std::size_t N>
+inline void swapBytesScalar(std::uint8_t *data, std::size_t n) noexcept {
+  for (std::size_t i = 0; i < n; ++i, data += N) std::reverse(data, data + N);
+}
+
+#ifdef IMAGESTACK_X86_DISPATCH
+
+/// @brief Shuffle mask reversing the bytes of each N byte element in a 16
+/// byte lane
+template <std::size_t N> inline std::array<char, 16> swapMask() noexcept {
+  std::array<char, 16> mask;
+  for (std::size_t i = 0; i < 16; ++i)
+    mask[i] = static_cast<char>((i / N) * N + (N - 1 - i % N));
+  return mask;
+}
+
+template <std::size_t N>
+__attribute__((target("ssse3"))) void swapBytesSSSE3(std::uint8_t *data,
+                                                     std::size_t n) noexcept {
+  auto const m = swapMask<N>();
+  __m128i const mask =
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(m.data()));
+
+  auto const bytes = n * N;
+  std::size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    auto *p = reinterpret_cast<__m128i *>(data + i);
+    _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+  }
+  swapBytesScalar<N>(data + i, (bytes - i) / N);
+}
+
+template <std::size_t N>
+__attribute__((target("avx2"))) void swapBytesAVX2(std::uint8_t *data,
+                                                   std::size_t n) noexcept {
+  auto const m = swapMask<N>();
+  __m128i const lane =
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(m.data()));
+  __m256i const mask = _mm256_broadcastsi128_si256(lane);
+
+  auto const bytes = n * N;
+  std::size_t i = 0;
+  // Unrolled twice to keep both shuffle ports busy
+  for (; i + 64 <= bytes; i += 64) {
+    auto *p0 = reinterpret_cast<__m256i *>(data + i);
+    auto *p1 = reinterpret_cast<__m256i *>(data + i + 32);
+    __m256i const a = _mm256_loadu_si256(p0);
+    __m256i const b = _mm256_loadu_si256(p1);
+    _mm256_storeu_si256(p0, _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256(p1, _mm256_shuffle_epi8(b, mask));
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    auto *p = reinterpret_cast<__m256i *>(data + i);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+  }
+  swapBytesScalar<N>(data + i, (bytes - i) / N);
+}
+
+#endif
+
+template <std::size_t N> struct SwapBytes {
+  using Kernel = void (*)(std::uint8_t *, std::size_t);
+
+  /// @brief Selects the best kernel for the host CPU
+  static Kernel select() noexcept {
+#ifdef IMAGESTACK_X86_DISPATCH
+    if (cpuFeatures().avx2) return &swapBytesAVX2<N>;
+    if (cpuFeatures().ssse3) return &swapBytesSSSE3<N>;
+#endif
+    return &swapBytesScalar<N>;
+  }
+
+  inline void operator()(std::uint8_t *data, std::size_t n) const noexcept {
+    static Kernel const kernel = select();
+    kernel(data, n);
+  }
+};
+
+template <> struct SwapBytes<1> {
+  inline void operator()(std::uint8_t *, std::size_t) const noexcept {}
+};
+
+} // namespace detail
+
+/// @brief Changes the endianness of @c n consecutive elements in place
+///
+/// Uses SSSE3 or AVX2 byte shuffles if supported by the host CPU, the
+/// implementation is selected at runtime.
+/// @tparam T element type, must be trivially copyable and of size 1, 2, 4 or
+/// 8 bytes
+/// @param data pointer to the first element
+/// @param n number of elements
+template <class T> inline void swapBytes(T *data, std::size_t n) noexcept {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+  static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 ||
+                    sizeof(T) == 8,
+                "Unsupported element size");
+  detail::SwapBytes<sizeof(T)>{}(reinterpret_cast<std::uint8_t *>(data), n);
+}
+
+/// @brief Converts @c n consecutive elements in place from the given byte
+/// order to the host byte order (or vice versa)
+template <class T>
+inline void convertByteOrder(T *data, std::size_t n,
+                             Endianness byteOrder) noexcept {
+  if (byteOrder != hostByteOrder()) swapBytes(data, n);
+}
+
+namespace detail {
+
+/// @brief Writes a single value in little endian byte order
+template <class V> inline void writeLE(std::ostream &out, V value) {
+  convertByteOrder(&value, 1, Endianness::LittleEndian);
+  out.write(reinterpret_cast<char const *>(&value), sizeof(V));
+}
+
+/// @brief Reads a single value stored in little endian byte order
+template <class V> inline V readLE(std::istream &in) {
+  V value;
+  in.read(reinterpret_cast<char *>(&value), sizeof(V));
+  convertByteOrder(&value, 1, Endianness::LittleEndian);
+  return value;
+}
+
+} // namespace detail
+
+} // namespace ImageStack
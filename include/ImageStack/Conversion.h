@@ -0,0 +1,273 @@
+#pragma once
+
+#include "HostStorage.h"
+#include "Parallel.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace ImageStack {
+
+template <class T, template <class> class Storage_, class... Decorators>
+class ImageStack;
+
+namespace detail {
+
+/// @brief True if each value of type @c S can be represented exactly by @c D
+template <class S, class D>
+struct IsLosslessConversion
+    : public std::integral_constant<
+          bool,
+          std::is_same<S, D>::value ||
+              (std::is_floating_point<D>::value &&
+               (std::is_floating_point<S>::value
+                    ? sizeof(D) >= sizeof(S)
+                    : std::numeric_limits<S>::digits <=
+                          std::numeric_limits<D>::digits)) ||
+              (std::is_integral<S>::value && std::is_integral<D>::value &&
+               std::numeric_limits<S>::digits <=
+                   std::numeric_limits<D>::digits &&
+               (std::is_signed<D>::value || !std::is_signed<S>::value))> {};
+
+/// @brief Type used for computing scaled values, double if float could lose
+/// precision of the source or the target type
+template <class S, class D>
+using ConversionCompute_t = std::conditional_t<
+    (std::numeric_limits<S>::digits > std::numeric_limits<float>::digits ||
+     std::numeric_limits<D>::digits > std::numeric_limits<float>::digits),
+    double, float>;
+
+/// @brief Converts @c value to @c D, clamping to the range of @c D and
+/// rounding to the nearest integer if @c D is integral
+template <class D, class C>
+inline std::enable_if_t<std::is_floating_point<D>::value, D>
+saturate(C value) noexcept {
+  return static_cast<D>(value);
+}
+
+template <class D, class C>
+inline std::enable_if_t<std::is_integral<D>::value, D>
+saturate(C value) noexcept {
+  // Comparisons are written such that NaN maps to zero
+  if (!(value > static_cast<C>(std::numeric_limits<D>::lowest())))
+    return value < 0 ? std::numeric_limits<D>::lowest() : D{0};
+  if (!(value < static_cast<C>(std::numeric_limits<D>::max())))
+    return std::numeric_limits<D>::max();
+  return static_cast<D>(value < 0 ? value - C(0.5) : value + C(0.5));
+}
+
+/// @brief Converts @c n values from @c S to @c D, applying
+/// `scale * value + offset`
+///
+/// The loops contain no function calls and no data dependent control flow
+/// besides clamping, so they are vectorized by the compiler.
+template <class S, class D>
+inline void convertValues(S const *src, D *dst, std::size_t n, double scale,
+                          double offset) noexcept {
+  using C = ConversionCompute_t<S, D>;
+
+  if (scale == 1.0 && offset == 0.0) {
+    if (IsLosslessConversion<S, D>::value) {
+      for (std::size_t i = 0; i < n; ++i) dst[i] = static_cast<D>(src[i]);
+    } else {
+      for (std::size_t i = 0; i < n; ++i)
+        dst[i] = saturate<D>(static_cast<C>(src[i]));
+    }
+    return;
+  }
+
+  auto const s = static_cast<C>(scale);
+  auto const o = static_cast<C>(offset);
+  for (std::size_t i = 0; i < n; ++i)
+    dst[i] = saturate<D>(static_cast<C>(src[i]) * s + o);
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Transforms contiguous mappings slice by slice in parallel
+template <class SrcMap, class DstMap, class F>
+inline void transformSlices(SrcMap const &src, DstMap &dst, F f,
+                            std::true_type) {
+  auto const slice = src.size()[0] * src.size()[1];
+  auto const slices = narrow<long>(src.size()[2]);
+  auto const *const srcData = src.data();
+  auto *const dstData = dst.data();
+
+#pragma omp parallel for schedule(static)
+  for (long z = 0; z < slices; ++z) {
+    auto const first = static_cast<Size>(z) * slice;
+    f(srcData + first, dstData + first, slice);
+  }
+}
+
+/// @brief Transforms mappings with random access iterators slice by slice
+/// in parallel, others sequentially
+///
+/// Destinations written through proxies (e.g. MappedBitMask) are always
+/// transformed sequentially: a slice need not start at a word boundary, so
+/// two threads would update the same word.
+template <class SrcMap, class DstMap, class F>
+inline void transformSlices(SrcMap const &src, DstMap &dst, F f,
+                            std::false_type) {
+  if (!(HasRandomAccess<SrcMap const>::value &&
+        HasRandomAccess<DstMap>::value && HasReferenceAccess<DstMap>::value)) {
+    f(src.begin(), dst.begin(), src.linearSize());
+    return;
+  }
+
+  auto const slice = src.size()[0] * src.size()[1];
+  auto const slices = narrow<long>(src.size()[2]);
+  auto const srcBegin = src.begin();
+  auto const dstBegin = dst.begin();
+
+#pragma omp parallel for schedule(static)
+  for (long z = 0; z < slices; ++z) {
+    auto const first = static_cast<Size>(z) * slice;
+    f(std::next(srcBegin, narrow_cast<std::ptrdiff_t>(first)),
+      std::next(dstBegin, narrow_cast<std::ptrdiff_t>(first)), slice);
+  }
+}
+#pragma clang diagnostic pop
+
+/// @brief Calls `f(srcFirst, dstFirst, count)` for ranges of the voxels of
+/// two mappings of the same size, in parallel if possible
+///
+/// If both mappings are contiguous, @c f is called with pointers, so its
+/// loops can be vectorized. Otherwise it is called with iterators.
+template <class SrcMap, class DstMap, class F>
+inline void transformMaps(SrcMap const &src, DstMap &dst, F f) {
+  static_assert(IsWritableMapping<DstMap>::value,
+                "The destination storage is read only");
+  Expects(src.size() == dst.size());
+  if (src.linearSize() == 0) return;
+
+  transformSlices(src, dst, f,
+                  std::integral_constant<
+                      bool, HasContiguousData<SrcMap const>::value &&
+                                HasContiguousData<DstMap>::value>{});
+}
+
+/// @brief Converts @c n contiguous values, see convertValues()
+template <class S, class D>
+inline void convertRange(S const *src, D *dst, std::size_t n, double scale,
+                         double offset) noexcept {
+  convertValues(src, dst, n, scale, offset);
+}
+
+/// @brief Converts @c n values accessed through iterators, see
+/// convertValues()
+template <class SrcIt, class DstIt>
+inline void convertRange(SrcIt src, DstIt dst, std::size_t n, double scale,
+                         double offset) {
+  using S = typename std::iterator_traits<SrcIt>::value_type;
+  using D = typename std::iterator_traits<DstIt>::value_type;
+  using C = ConversionCompute_t<S, D>;
+
+  if (scale == 1.0 && offset == 0.0 && IsLosslessConversion<S, D>::value) {
+    for (std::size_t i = 0; i < n; ++i, ++src, ++dst)
+      *dst = static_cast<D>(*src);
+    return;
+  }
+
+  auto const s = static_cast<C>(scale);
+  auto const o = static_cast<C>(offset);
+  for (std::size_t i = 0; i < n; ++i, ++src, ++dst)
+    *dst = saturate<D>(static_cast<C>(*src) * s + o);
+}
+
+/// @brief Converts the voxels of @c src to the type of @c dst in parallel,
+/// applying `scale * value + offset` and saturating
+template <class SrcMap, class DstMap>
+inline void convertMaps(SrcMap const &src, DstMap &dst, double scale,
+                        double offset) {
+  transformMaps(src, dst, [scale, offset](auto srcIt, auto dstIt, Size n) {
+    convertRange(srcIt, dstIt, n, scale, offset);
+  });
+}
+
+} // namespace detail
+
+/// @brief Converts an image stack to voxel type @c D, computing
+/// `scale * value + offset` for each voxel
+///
+/// Values outside of the range of @c D are clamped to its range, values
+/// converted to an integral type are rounded to the nearest integer. The
+/// voxels are converted slice by slice in parallel, contiguous storages
+/// (e.g. HostStorage) use vectorized loops. The decorators are copied.
+///
+/// Example: int16 CT values with a rescale slope and intercept to float
+/// @code
+/// auto const hu = convert<float>(ct, slope, intercept);
+/// @endcode
+///
+/// Unit tests are in \ref testConversion.cpp
+/// @tparam D voxel type of the result, must be arithmetic
+/// @tparam DS storage of the result, e.g. HostStorage or BrickedHostStorage
+/// @param scale factor applied to each voxel
+/// @param offset offset added to each scaled voxel
+template <class D, template <class> class DS = HostStorage, class S,
+          template <class> class SS, class... Decorators,
+          typename = std::enable_if_t<std::is_arithmetic<D>::value &&
+                                      std::is_arithmetic<S>::value &&
+                                      isHostStorage_v<SS>>>
+auto convert(ImageStack<S, SS, Decorators...> const &img, double scale = 1.0,
+             double offset = 0.0) {
+  ImageStack<D, DS, Decorators...> result(
+      DS<D>(img.size()), static_cast<Decorators const &>(img)...);
+  if (img.empty()) return result;
+
+  auto dstMap = result.map();
+  detail::convertMaps(img.map(), dstMap, scale, offset);
+  return result;
+}
+
+/// @brief Converts an image stack to voxel type @c D, mapping the value range
+/// `[srcMin, srcMax]` linearly to `[dstMin, dstMax]`
+///
+/// Values outside of `[srcMin, srcMax]` are clamped. By default the source
+/// range is mapped to the whole range of @c D.
+///
+/// Example: display a CT window of [-1000, 1000] HU as 8 bit image
+/// @code
+/// auto const display = convertRange<std::uint8_t>(hu, -1000, 1000);
+/// @endcode
+/// @pre `srcMin < srcMax` and `dstMin <= dstMax`
+template <class D, template <class> class DS = HostStorage, class S,
+          template <class> class SS, class... Decorators,
+          typename = std::enable_if_t<std::is_arithmetic<D>::value &&
+                                      std::is_arithmetic<S>::value &&
+                                      isHostStorage_v<SS>>>
+auto convertRange(ImageStack<S, SS, Decorators...> const &img, double srcMin,
+                  double srcMax,
+                  double dstMin = static_cast<double>(
+                      std::numeric_limits<D>::lowest()),
+                  double dstMax = static_cast<double>(
+                      std::numeric_limits<D>::max())) {
+  Expects(srcMin < srcMax && dstMin <= dstMax);
+  using C = detail::ConversionCompute_t<S, D>;
+
+  ImageStack<D, DS, Decorators...> result(
+      DS<D>(img.size()), static_cast<Decorators const &>(img)...);
+  if (img.empty()) return result;
+
+  auto const scale = static_cast<C>((dstMax - dstMin) / (srcMax - srcMin));
+  auto const offset = static_cast<C>(dstMin) - scale * static_cast<C>(srcMin);
+  auto const lo = static_cast<C>(dstMin);
+  auto const hi = static_cast<C>(dstMax);
+
+  auto dstMap = result.map();
+  detail::transformMaps(img.map(), dstMap, [=](auto src, auto dst, Size n) {
+    for (Size i = 0; i < n; ++i, ++src, ++dst) {
+      auto const v = static_cast<C>(*src) * scale + offset;
+      *dst = detail::saturate<D>(std::min(std::max(v, lo), hi));
+    }
+  });
+  return result;
+}
+
+} // namespace ImageStack
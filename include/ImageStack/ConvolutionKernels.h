@@ -0,0 +1,279 @@
+#pragma once
+
+#include "CpuFeatures.h"
+#include "Types.h"
+
+#ifdef IMAGESTACK_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace ImageStack {
+namespace Filter {
+namespace detail {
+
+/// @brief Scalar fallback, computes
+/// `acc[x] += sum_t weights[t] * in[x + t]` for `x < n` and `t < taps`
+template <class T>
+inline void correlateRowScalar(T const *in, T const *weights, Size taps,
+                               T *acc, Size n) noexcept {
+  for (Size t = 0; t < taps; ++t) {
+    auto const w = weights[t];
+    auto const *src = in + t;
+    for (Size x = 0; x < n; ++x) acc[x] += w * src[x];
+  }
+}
+
+#ifdef IMAGESTACK_X86_DISPATCH
+
+// The SIMD kernels keep a block of output voxels in registers while summing
+// over all taps, so each output is loaded and stored once. Blocks hold four
+// (SSE) or two (AVX2, AVX-512) vectors, which hides the latency of the
+// additions.
+
+__attribute__((target("sse4.1"))) inline void
+correlateRowSSE41(float const *in, float const *weights, Size taps,
+                  float *acc, Size n) noexcept {
+  Size x = 0;
+  for (; x + 16 <= n; x += 16) {
+    __m128 a0 = _mm_loadu_ps(acc + x);
+    __m128 a1 = _mm_loadu_ps(acc + x + 4);
+    __m128 a2 = _mm_loadu_ps(acc + x + 8);
+    __m128 a3 = _mm_loadu_ps(acc + x + 12);
+    for (Size t = 0; t < taps; ++t) {
+      __m128 const w = _mm_set1_ps(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm_add_ps(a0, _mm_mul_ps(w, _mm_loadu_ps(p)));
+      a1 = _mm_add_ps(a1, _mm_mul_ps(w, _mm_loadu_ps(p + 4)));
+      a2 = _mm_add_ps(a2, _mm_mul_ps(w, _mm_loadu_ps(p + 8)));
+      a3 = _mm_add_ps(a3, _mm_mul_ps(w, _mm_loadu_ps(p + 12)));
+    }
+    _mm_storeu_ps(acc + x, a0);
+    _mm_storeu_ps(acc + x + 4, a1);
+    _mm_storeu_ps(acc + x + 8, a2);
+    _mm_storeu_ps(acc + x + 12, a3);
+  }
+  for (; x + 4 <= n; x += 4) {
+    __m128 a = _mm_loadu_ps(acc + x);
+    for (Size t = 0; t < taps; ++t)
+      a = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(weights[t]),
+                                   _mm_loadu_ps(in + x + t)));
+    _mm_storeu_ps(acc + x, a);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+__attribute__((target("sse4.1"))) inline void
+correlateRowSSE41(double const *in, double const *weights, Size taps,
+                  double *acc, Size n) noexcept {
+  Size x = 0;
+  for (; x + 8 <= n; x += 8) {
+    __m128d a0 = _mm_loadu_pd(acc + x);
+    __m128d a1 = _mm_loadu_pd(acc + x + 2);
+    __m128d a2 = _mm_loadu_pd(acc + x + 4);
+    __m128d a3 = _mm_loadu_pd(acc + x + 6);
+    for (Size t = 0; t < taps; ++t) {
+      __m128d const w = _mm_set1_pd(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm_add_pd(a0, _mm_mul_pd(w, _mm_loadu_pd(p)));
+      a1 = _mm_add_pd(a1, _mm_mul_pd(w, _mm_loadu_pd(p + 2)));
+      a2 = _mm_add_pd(a2, _mm_mul_pd(w, _mm_loadu_pd(p + 4)));
+      a3 = _mm_add_pd(a3, _mm_mul_pd(w, _mm_loadu_pd(p + 6)));
+    }
+    _mm_storeu_pd(acc + x, a0);
+    _mm_storeu_pd(acc + x + 2, a1);
+    _mm_storeu_pd(acc + x + 4, a2);
+    _mm_storeu_pd(acc + x + 6, a3);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+__attribute__((target("avx2,fma"))) inline void
+correlateRowAVX2(float const *in, float const *weights, Size taps, float *acc,
+                 Size n) noexcept {
+  Size x = 0;
+  for (; x + 16 <= n; x += 16) {
+    __m256 a0 = _mm256_loadu_ps(acc + x);
+    __m256 a1 = _mm256_loadu_ps(acc + x + 8);
+    for (Size t = 0; t < taps; ++t) {
+      __m256 const w = _mm256_set1_ps(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm256_fmadd_ps(w, _mm256_loadu_ps(p), a0);
+      a1 = _mm256_fmadd_ps(w, _mm256_loadu_ps(p + 8), a1);
+    }
+    _mm256_storeu_ps(acc + x, a0);
+    _mm256_storeu_ps(acc + x + 8, a1);
+  }
+  for (; x + 8 <= n; x += 8) {
+    __m256 a = _mm256_loadu_ps(acc + x);
+    for (Size t = 0; t < taps; ++t)
+      a = _mm256_fmadd_ps(_mm256_set1_ps(weights[t]),
+                          _mm256_loadu_ps(in + x + t), a);
+    _mm256_storeu_ps(acc + x, a);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+__attribute__((target("avx2,fma"))) inline void
+correlateRowAVX2(double const *in, double const *weights, Size taps,
+                 double *acc, Size n) noexcept {
+  Size x = 0;
+  for (; x + 8 <= n; x += 8) {
+    __m256d a0 = _mm256_loadu_pd(acc + x);
+    __m256d a1 = _mm256_loadu_pd(acc + x + 4);
+    for (Size t = 0; t < taps; ++t) {
+      __m256d const w = _mm256_set1_pd(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm256_fmadd_pd(w, _mm256_loadu_pd(p), a0);
+      a1 = _mm256_fmadd_pd(w, _mm256_loadu_pd(p + 4), a1);
+    }
+    _mm256_storeu_pd(acc + x, a0);
+    _mm256_storeu_pd(acc + x + 4, a1);
+  }
+  for (; x + 4 <= n; x += 4) {
+    __m256d a = _mm256_loadu_pd(acc + x);
+    for (Size t = 0; t < taps; ++t)
+      a = _mm256_fmadd_pd(_mm256_set1_pd(weights[t]),
+                          _mm256_loadu_pd(in + x + t), a);
+    _mm256_storeu_pd(acc + x, a);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+__attribute__((target("avx512f"))) inline void
+correlateRowAVX512(float const *in, float const *weights, Size taps,
+                   float *acc, Size n) noexcept {
+  Size x = 0;
+  for (; x + 32 <= n; x += 32) {
+    __m512 a0 = _mm512_loadu_ps(acc + x);
+    __m512 a1 = _mm512_loadu_ps(acc + x + 16);
+    for (Size t = 0; t < taps; ++t) {
+      __m512 const w = _mm512_set1_ps(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p), a0);
+      a1 = _mm512_fmadd_ps(w, _mm512_loadu_ps(p + 16), a1);
+    }
+    _mm512_storeu_ps(acc + x, a0);
+    _mm512_storeu_ps(acc + x + 16, a1);
+  }
+  for (; x + 16 <= n; x += 16) {
+    __m512 a = _mm512_loadu_ps(acc + x);
+    for (Size t = 0; t < taps; ++t)
+      a = _mm512_fmadd_ps(_mm512_set1_ps(weights[t]),
+                          _mm512_loadu_ps(in + x + t), a);
+    _mm512_storeu_ps(acc + x, a);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+__attribute__((target("avx512f"))) inline void
+correlateRowAVX512(double const *in, double const *weights, Size taps,
+                   double *acc, Size n) noexcept {
+  Size x = 0;
+  for (; x + 16 <= n; x += 16) {
+    __m512d a0 = _mm512_loadu_pd(acc + x);
+    __m512d a1 = _mm512_loadu_pd(acc + x + 8);
+    for (Size t = 0; t < taps; ++t) {
+      __m512d const w = _mm512_set1_pd(weights[t]);
+      auto const *p = in + x + t;
+      a0 = _mm512_fmadd_pd(w, _mm512_loadu_pd(p), a0);
+      a1 = _mm512_fmadd_pd(w, _mm512_loadu_pd(p + 8), a1);
+    }
+    _mm512_storeu_pd(acc + x, a0);
+    _mm512_storeu_pd(acc + x + 8, a1);
+  }
+  for (; x + 8 <= n; x += 8) {
+    __m512d a = _mm512_loadu_pd(acc + x);
+    for (Size t = 0; t < taps; ++t)
+      a = _mm512_fmadd_pd(_mm512_set1_pd(weights[t]),
+                          _mm512_loadu_pd(in + x + t), a);
+    _mm512_storeu_pd(acc + x, a);
+  }
+  correlateRowScalar(in + x, weights, taps, acc + x, n - x);
+}
+
+#endif
+
+/// @brief Instruction set used by the convolution kernels
+enum class KernelIsa { Scalar, SSE41, AVX2, AVX512 };
+
+/// @brief Returns true if the host CPU supports the instruction set
+inline bool isSupported(KernelIsa isa) noexcept {
+#ifdef IMAGESTACK_X86_DISPATCH
+  auto const &cpu = cpuFeatures();
+  switch (isa) {
+  case KernelIsa::Scalar:
+    return true;
+  case KernelIsa::SSE41:
+    return cpu.sse41;
+  case KernelIsa::AVX2:
+    return cpu.avx2 && cpu.fma;
+  case KernelIsa::AVX512:
+    return cpu.avx512f;
+  }
+  return false;
+#else
+  return isa == KernelIsa::Scalar;
+#endif
+}
+
+/// @brief Returns the best instruction set of the host CPU supported by the
+/// convolution kernels
+inline KernelIsa bestKernelIsa() noexcept {
+  for (auto const isa : {KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE41})
+    if (isSupported(isa)) return isa;
+  return KernelIsa::Scalar;
+}
+
+template <class T> struct CorrelateRow {
+  using Kernel = void (*)(T const *, T const *, Size, T *, Size);
+
+  /// @brief Returns the kernel for the given instruction set, the scalar
+  /// kernel for types without SIMD kernels
+  static Kernel select(KernelIsa) noexcept { return &correlateRowScalar<T>; }
+};
+
+/// @brief Selects the SIMD kernels, used for float and double
+template <class T> struct CorrelateRowSimd {
+  using Kernel = void (*)(T const *, T const *, Size, T *, Size);
+
+  static Kernel select(KernelIsa isa) noexcept {
+#ifdef IMAGESTACK_X86_DISPATCH
+    switch (isa) {
+    case KernelIsa::AVX512:
+      return static_cast<Kernel>(&correlateRowAVX512);
+    case KernelIsa::AVX2:
+      return static_cast<Kernel>(&correlateRowAVX2);
+    case KernelIsa::SSE41:
+      return static_cast<Kernel>(&correlateRowSSE41);
+    case KernelIsa::Scalar:
+      break;
+    }
+#else
+    (void)isa;
+#endif
+    return &correlateRowScalar<T>;
+  }
+};
+
+template <> struct CorrelateRow<float> : public CorrelateRowSimd<float> {};
+
+template <> struct CorrelateRow<double> : public CorrelateRowSimd<double> {};
+
+/// @brief Computes `acc[x] += sum_t weights[t] * in[x + t]` for `x < n` and
+/// `t < taps`
+///
+/// For float and double, the kernel uses SSE4.1, AVX2 with FMA or AVX-512
+/// if supported by the host CPU, the implementation is selected at runtime.
+/// The SIMD kernels compute 16 (float) or 8 (double) results per instruction
+/// with AVX-512.
+/// @param in `n + taps - 1` input values
+template <class T>
+inline void correlateRow(T const *in, T const *weights, Size taps, T *acc,
+                         Size n) noexcept {
+  static auto const kernel = CorrelateRow<T>::select(bestKernelIsa());
+  kernel(in, weights, taps, acc, n);
+}
+
+} // namespace detail
+} // namespace Filter
+} // namespace ImageStack
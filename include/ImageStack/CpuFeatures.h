@@ -0,0 +1,44 @@
+#pragma once
+
+// clang-format off
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#  define IMAGESTACK_X86_DISPATCH
+#endif
+// clang-format on
+
+namespace ImageStack {
+
+/// @brief Instruction set extensions available on the host CPU
+///
+/// Used to select the best implementation of vectorized kernels at runtime,
+/// so a single binary makes use of the features of every machine it runs on.
+struct CpuFeatures {
+  bool ssse3{false};
+  bool sse41{false};
+  bool avx2{false};
+  bool fma{false};
+  bool avx512f{false};
+  bool avx512bw{false};
+};
+
+/// @brief Returns the instruction set extensions of the host CPU
+/// @note The features are detected once and cached.
+inline CpuFeatures const &cpuFeatures() noexcept {
+  static CpuFeatures const features = [] {
+    CpuFeatures f;
+#ifdef IMAGESTACK_X86_DISPATCH
+    __builtin_cpu_init();
+    f.ssse3 = __builtin_cpu_supports("ssse3");
+    f.sse41 = __builtin_cpu_supports("sse4.1");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.fma = __builtin_cpu_supports("fma");
+    f.avx512f = __builtin_cpu_supports("avx512f");
+    f.avx512bw = __builtin_cpu_supports("avx512bw");
+#endif
+    return f;
+  }();
+  return features;
+}
+
+} // namespace ImageStack
@@ -0,0 +1,365 @@
+#pragma once
+
+#include "Types.h"
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#ifdef IMAGESTACK_USE_MKL
+#include <mkl_dfti.h>
+
+#include <stdexcept>
+#include <string>
+#endif
+
+namespace ImageStack {
+
+using Complex = std::complex<double>;
+
+namespace detail {
+
+/// @brief Returns the smallest power of two not less than @c n
+inline Size nextPowerOfTwo(Size n) noexcept {
+  Size p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+/// @brief Complex product without the NaN and infinity handling of
+/// std::complex, which prevents vectorization
+inline Complex mul(Complex const &a, Complex const &b) noexcept {
+  return {a.real() * b.real() - a.imag() * b.imag(),
+          a.real() * b.imag() + a.imag() * b.real()};
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Iterative radix-2 complex FFT of a fixed length
+///
+/// Both directions are unnormalized, i.e. the inverse of the forward
+/// transform of @c x is `n * x`.
+class FFTPlan {
+public:
+  /// @pre @c n is a power of two
+  inline explicit FFTPlan(Size n = 1) : n_(n), twiddles_(n / 2), reversed_(n) {
+    Expects(n > 0 && (n & (n - 1)) == 0);
+    auto const pi = std::acos(-1.0);
+    for (Size k = 0; k < n / 2; ++k) {
+      auto const phi =
+          -2 * pi * static_cast<double>(k) / static_cast<double>(n);
+      twiddles_[k] = Complex(std::cos(phi), std::sin(phi));
+    }
+    Size bits = 0;
+    while ((Size{1} << bits) < n) ++bits;
+    for (Size i = 0; i < n; ++i) {
+      Size r = 0;
+      for (Size b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+      reversed_[i] = r;
+    }
+  }
+
+  /// @brief Returns the length of the transform
+  inline Size size() const noexcept { return n_; }
+
+  /// @brief Transforms @c x in place, computing
+  /// `X[k] = sum_j x[j] exp(-2 pi i j k / n)`
+  inline void forward(Complex *x) const noexcept { transform(x, false); }
+
+  /// @brief Transforms @c x in place, computing
+  /// `x[j] = sum_k X[k] exp(2 pi i j k / n)`
+  inline void inverse(Complex *x) const noexcept { transform(x, true); }
+
+private:
+  inline void transform(Complex *x, bool inverse) const noexcept {
+    for (Size i = 0; i < n_; ++i) {
+      auto const j = reversed_[i];
+      if (i < j) std::swap(x[i], x[j]);
+    }
+    for (Size len = 2; len <= n_; len <<= 1) {
+      auto const half = len / 2;
+      auto const step = n_ / len;
+      for (Size i = 0; i < n_; i += len) {
+        for (Size k = 0; k < half; ++k) {
+          auto w = twiddles_[k * step];
+          if (inverse) w = std::conj(w);
+          auto const u = x[i + k];
+          auto const v = mul(x[i + k + half], w);
+          x[i + k] = u + v;
+          x[i + k + half] = u - v;
+        }
+      }
+    }
+  }
+
+  Size n_;
+  std::vector<Complex> twiddles_;
+  std::vector<Size> reversed_;
+};
+
+/// @brief FFT of real sequences of a fixed even length, computed by a complex
+/// FFT of half the length
+///
+/// The spectrum is stored as its first `n / 2 + 1` coefficients, the others
+/// are their complex conjugates. Both directions are unnormalized.
+class RealFFTPlan {
+public:
+  /// @pre @c n is a power of two
+  inline explicit RealFFTPlan(Size n = 1)
+      : n_(n), half_(n > 1 ? n / 2 : 1), twiddles_(n / 2 + 1) {
+    auto const pi = std::acos(-1.0);
+    for (Size k = 0; k <= n / 2; ++k) {
+      auto const phi =
+          -2 * pi * static_cast<double>(k) / static_cast<double>(n);
+      twiddles_[k] = Complex(std::cos(phi), std::sin(phi));
+    }
+  }
+
+  /// @brief Returns the length of the real sequences
+  inline Size size() const noexcept { return n_; }
+
+  /// @brief Transforms the real sequence @c x into the `n / 2 + 1`
+  /// coefficients @c X
+  /// @param buffer scratch space of `n / 2` elements
+  inline void forward(double const *x, Complex *X,
+                      Complex *buffer) const noexcept {
+    if (n_ == 1) {
+      X[0] = x[0];
+      return;
+    }
+    auto const m = n_ / 2;
+    for (Size k = 0; k < m; ++k) buffer[k] = Complex(x[2 * k], x[2 * k + 1]);
+    half_.forward(buffer);
+    // Split the transform of the packed sequence into the transforms of the
+    // even and the odd samples
+    for (Size k = 0; k <= m; ++k) {
+      auto const z = buffer[k % m];
+      auto const zc = std::conj(buffer[(m - k) % m]);
+      auto const even = 0.5 * (z + zc);
+      auto const odd = Complex(0, -0.5) * (z - zc);
+      X[k] = even + mul(twiddles_[k], odd);
+    }
+  }
+
+  /// @brief Transforms the `n / 2 + 1` coefficients @c X into the real
+  /// sequence @c x, scaled by @c n
+  /// @param buffer scratch space of `n / 2` elements
+  inline void inverse(Complex const *X, double *x,
+                      Complex *buffer) const noexcept {
+    if (n_ == 1) {
+      x[0] = X[0].real();
+      return;
+    }
+    auto const m = n_ / 2;
+    for (Size k = 0; k < m; ++k) {
+      auto const a = X[k];
+      auto const b = std::conj(X[m - k]);
+      auto const even = a + b;
+      auto const odd = mul(a - b, std::conj(twiddles_[k]));
+      buffer[k] = even + Complex(0, 1) * odd;
+    }
+    half_.inverse(buffer);
+    for (Size k = 0; k < m; ++k) {
+      x[2 * k] = buffer[k].real();
+      x[2 * k + 1] = buffer[k].imag();
+    }
+  }
+
+private:
+  Size n_;
+  FFTPlan half_;
+  std::vector<Complex> twiddles_;
+};
+#pragma clang diagnostic pop
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Real to complex 3D FFT of a fixed size
+///
+/// The real volume is stored x fastest. Its spectrum holds the coefficients
+/// `0, ..., nx / 2` along x and all coefficients along y and z, again x
+/// fastest; the remaining coefficients are the complex conjugates of these.
+/// Both directions are unnormalized, i.e. the inverse of the forward
+/// transform of a volume is the volume multiplied by its number of voxels.
+///
+/// If @c IMAGESTACK_USE_MKL is defined (CMake option @c WITH_MKL_FFT, off by
+/// default), the transforms use the FFT of MKL. Otherwise a bundled radix-2
+/// FFT is used, lines are transformed in parallel.
+///
+/// Unit tests are in \ref testFFT.cpp
+class RealFFT3 {
+public:
+  /// @brief Creates the transform for volumes of the given size
+  /// @pre all sizes are powers of two
+  inline explicit RealFFT3(Size3 const &size) : size_(size) {
+    for (int a = 0; a < 3; ++a)
+      Expects(size[a] > 0 && (size[a] & (size[a] - 1)) == 0);
+#ifdef IMAGESTACK_USE_MKL
+    MKL_LONG lengths[3] = {static_cast<MKL_LONG>(size[2]),
+                           static_cast<MKL_LONG>(size[1]),
+                           static_cast<MKL_LONG>(size[0])};
+    auto const nx = static_cast<MKL_LONG>(spectrumSize()[0]);
+    MKL_LONG realStrides[4] = {0, lengths[1] * lengths[2], lengths[2], 1};
+    MKL_LONG complexStrides[4] = {0, lengths[1] * nx, nx, 1};
+
+    auto const create = [&](DFTI_DESCRIPTOR_HANDLE &handle, MKL_LONG *in,
+                            MKL_LONG *out) {
+      auto status =
+          DftiCreateDescriptor(&handle, DFTI_DOUBLE, DFTI_REAL, 3, lengths);
+      if (status != DFTI_NO_ERROR) {
+        handle = nullptr;
+        checkDfti(status);
+      }
+      status = DftiSetValue(handle, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
+      if (status == DFTI_NO_ERROR)
+        status = DftiSetValue(handle, DFTI_CONJUGATE_EVEN_STORAGE,
+                              DFTI_COMPLEX_COMPLEX);
+      if (status == DFTI_NO_ERROR)
+        status = DftiSetValue(handle, DFTI_INPUT_STRIDES, in);
+      if (status == DFTI_NO_ERROR)
+        status = DftiSetValue(handle, DFTI_OUTPUT_STRIDES, out);
+      if (status == DFTI_NO_ERROR) status = DftiCommitDescriptor(handle);
+      if (status != DFTI_NO_ERROR) {
+        DftiFreeDescriptor(&handle);
+        checkDfti(status);
+      }
+    };
+    create(forward_, realStrides, complexStrides);
+    try {
+      create(backward_, complexStrides, realStrides);
+    } catch (...) {
+      DftiFreeDescriptor(&forward_);
+      throw;
+    }
+#else
+    for (int a = 0; a < 3; ++a) {
+      auto const i = static_cast<Size>(a);
+      if (a == 0)
+        real_ = detail::RealFFTPlan(size[0]);
+      else
+        plans_[i] = detail::FFTPlan(size[a]);
+    }
+#endif
+  }
+
+#ifdef IMAGESTACK_USE_MKL
+  RealFFT3(RealFFT3 const &) = delete;
+  RealFFT3 &operator=(RealFFT3 const &) = delete;
+
+  inline ~RealFFT3() {
+    DftiFreeDescriptor(&forward_);
+    DftiFreeDescriptor(&backward_);
+  }
+#endif
+
+  /// @brief Returns the size of the real volumes
+  inline Size3 const &size() const noexcept { return size_; }
+
+  /// @brief Returns the size of the spectrum
+  inline Size3 spectrumSize() const noexcept {
+    return Size3(size_[0] / 2 + 1, size_[1], size_[2]);
+  }
+
+  /// @brief Transforms the real volume @c in into the spectrum @c out
+  inline void forward(double const *in, Complex *out) const {
+#ifdef IMAGESTACK_USE_MKL
+    checkDfti(DftiComputeForward(forward_, const_cast<double *>(in), out));
+#else
+    auto const s = spectrumSize();
+    auto const rows = narrow<long>(size_[1] * size_[2]);
+
+#pragma omp parallel
+    {
+      std::vector<Complex> buffer(size_[0] / 2 + 1);
+#pragma omp for schedule(static)
+      for (long r = 0; r < rows; ++r) {
+        auto const row = static_cast<Size>(r);
+        real_.forward(in + row * size_[0], out + row * s[0], buffer.data());
+      }
+    }
+
+    transformColumns(out, false);
+#endif
+  }
+
+  /// @brief Transforms the spectrum @c in into the real volume @c out
+  /// @note The spectrum is overwritten.
+  inline void inverse(Complex *in, double *out) const {
+#ifdef IMAGESTACK_USE_MKL
+    checkDfti(DftiComputeBackward(backward_, in, out));
+#else
+    transformColumns(in, true);
+
+    auto const s = spectrumSize();
+    auto const rows = narrow<long>(size_[1] * size_[2]);
+
+#pragma omp parallel
+    {
+      std::vector<Complex> buffer(size_[0] / 2 + 1);
+#pragma omp for schedule(static)
+      for (long r = 0; r < rows; ++r) {
+        auto const row = static_cast<Size>(r);
+        real_.inverse(in + row * s[0], out + row * size_[0], buffer.data());
+      }
+    }
+#endif
+  }
+
+private:
+#ifndef IMAGESTACK_USE_MKL
+  /// @brief Transforms the spectrum in place along y and z
+  inline void transformColumns(Complex *data, bool inverse) const {
+    auto const s = spectrumSize();
+    std::array<Size, 3> const strides{{1, s[0], s[0] * s[1]}};
+
+    for (Size a = 1; a < 3; ++a) {
+      auto const n = s[narrow_cast<long>(a)];
+      if (n == 1) continue;
+      auto const &plan = plans_[a];
+      auto const other = 3 - a;
+      auto const lines = narrow<long>(s[0] * s[narrow_cast<long>(other)]);
+
+#pragma omp parallel
+      {
+        std::vector<Complex> line(n);
+#pragma omp for schedule(static)
+        for (long l = 0; l < lines; ++l) {
+          auto const x = static_cast<Size>(l) % s[0];
+          auto const o = static_cast<Size>(l) / s[0];
+          auto *first = data + x + o * strides[other];
+          for (Size i = 0; i < n; ++i) line[i] = first[i * strides[a]];
+          if (inverse)
+            plan.inverse(line.data());
+          else
+            plan.forward(line.data());
+          for (Size i = 0; i < n; ++i) first[i * strides[a]] = line[i];
+        }
+      }
+    }
+  }
+#endif
+
+  Size3 size_;
+#ifdef IMAGESTACK_USE_MKL
+  /// @brief Throws if @c status is an error of MKL
+  /// @throw std::runtime_error with the message of MKL
+  static void checkDfti(MKL_LONG status) {
+    if (status != DFTI_NO_ERROR)
+      throw std::runtime_error(std::string("MKL FFT: ") +
+                               DftiErrorMessage(status));
+  }
+
+  DFTI_DESCRIPTOR_HANDLE forward_{nullptr};
+  DFTI_DESCRIPTOR_HANDLE backward_{nullptr};
+#else
+  detail::RealFFTPlan real_;
+  std::array<detail::FFTPlan, 3> plans_;
+#endif
+};
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Boundary.h"
+#include "Conversion.h"
+#include "FFT.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ImageStack {
+namespace Filter {
+namespace detail {
+
+/// @brief Minimum number of filter taps for which Filter::filter() convolves
+/// non-separable filters using FFTs
+constexpr Size kFFTMinTaps = 9 * 9 * 9;
+
+/// @brief Transform size along each axis of the tiles of the overlap-save
+/// convolution, unless the kernel or the image needs less
+constexpr Size kFFTTileSize = 128;
+
+/// @brief True if convolving with a filter of the given size is faster using
+/// FFTs than by summing over all taps
+inline bool preferFFT(Size3 const &size) noexcept {
+  return indexProduct(size) >= kFFTMinTaps;
+}
+
+/// @brief Returns the transform size of the overlap-save tiles for a kernel
+/// of size @c taps and a result of size @c out
+///
+/// Along each axis, the whole result is computed by a single tile if it fits
+/// into kFFTTileSize, otherwise the tiles are at least twice as large as the
+/// kernel, so at least half of each transform contributes to the result.
+inline Size3 fftTileSize(Size3 const &taps, Size3 const &out) noexcept {
+  using ::ImageStack::detail::nextPowerOfTwo;
+  Size3 size;
+  for (int a = 0; a < 3; ++a) {
+    auto const whole = nextPowerOfTwo(out[a] + taps[a] - 1);
+    auto const tile =
+        std::max(kFFTTileSize, nextPowerOfTwo(2 * (taps[a] - 1) + 1));
+    size[a] = std::min(whole, tile);
+  }
+  return size;
+}
+
+/// @brief Cache of the spectra of a filter kernel for different transform
+/// sizes, together with the transforms
+///
+/// Entries are created on first use and kept until the cache is destroyed.
+/// Access is thread safe. Copies of a cache start empty.
+class KernelSpectra {
+public:
+  struct Entry {
+    explicit Entry(Size3 const &size) : fft(size) {}
+
+    RealFFT3 fft;
+    /// @brief Spectrum of the kernel, divided by the number of voxels of the
+    /// transform, which normalizes the inverse transform
+    std::vector<Complex> spectrum;
+  };
+
+  KernelSpectra() = default;
+  KernelSpectra(KernelSpectra const &) : KernelSpectra() {}
+  KernelSpectra &operator=(KernelSpectra const &) { return *this; }
+
+  /// @brief Returns the entry for transforms of size @c size, computing the
+  /// spectrum of @c filter if necessary
+  ///
+  /// Tap @c y of the filter is placed at `y + K` of the transformed volume,
+  /// where @c K is the half size of the filter.
+  template <class F>
+  Entry const &get(Size3 const &size, F const &filter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto const key = std::array<Size, 3>{{size[0], size[1], size[2]}};
+    auto &entry = entries_[key];
+    if (entry) return *entry;
+
+    entry = std::make_unique<Entry>(size);
+
+    Size3 const taps = filter.size();
+    SIndex3 const K = filter.halfSize().template cast<long>();
+    auto const scale = 1.0 / static_cast<double>(indexProduct(size));
+
+    std::vector<double> kernel(indexProduct(size), 0.0);
+    for (Size k = 0; k < taps[2]; ++k)
+      for (Size j = 0; j < taps[1]; ++j)
+        for (Size i = 0; i < taps[0]; ++i) {
+          SIndex3 const y = Size3(i, j, k).cast<long>() - K;
+          kernel[(k * size[1] + j) * size[0] + i] =
+              static_cast<double>(filter[y]) * scale;
+        }
+
+    entry->spectrum.resize(indexProduct(entry->fft.spectrumSize()));
+    entry->fft.forward(kernel.data(), entry->spectrum.data());
+
+    return *entry;
+  }
+
+private:
+  std::map<std::array<Size, 3>, std::unique_ptr<Entry>> entries_;
+  std::mutex mutex_;
+};
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Convolves @c src with @c filter using FFTs, writing the result to
+/// @c dst
+///
+/// The result is computed in tiles using the overlap-save method: each tile
+/// transforms a block of the source, multiplies it with the spectrum of the
+/// kernel and keeps the part of the inverse transform that is not affected
+/// by the cyclic wrap around. The FFTs of each tile are computed in
+/// parallel.
+/// @param pad if true, voxels outside of @c src are given by @c boundary and
+/// the result has the size of @c src, otherwise @c dst is `2 * K` voxels
+/// smaller than @c src along each axis
+template <class SrcMap, class DstMap, class F>
+inline void convolveFFT(SrcMap const &src, DstMap &dst, F const &filter,
+                        KernelSpectra &spectra, bool pad, Boundary boundary) {
+  using T = std::decay_t<decltype(*dst.begin())>;
+
+  auto const srcSize = src.size();
+  SIndex3 const sizeS(narrow_cast<long>(srcSize[0]),
+                      narrow_cast<long>(srcSize[1]),
+                      narrow_cast<long>(srcSize[2]));
+  auto const dstSize = dst.size();
+  Size3 const out(dstSize[0], dstSize[1], dstSize[2]);
+  Size3 const taps = filter.size();
+  SIndex3 const K = filter.halfSize().template cast<long>();
+  SIndex3 const shift = pad ? SIndex3::Zero() : K;
+
+  auto const N = fftTileSize(taps, out);
+  Size3 const valid = N - taps + Size3::Ones();
+  auto const &entry = spectra.get(N, filter);
+  auto const &fft = entry.fft;
+  auto const spectrumSize = indexProduct(fft.spectrumSize());
+
+  std::vector<double> block(indexProduct(N));
+  std::vector<Complex> spectrum(spectrumSize);
+
+  for (Size tz = 0; tz < out[2]; tz += valid[2]) {
+    for (Size ty = 0; ty < out[1]; ty += valid[1]) {
+      for (Size tx = 0; tx < out[0]; tx += valid[0]) {
+        Size3 const tile(tx, ty, tz);
+        // Voxel j of the block is source voxel first + j, result voxel
+        // tile + t is voxel t + 2K of the inverse transform
+        SIndex3 const first = tile.cast<long>() + shift - K;
+
+#pragma omp parallel for schedule(static)
+        for (long k = 0; k < narrow_cast<long>(N[2]); ++k)
+          for (Size j = 0; j < N[1]; ++j)
+            for (Size i = 0; i < N[0]; ++i) {
+              // Without padding, voxels outside of the source only affect
+              // discarded results
+              auto const x = boundaryIndex(
+                  first + SIndex3(narrow_cast<long>(i), narrow_cast<long>(j),
+                                  k),
+                  sizeS, pad ? boundary : Boundary::Zero);
+              block[(static_cast<Size>(k) * N[1] + j) * N[0] + i] =
+                  x[0] >= 0 ? static_cast<double>(src[x]) : 0.0;
+            }
+
+        fft.forward(block.data(), spectrum.data());
+#pragma omp parallel for schedule(static)
+        for (long i = 0; i < narrow_cast<long>(spectrumSize); ++i) {
+          auto const n = static_cast<Size>(i);
+          spectrum[n] =
+              ::ImageStack::detail::mul(spectrum[n], entry.spectrum[n]);
+        }
+        fft.inverse(spectrum.data(), block.data());
+
+        Size3 const count = (out - tile).cwiseMin(valid);
+        Size3 const offset = 2 * K.cast<Size>();
+#pragma omp parallel for schedule(static)
+        for (long z = 0; z < narrow_cast<long>(count[2]); ++z)
+          for (Size j = 0; j < count[1]; ++j)
+            for (Size i = 0; i < count[0]; ++i) {
+              auto const k = static_cast<Size>(z);
+              auto const value =
+                  block[((k + offset[2]) * N[1] + j + offset[1]) * N[0] + i +
+                        offset[0]];
+              dst[tile + Size3(i, j, k)] =
+                  ::ImageStack::detail::saturate<T>(value);
+            }
+      }
+    }
+  }
+}
+#pragma clang diagnostic pop
+
+} // namespace detail
+} // namespace Filter
+} // namespace ImageStack
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Filter.h"
+
+namespace ImageStack {
+namespace Filter {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Filter that is always applied using FFTs and keeps the spectra of
+/// its kernel
+///
+/// The spectrum of the kernel is computed once per transform size, so
+/// convolving many images of the same size, e.g. with a point spread
+/// function, transforms the kernel only once. An FFTFilter can be used by
+/// multiple threads at the same time.
+///
+/// Example:
+/// @code
+/// Filter::FFTFilter<Psf> const psf(loadPsf());
+/// for (auto const &img : images) results.push_back(Filter::filter(img, psf));
+/// @endcode
+///
+/// Unit tests are in \ref testFFT.cpp
+/// @tparam F type of the wrapped filter
+template <class F> class FFTFilter : public FilterBase<FFTFilter<F>> {
+public:
+  /// @brief Wraps a copy of the given filter
+  inline explicit FFTFilter(F filter) : filter_(std::move(filter)) {}
+
+  inline Size3 size() const { return filter_.size(); }
+
+  template <class Idx, typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> &&
+                                                   (dims_v<Idx> >= 3)>>
+  inline auto const &operator[](Idx &&i) const {
+    return filter_[std::forward<Idx>(i)];
+  }
+
+  /// @brief Returns the wrapped filter
+  inline F const &filter() const noexcept { return filter_; }
+
+  /// @brief Returns the cached spectra of the kernel
+  inline detail::KernelSpectra &spectra() const noexcept { return spectra_; }
+
+private:
+  F filter_;
+  mutable detail::KernelSpectra spectra_;
+};
+#pragma clang diagnostic pop
+
+template <class F> struct Traits<FFTFilter<F>> {
+  using Scalar = typename Traits<F>::Scalar;
+};
+
+} // namespace Filter
+} // namespace ImageStack
@@ -1,6 +1,18 @@
 #pragma once
 
+#include "Boundary.h"
+#include "Conversion.h"
+#include "ConvolutionKernels.h"
+#include "FFTConvolution.h"
 #include "ImageStack.h"
+#include "MappedStridedMemory.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace ImageStack {
 
@@ -8,6 +20,13 @@ namespace Filter {
 
 template <class Derived> struct Traits {};
 
+/// @brief Base class of convolution filters
+///
+/// A filter provides its @c size() and its weights through @c operator[],
+/// indexed relative to its center. Separable filters additionally provide
+/// `kernel(axis)`, the 1D weights along each axis whose product gives the
+/// 3D weights. Filter::filter() convolves with separable filters using three
+/// 1D passes.
 template <class Derived> class FilterBase {
 public:
   using Scalar = typename Traits<Derived>::Scalar;
@@ -39,11 +58,321 @@ struct FilterException : public std::runtime_error {
 #pragma clang diagnostic pop
 
 #pragma clang diagnostic ignored "-Wunused-variable"
-template <class Derived, class T, class... Decorators>
-auto filter(ImageStack<T, HostStorage, Decorators...> const &img,
+namespace detail {
+
+/// @brief True if the filter provides its 1D kernels through
+/// `kernel(axis)`
+template <class Derived, typename = void>
+struct IsSeparable : public std::false_type {};
+
+template <class Derived>
+struct IsSeparable<Derived, decltype(std::declval<Derived const &>().kernel(0),
+                                     void())> : public std::true_type {};
+
+/// @brief True if the filter keeps the spectra of its kernel in a
+/// KernelSpectra object returned by `spectra()`, e.g. FFTFilter
+template <class Derived, typename = void>
+struct HasSpectra : public std::false_type {};
+
+template <class Derived>
+struct HasSpectra<Derived, decltype(std::declval<Derived const &>().spectra(),
+                                    void())> : public std::true_type {};
+
+template <class Derived>
+inline KernelSpectra *spectraOf(Derived const &filter, std::true_type) {
+  return &filter.spectra();
+}
+
+template <class Derived>
+inline KernelSpectra *spectraOf(Derived const &, std::false_type) {
+  return nullptr;
+}
+
+/// @brief Returns the range of result voxels along one axis whose
+/// neighborhood lies inside of the source
+inline std::pair<long, long> interiorRange(long size, long out, long K,
+                                           long shift) noexcept {
+  auto const first = std::min(std::max(K - shift, 0l), out);
+  auto const last = std::max(std::min(size - K - shift, out), first);
+  return {first, last};
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Convolves @c src with a non-separable filter
+///
+/// Large filters and filters keeping their spectra are applied using FFTs
+/// (see convolveFFT()), others by summing over all taps of each voxel.
+///
+/// The sum is split into the interior box, whose neighborhoods lie inside of
+/// the source, and the shell around it. Interior rows are computed from a
+/// copy of each source row by correlateRow() without any boundary logic,
+/// using the SIMD kernels of the host CPU. Only the shell maps its neighbors
+/// according to @c boundary. The sums are converted to the voxel type of
+/// @c dst by saturate().
+template <class SrcMap, class DstMap, class Derived>
+inline void convolveDirect(SrcMap const &mSrc, DstMap &mDest,
+                           FilterBase<Derived> const &filter,
+                           Size3 const &finalSize, bool pad,
+                           Boundary boundary) {
+  using T = std::decay_t<decltype(*mSrc.begin())>;
+  using D = std::decay_t<decltype(*mDest.begin())>;
+  using Scalar = typename FilterBase<Derived>::Scalar;
+  using Acc = std::decay_t<decltype(T{} * Scalar{})>;
+
+  auto *const spectra = spectraOf(static_cast<Derived const &>(filter),
+                                  HasSpectra<Derived>{});
+  if (spectra || preferFFT(filter.size())) {
+    KernelSpectra local;
+    convolveFFT(mSrc, mDest, filter, spectra ? *spectra : local, pad,
+                boundary);
+    return;
+  }
+
+  SIndex3 const K = filter.halfSize().template cast<long>();
+  SIndex3 const shift = pad ? SIndex3::Zero() : K;
+  SIndex3 const size(narrow_cast<long>(mSrc.size()[0]),
+                     narrow_cast<long>(mSrc.size()[1]),
+                     narrow_cast<long>(mSrc.size()[2]));
+  SIndex3 const out = finalSize.template cast<long>();
+
+  std::array<std::pair<long, long>, 3> interior;
+  for (int a = 0; a < 3; ++a)
+    interior[static_cast<Size>(a)] = interiorRange(size[a], out[a], K[a],
+                                                   shift[a]);
+  auto const inInterior = [&interior](long x, int a) {
+    auto const &r = interior[static_cast<Size>(a)];
+    return x >= r.first && x < r.second;
+  };
+
+  // Weights in the order of the taps, x fastest
+  std::vector<Acc> weights;
+  for (auto c = -K[2]; c <= K[2]; ++c)
+    for (auto b = -K[1]; b <= K[1]; ++b)
+      for (auto a = -K[0]; a <= K[0]; ++a)
+        weights.push_back(static_cast<Acc>(filter[SIndex3(a, b, c)]));
+
+  // Weights of each row of taps along x in reverse order, as used by
+  // correlateRow()
+  auto const tapsX = static_cast<Size>(2 * K[0] + 1);
+  std::vector<Acc> rowWeights;
+  for (auto c = -K[2]; c <= K[2]; ++c)
+    for (auto b = -K[1]; b <= K[1]; ++b)
+      for (auto a = K[0]; a >= -K[0]; --a)
+        rowWeights.push_back(static_cast<Acc>(filter[SIndex3(a, b, c)]));
+
+  auto const shell = [&](SIndex3 const &x) {
+    Acc sum{0};
+    auto w = weights.cbegin();
+    for (auto c = -K[2]; c <= K[2]; ++c)
+      for (auto b = -K[1]; b <= K[1]; ++b)
+        for (auto a = -K[0]; a <= K[0]; ++a, ++w) {
+          auto const p =
+              boundaryIndex(x + shift - SIndex3(a, b, c), size, boundary);
+          if (p[0] >= 0) sum += static_cast<Acc>(mSrc[p]) * *w;
+        }
+    mDest[x] = ::ImageStack::detail::saturate<D>(sum);
+  };
+
+  auto const x0 = interior[0].first;
+  auto const x1 = interior[0].second;
+
+#pragma omp parallel
+  {
+    std::vector<Acc> line(static_cast<Size>(size[0]));
+    std::vector<Acc> sum(static_cast<Size>(out[0]));
+
+#pragma omp for schedule(static)
+    for (long k = 0; k < out[2]; ++k) {
+      for (long j = 0; j < out[1]; ++j) {
+        if (!inInterior(j, 1) || !inInterior(k, 2)) {
+          for (long i = 0; i < out[0]; ++i) shell(SIndex3(i, j, k));
+          continue;
+        }
+
+        for (long i = 0; i < x0; ++i) shell(SIndex3(i, j, k));
+        for (long i = x1; i < out[0]; ++i) shell(SIndex3(i, j, k));
+
+        std::fill(sum.begin(), sum.end(), Acc{0});
+        auto const *w = rowWeights.data();
+        for (auto c = -K[2]; c <= K[2]; ++c) {
+          for (auto b = -K[1]; b <= K[1]; ++b, w += tapsX) {
+            SIndex3 pos(0, j + shift[1] - b, k + shift[2] - c);
+            for (long i = 0; i < size[0]; ++i) {
+              pos[0] = i;
+              line[static_cast<Size>(i)] = static_cast<Acc>(mSrc[pos]);
+            }
+            // sum[i] += w(a, b, c) * src[i + shift - a] for the interior
+            // voxels, with a = K - t
+            correlateRow(line.data() + (x0 + shift[0] - K[0]), w, tapsX,
+                         sum.data() + x0, static_cast<Size>(x1 - x0));
+          }
+        }
+
+        for (auto i = x0; i < x1; ++i)
+          mDest[SIndex3(i, j, k)] =
+              ::ImageStack::detail::saturate<D>(sum[static_cast<Size>(i)]);
+      }
+    }
+  }
+}
+
+/// @brief Convolves all lines of @c src along @c axis with the 1D kernel
+/// @c kernel and writes the result to @c dst
+///
+/// Each line is copied into a zero padded buffer, convolved and written
+/// back, so lines along any axis are processed with contiguous memory
+/// accesses. Lines are processed in parallel. The results are converted to
+/// the voxel type of @c dst by saturate().
+/// @param pad if false, the result along @c axis is `2 * K` voxels shorter
+/// than the source, where @c K is the half size of the kernel, otherwise the
+/// line is continued according to @c boundary
+template <class Acc, class SrcMap, class DstMap, class Kernel>
+inline void convolveLines(SrcMap const &src, DstMap &dst,
+                          Kernel const &kernel, int axis, bool pad,
+                          Boundary boundary) {
+  auto const srcSize = src.size();
+  auto const dstSize = dst.size();
+  auto const a = static_cast<Size>(axis);
+  auto const a1 = (a + 1) % 3;
+  auto const a2 = (a + 2) % 3;
+
+  auto const taps = static_cast<Size>(kernel.size());
+  auto const K = (taps - 1) / 2;
+  auto const nIn = srcSize[a];
+  auto const nOut = dstSize[a];
+  auto const offset = pad ? 0 : K;
+  auto const lines = narrow<long>(dstSize[a1] * dstSize[a2]);
+
+  // Reversed, as used by correlateRow()
+  std::vector<Acc> weights(taps);
+  for (Size t = 0; t < taps; ++t)
+    weights[t] = static_cast<Acc>(kernel[narrow_cast<long>(taps - 1 - t)]);
+
+#pragma omp parallel
+  {
+    // Element K + i of the buffer holds voxel i of the line
+    std::vector<Acc> line(nIn + 2 * K, Acc{0});
+    std::vector<Acc> result(nOut);
+
+#pragma omp for schedule(static)
+    for (long l = 0; l < lines; ++l) {
+      Index3 pos;
+      pos[narrow_cast<long>(a1)] = static_cast<Size>(l) % dstSize[a1];
+      pos[narrow_cast<long>(a2)] = static_cast<Size>(l) / dstSize[a1];
+
+      for (Size i = 0; i < nIn; ++i) {
+        pos[axis] = i;
+        line[K + i] = static_cast<Acc>(src[pos]);
+      }
+
+      // With zero padding the borders of the buffer are never written
+      if (pad && boundary != Boundary::Zero) {
+        auto const n = narrow_cast<long>(nIn);
+        for (Size t = 1; t <= K; ++t) {
+          auto const before = boundaryIndex(-narrow_cast<long>(t), n, boundary);
+          auto const after = boundaryIndex(n - 1 + narrow_cast<long>(t), n,
+                                           boundary);
+          line[K - t] = line[K + static_cast<Size>(before)];
+          line[K + nIn - 1 + t] = line[K + static_cast<Size>(after)];
+        }
+      }
+
+      // result[x] = sum_t line[x + offset + 2K - t] * kernel[t]
+      std::fill(result.begin(), result.end(), Acc{0});
+      correlateRow(line.data() + offset, weights.data(), taps, result.data(),
+                   nOut);
+
+      for (Size x = 0; x < nOut; ++x) {
+        pos[axis] = x;
+        dst[pos] = ::ImageStack::detail::saturate<
+            std::decay_t<decltype(*dst.begin())>>(result[x]);
+      }
+    }
+  }
+}
+#pragma clang diagnostic pop
+
+/// @brief Convolves @c src with a separable filter using one 1D pass per
+/// axis
+///
+/// This takes `O(Kx + Ky + Kz)` instead of `O(Kx * Ky * Kz)` operations per
+/// voxel. Intermediate results are stored with the precision of the product
+/// of the voxel and the filter type in a single temporary volume: the x pass
+/// writes it, the y pass convolves its lines in place and the z pass writes
+/// the result. The temporary uses @c Storage if it is an out of core storage
+/// (see IsOutOfCoreStorage), HostStorage otherwise.
+template <template <class> class Storage, class SrcMap, class DstMap,
+          class Derived>
+inline void convolve(SrcMap const &mSrc, DstMap &mDest,
+                     FilterBase<Derived> const &filter, Size3 const &,
+                     bool pad, Boundary boundary, std::true_type) {
+  using T = std::decay_t<decltype(*mSrc.begin())>;
+  using Scalar = typename FilterBase<Derived>::Scalar;
+  using Acc = std::decay_t<decltype(T{} * Scalar{})>;
+  using Tmp = std::conditional_t<isOutOfCoreStorage_v<Storage>, Storage<Acc>,
+                                 HostStorage<Acc>>;
+
+  auto const &f = static_cast<Derived const &>(filter);
+  Size3 const K = filter.halfSize();
+  Size3 size(mSrc.size()[0], mSrc.size()[1], mSrc.size()[2]);
+  if (!pad) size[0] -= 2 * K[0];
+
+  Tmp tmp(size);
+  auto mX = tmp.map();
+  convolveLines<Acc>(mSrc, mX, f.kernel(0), 0, pad, boundary);
+
+  // Each line is copied into a buffer before its result is written, so the
+  // y pass can write to the first voxels of the lines it reads
+  MappedStridedMemory<Acc> mY(mX);
+  if (!pad) size[1] -= 2 * K[1];
+  MappedStridedMemory<Acc> mXY(not_null<Acc *>(mX.data()), size,
+                               mY.strides());
+  convolveLines<Acc>(mY, mXY, f.kernel(1), 1, pad, boundary);
+
+  convolveLines<Acc>(mXY, mDest, f.kernel(2), 2, pad, boundary);
+}
+
+/// @brief Convolves @c src with a non-separable filter, see convolveDirect()
+template <template <class> class Storage, class SrcMap, class DstMap,
+          class Derived>
+inline void convolve(SrcMap const &mSrc, DstMap &mDest,
+                     FilterBase<Derived> const &filter, Size3 const &finalSize,
+                     bool pad, Boundary boundary, std::false_type) {
+  convolveDirect(mSrc, mDest, filter, finalSize, pad, boundary);
+}
+
+} // namespace detail
+
+/// @brief Convolves the image with the given filter, computing only voxels
+/// whose neighborhood lies inside of the image or continuing the image
+/// beyond its border with zeros
+///
+/// The image may use any storage mapped to host memory, e.g. a view (see
+/// ImageStackView.h). The result is stored in HostStorage, or in the storage
+/// of the image if it is an out of core storage (see IsOutOfCoreStorage).
+///
+/// Separable filters (e.g. GaussFilter) are applied with three 1D passes.
+/// Other filters with at least kFFTMinTaps taps are applied using FFTs in
+/// overlap-save tiles, smaller ones by summing over all taps of each voxel.
+/// Wrap a filter into an FFTFilter to always use FFTs and to reuse the
+/// spectra of its kernel across calls. All paths convert their sums to the
+/// voxel type by saturate(), i.e. integral results are rounded to the nearest
+/// value and clamped to the range of the type.
+/// @param pad if true, the image is padded with zeros and the result has the
+/// size of the image (same as Boundary::Zero), otherwise only voxels whose
+/// neighborhood lies inside of the image are computed
+/// @throw FilterException if @c pad is false and the image is smaller than
+/// the filter
+template <class Derived, class T, template <class> class Storage,
+          class... Decorators,
+          typename = std::enable_if_t<isHostStorage_v<Storage>>>
+auto filter(ImageStack<T, Storage, Decorators...> const &img,
             FilterBase<Derived> const &filter, bool pad = true) {
 
-  using Img = ImageStack<T, HostStorage, Decorators...>;
+  using Img = std::conditional_t<isOutOfCoreStorage_v<Storage>,
+                                 ImageStack<T, Storage, Decorators...>,
+                                 ImageStack<T, HostStorage, Decorators...>>;
 
   SIndex3 const K = filter.halfSize().template cast<long>();
 
@@ -69,37 +398,37 @@ auto filter(ImageStack<T, HostStorage, Decorators...> const &img,
   auto const mSrc = img.map();
   auto mDest = dest.map();
 
-  auto const inside = [&finalSize](auto const &x) {
-    return x.x() >= 0 && x.y() >= 0 && x.z() >= 0 &&
-           x.x() < narrow_cast<long>(finalSize.x()) &&
-           x.y() < narrow_cast<long>(finalSize.y()) &&
-           x.z() < narrow_cast<long>(finalSize.z());
-  };
+  detail::convolve<Storage>(mSrc, mDest, filter, finalSize, pad,
+                            Boundary::Zero, detail::IsSeparable<Derived>{});
 
-#pragma clang diagnostic ignored "-Wsource-uses-openmp"
-#pragma omp parallel for
-  for (long k = 0; k < narrow_cast<long>(finalSize[2]); ++k) {
-    for (auto j = 0; j < narrow_cast<long>(finalSize[1]); ++j) {
-      for (auto i = 0; i < narrow_cast<long>(finalSize[0]); ++i) {
+  return dest;
+}
 
-        SIndex3 const x{i, j, k};
+/// @brief Convolves the image with the given filter, continuing the image
+/// beyond its border according to @c boundary
+///
+/// Same as `filter(img, filter, true)`, but the voxels outside of the image
+/// are given by @c boundary instead of being zero. Boundary::Mirror and
+/// Boundary::Clamp avoid the intensity drop at the border of the result
+/// that zero padding causes for smoothing filters.
+template <class Derived, class T, template <class> class Storage,
+          class... Decorators,
+          typename = std::enable_if_t<isHostStorage_v<Storage>>>
+auto filter(ImageStack<T, Storage, Decorators...> const &img,
+            FilterBase<Derived> const &filter, Boundary boundary) {
 
-        for (auto c = -K[2]; c <= K[2]; ++c) {
-          for (auto b = -K[1]; b <= K[1]; ++b) {
-            for (auto a = -K[0]; a <= K[0]; ++a) {
+  using Img = std::conditional_t<isOutOfCoreStorage_v<Storage>,
+                                 ImageStack<T, Storage, Decorators...>,
+                                 ImageStack<T, HostStorage, Decorators...>>;
 
-              SIndex3 const y{a, b, c};
+  Img dest{img.size(), T{0}};
+  if (img.empty()) return dest;
 
-              auto const srcVal =
-                  pad ? (inside(x - y) ? mSrc[x - y] : T{0}) : mSrc[x + K - y];
+  auto const mSrc = img.map();
+  auto mDest = dest.map();
 
-              mDest[x] += srcVal * filter[y];
-            }
-          }
-        }
-      }
-    }
-  }
+  detail::convolve<Storage>(mSrc, mDest, filter, img.size(), true, boundary,
+                            detail::IsSeparable<Derived>{});
 
   return dest;
 }
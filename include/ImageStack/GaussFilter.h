@@ -2,6 +2,8 @@
 
 #include "Filter.h"
 
+#include <array>
+
 namespace ImageStack {
 namespace Filter {
 
@@ -15,10 +17,20 @@ class GaussFilter : public FilterBase<GaussFilter<T, W, H, D>> {
   friend Parent;
 
 public:
+  using Kernel = Eigen::Matrix<T, Dynamic, 1>;
+
   inline auto size() const noexcept { return size_; }
 
   inline auto sigma() const noexcept { return sigma_; }
 
+  /// @brief Returns the normalized 1D kernel along the given axis
+  ///
+  /// The 3D weights are the products of the 1D kernels, so the filter can be
+  /// applied as three 1D convolutions.
+  inline Kernel const &kernel(int axis) const noexcept {
+    return kernels_[static_cast<std::size_t>(axis)];
+  }
+
   template <class Derived>
   inline GaussFilter(Eigen::MatrixBase<Derived> const &sigma, SIndex w = W,
                      SIndex h = H, SIndex d = D)
@@ -30,33 +42,41 @@ public:
     auto const d_ = (d == Dynamic ? static_cast<Size>(ceil(T{3.0} * sigma[2]))
                                   : narrow_cast<Size>((d - 1) / 2));
 
-    Expects(w_ >= 0 && h_ >= 0 && d_ >= 0);
+    Expects((sigma.array() >= 0).all());
 
     size_ = 2 * Size3{w_, h_, d_} + Size3::Ones();
 
     SIndex3 const K = Size3{w_, h_, d_}.cast<long>();
 
+    // The Gaussian with a diagonal covariance is the product of 1D Gaussians,
+    // normalizing each of them normalizes the product as well
+    for (int a = 0; a < 3; ++a) {
+      auto &kernel = kernels_[static_cast<std::size_t>(a)];
+      kernel.resize(2 * K[a] + 1);
+      for (auto i = -K[a]; i <= K[a]; ++i) {
+        auto const x = static_cast<T>(i);
+        kernel[i + K[a]] =
+            sigma_[a] > 0 ? static_cast<T>(exp(-T{0.5} * x * x /
+                                               (sigma_[a] * sigma_[a])))
+                          : T(i == 0 ? 1 : 0);
+      }
+      kernel /= kernel.sum();
+    }
+
     constexpr auto WH = (W == Dynamic || H == Dynamic) ? Dynamic : W * H;
 
     Eigen::Matrix<T, WH, D> weights = Eigen::Matrix<T, WH, D>::Zero(
         narrow_cast<long>(size_[0] * size_[1]), narrow_cast<long>(size_[2]));
 
-    Eigen::Matrix<T, 3, 1> const sigmaSqInv =
-        sigma.cwiseProduct(sigma).cwiseInverse();
-
-    for (auto k = -K[2]; k <= K[2]; ++k) {
-      for (auto j = -K[1]; j <= K[1]; ++j) {
-        for (auto i = -K[0]; i <= K[0]; ++i) {
-          auto const x = SIndex3{i, j, k}.template cast<T>().eval();
-          weights((j + K[1]) * narrow_cast<long>(size_[0]) + i + K[0],
-                  k + K[2]) =
-              static_cast<T>(exp(-T{0.5} * x.transpose() * sigmaSqInv.asDiagonal() * x));
+    for (auto k = 0; k <= 2 * K[2]; ++k) {
+      for (auto j = 0; j <= 2 * K[1]; ++j) {
+        for (auto i = 0; i <= 2 * K[0]; ++i) {
+          weights(j * narrow_cast<long>(size_[0]) + i, k) =
+              kernels_[0][i] * kernels_[1][j] * kernels_[2][k];
         }
       }
     }
 
-    weights /= weights.sum();
-
     weights_ = std::move(weights);
 
     K_ = K;
@@ -73,6 +93,7 @@ private:
   Eigen::Matrix<T, 3, 1> sigma_;
   Eigen::Matrix<T, (W == Dynamic || H == Dynamic) ? Dynamic : W * H, D>
       weights_;
+  std::array<Kernel, 3> kernels_;
   Size3 size_;
   SIndex3 K_;
 };
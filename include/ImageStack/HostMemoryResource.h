@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Types.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef IMAGESTACK_HUGE_PAGES
+#include <sys/mman.h>
+#endif
+
+namespace ImageStack {
+
+namespace detail {
+
+/// @brief Alignment of host memory allocations in bytes, the size of a cache
+/// line and of an AVX-512 register
+constexpr std::size_t kHostAlignment = 64;
+
+#ifdef IMAGESTACK_HUGE_PAGES
+/// @brief Size of a transparent huge page
+constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+#endif
+
+/// @brief Allocates @c bytes of uninitialized memory aligned to
+/// kHostAlignment
+///
+/// If IMAGESTACK_HUGE_PAGES is defined, allocations of at least one huge page
+/// are aligned to the huge page size and the kernel is advised to back them
+/// with transparent huge pages.
+/// @throw std::bad_alloc if the allocation fails
+inline void *allocateAligned(std::size_t bytes) {
+  auto alignment = kHostAlignment;
+#ifdef IMAGESTACK_HUGE_PAGES
+  if (bytes >= kHugePageSize) alignment = kHugePageSize;
+#endif
+
+#ifdef _WIN32
+  auto *ptr = _aligned_malloc(bytes, alignment);
+  if (!ptr) throw std::bad_alloc();
+#else
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, alignment, bytes) != 0) throw std::bad_alloc();
+#endif
+
+#ifdef IMAGESTACK_HUGE_PAGES
+  if (alignment == kHugePageSize)
+    madvise(ptr, bytes / kHugePageSize * kHugePageSize, MADV_HUGEPAGE);
+#endif
+
+  return ptr;
+}
+
+/// @brief Frees memory allocated by allocateAligned()
+inline void freeAligned(void *ptr) noexcept {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+} // namespace detail
+
+/// @brief Interface of the memory resources HostStorage allocates its memory
+/// from
+///
+/// Implementations must be thread safe and return memory aligned to at least
+/// 64 bytes.
+class HostMemoryResource {
+public:
+  virtual ~HostMemoryResource() = default;
+
+  /// @brief Allocates @c bytes of uninitialized memory
+  /// @throw std::bad_alloc if the allocation fails
+  virtual void *allocate(std::size_t bytes) = 0;
+
+  /// @brief Returns memory obtained by @c allocate(bytes)
+  virtual void deallocate(void *ptr, std::size_t bytes) noexcept = 0;
+};
+
+/// @brief Memory resource allocating each buffer from the system
+class AlignedMemoryResource : public HostMemoryResource {
+public:
+  void *allocate(std::size_t bytes) override {
+    return detail::allocateAligned(bytes);
+  }
+
+  void deallocate(void *ptr, std::size_t) noexcept override {
+    detail::freeAligned(ptr);
+  }
+};
+
+namespace detail {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+inline HostMemoryResource *defaultHostMemoryResource() noexcept {
+  static AlignedMemoryResource resource;
+  return &resource;
+}
+#pragma clang diagnostic pop
+
+inline std::atomic<HostMemoryResource *> &currentHostMemoryResource() noexcept {
+  static std::atomic<HostMemoryResource *> resource{
+      defaultHostMemoryResource()};
+  return resource;
+}
+
+} // namespace detail
+
+/// @brief Counters of a BufferPool
+struct BufferPoolStatistics {
+  /// @brief Number of allocations served from the pool
+  std::size_t hits{0};
+  /// @brief Number of allocations forwarded to the upstream resource
+  std::size_t misses{0};
+  /// @brief Number of buffers freed because the pool was full
+  std::size_t evictions{0};
+  /// @brief Number of bytes currently kept in the pool
+  std::size_t cachedBytes{0};
+  /// @brief Number of bytes currently allocated through the pool
+  std::size_t usedBytes{0};
+};
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Thread safe memory resource recycling buffers of equal size
+///
+/// Deallocated buffers are kept in the pool, keyed by their size in bytes,
+/// and handed out again by the next allocation of the same size. This avoids
+/// returning large volume buffers to the operating system just to request
+/// them again, together with the page faults of touching fresh pages.
+///
+/// The pool must outlive all storage objects allocated from it.
+///
+/// Unit tests are in \ref testHostMemoryResource.cpp
+class BufferPool : public HostMemoryResource {
+public:
+  /// @brief Creates a pool
+  /// @param capacity maximum number of bytes kept in the pool, buffers
+  /// returned to a full pool are freed
+  /// @param upstream resource allocating new buffers, must outlive the pool
+  explicit BufferPool(std::size_t capacity = std::size_t{4} << 30,
+                      HostMemoryResource *upstream = nullptr)
+      : capacity_(capacity),
+        upstream_(upstream ? upstream : detail::defaultHostMemoryResource()) {}
+
+  BufferPool(BufferPool const &) = delete;
+  BufferPool &operator=(BufferPool const &) = delete;
+
+  ~BufferPool() override { release(); }
+
+  void *allocate(std::size_t bytes) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto const it = free_.find(bytes);
+      if (it != free_.end() && !it->second.empty()) {
+        auto *ptr = it->second.back();
+        it->second.pop_back();
+        ++statistics_.hits;
+        statistics_.cachedBytes -= bytes;
+        statistics_.usedBytes += bytes;
+        return ptr;
+      }
+      ++statistics_.misses;
+    }
+
+    auto *ptr = upstream_->allocate(bytes);
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.usedBytes += bytes;
+    return ptr;
+  }
+
+  void deallocate(void *ptr, std::size_t bytes) noexcept override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      statistics_.usedBytes -= bytes;
+      if (statistics_.cachedBytes + bytes <= capacity_) {
+        try {
+          free_[bytes].push_back(ptr);
+          statistics_.cachedBytes += bytes;
+          return;
+        } catch (...) {
+          // no memory to remember the buffer, free it
+        }
+      }
+      ++statistics_.evictions;
+    }
+    upstream_->deallocate(ptr, bytes);
+  }
+
+  /// @brief Returns a copy of the counters
+  BufferPoolStatistics statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+  }
+
+  /// @brief Resets the hit, miss and eviction counters
+  void resetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.hits = statistics_.misses = statistics_.evictions = 0;
+  }
+
+  /// @brief Returns the maximum number of bytes kept in the pool
+  inline std::size_t capacity() const noexcept { return capacity_; }
+
+  /// @brief Frees all buffers kept in the pool
+  void release() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : free_)
+      for (auto *ptr : entry.second) upstream_->deallocate(ptr, entry.first);
+    free_.clear();
+    statistics_.cachedBytes = 0;
+  }
+
+private:
+  std::size_t capacity_;
+  HostMemoryResource *upstream_;
+  std::map<std::size_t, std::vector<void *>> free_;
+  BufferPoolStatistics statistics_;
+  mutable std::mutex mutex_;
+};
+#pragma clang diagnostic pop
+
+/// @brief Returns the memory resource new HostStorage objects allocate from
+inline HostMemoryResource *hostMemoryResource() noexcept {
+  return detail::currentHostMemoryResource().load();
+}
+
+/// @brief Sets the memory resource new HostStorage objects allocate from
+///
+/// Existing storage objects keep returning their memory to the resource they
+/// were allocated from.
+/// @param resource resource to use, nullptr restores the default resource
+/// @return the previous resource
+inline HostMemoryResource *
+setHostMemoryResource(HostMemoryResource *resource) noexcept {
+  return detail::currentHostMemoryResource().exchange(
+      resource ? resource : detail::defaultHostMemoryResource());
+}
+
+} // namespace ImageStack
@@ -1,14 +1,40 @@
 #pragma once
 
+#include <ImageStack/HostMemoryResource.h>
 #include <ImageStack/MappedMemory.h>
 #include <ImageStack/Types.h>
 
-#include <vector>
+#include <algorithm>
+#include <memory>
+#include <new>
 
 namespace ImageStack {
 
+namespace detail {
+
+/// @brief Minimum number of elements of a storage object to initialize it
+/// with multiple threads
+constexpr Size kParallelInitThreshold = Size{1} << 18;
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
 /// @brief Class representing a 3D data storage in host memory
 ///
+/// The voxels are stored in a single allocation aligned to 64 bytes, obtained
+/// from the current HostMemoryResource (see setHostMemoryResource()). Storage
+/// created without an initial value is left uninitialized if @c T is
+/// trivially default constructible, so memory that is overwritten anyway
+/// (e.g. by a loader) is touched only once.
+///
+/// Large storage objects are initialized and copied slice by slice with
+/// multiple threads, using the static schedule of the parallel loops over
+/// slices in the filters and loaders. With the first touch placement of the
+/// operating system, each slab then lives on the NUMA node of the thread
+/// processing it later. See NumaMemoryResource for interleaving or binding
+/// the memory instead.
+///
 /// Unit tests are in \ref testHostStorage.cpp
 /// @tparam T type of stored elements
 template <class T> class HostStorage {
@@ -18,6 +44,9 @@ public:
   using ConstPointer = T const *;
 
   /// @brief Create host storage object and allocate memory
+  ///
+  /// The memory is default initialized, i.e. left uninitialized for
+  /// trivially default constructible types.
   /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
   /// @param size size of storage to be allocated
   /// @note if Size has more than 3 dimensions, only the first 3 dimensions are
@@ -25,7 +54,17 @@ public:
   template <class Size, typename = std::enable_if_t<
                             isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
   inline explicit HostStorage(Size size)
-      : size_(size[0], size[1], size[2]), storage_(indexProduct(size)) {}
+      : size_(size[0], size[1], size[2]), storage_(allocate(linearSize())) {
+    if (std::is_trivially_default_constructible<T>::value) {
+      constructed();
+      return;
+    }
+
+    initialize(
+        [](T *dest, std::size_t n) { std::uninitialized_fill_n(dest, n, T()); },
+        std::is_nothrow_default_constructible<T>::value &&
+            std::is_nothrow_copy_constructible<T>::value);
+  }
 
   /// @brief Create host storage and initialize allocated memory with given
   /// value
@@ -37,7 +76,13 @@ public:
   template <class Size, typename = std::enable_if_t<
                             isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
   inline HostStorage(Size size, T const &init)
-      : size_(size[0], size[1], size[2]), storage_(indexProduct(size), init) {}
+      : size_(size[0], size[1], size[2]), storage_(allocate(linearSize())) {
+    initialize(
+        [&init](T *dest, std::size_t n) {
+          std::uninitialized_fill_n(dest, n, init);
+        },
+        std::is_nothrow_copy_constructible<T>::value);
+  }
 
   /// @brief Create host storage and initialize allocated memory with given
   /// content
@@ -63,8 +108,41 @@ public:
           // Check if Size is a model of MultiIndexConcept with dims >= 3
           isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
   inline explicit HostStorage(Size size, Container const &init)
-      : size_(size[0], size[1], size[2]), storage_(init.cbegin(), init.cend()) {
+      : size_(size[0], size[1], size[2]), storage_(allocate(linearSize())) {
     Expects(indexProduct(size) == init.size());
+    auto const *src = init.data();
+    initialize(
+        [this, src](T *dest, std::size_t n) {
+          std::uninitialized_copy_n(src + (dest - storage_.get()), n, dest);
+        },
+        std::is_nothrow_copy_constructible<T>::value);
+  }
+
+  inline HostStorage(HostStorage const &other)
+      : size_(other.size_), storage_(allocate(linearSize())) {
+    auto const *src = other.storage_.get();
+    initialize(
+        [this, src](T *dest, std::size_t n) {
+          std::uninitialized_copy_n(src + (dest - storage_.get()), n, dest);
+        },
+        std::is_nothrow_copy_constructible<T>::value);
+  }
+
+  inline HostStorage &operator=(HostStorage const &other) {
+    if (this != &other) *this = HostStorage(other);
+    return *this;
+  }
+
+  inline HostStorage(HostStorage &&other) noexcept
+      : size_(other.size_), storage_(std::move(other.storage_)) {
+    other.size_.setZero();
+  }
+
+  inline HostStorage &operator=(HostStorage &&other) noexcept {
+    size_ = other.size_;
+    storage_ = std::move(other.storage_);
+    other.size_.setZero();
+    return *this;
   }
 
   /// @brief Returns the size of the storage
@@ -83,7 +161,7 @@ public:
   /// @return MappedHostMemory object representing the mapping
   inline auto map() noexcept {
     Expects(!empty());
-    return MappedHostMemory<T, 3>(not_null<Pointer>(storage_.data()), size_);
+    return MappedHostMemory<T, 3>(not_null<Pointer>(storage_.get()), size_);
   }
 
   /// @brief Maps to storage to host memory and returs a const memory mapping
@@ -91,7 +169,7 @@ public:
   /// @return const MappedHostMemory object representing the mapping
   inline auto map() const noexcept {
     return MappedHostMemory<T const, 3>(
-        not_null<ConstPointer>(storage_.data()), size_);
+        not_null<ConstPointer>(storage_.get()), size_);
   }
 
   /// @brief Returns true if the the storage is empty, i.e. no memory is
@@ -100,9 +178,65 @@ public:
   inline bool empty() const noexcept { return linearSize() == 0; }
 
 private:
+  /// @brief Destroys the elements and returns the memory to the resource it
+  /// was allocated from
+  struct Deleter {
+    /// @brief Number of constructed elements
+    Size n;
+    /// @brief Number of allocated elements
+    Size capacity;
+    HostMemoryResource *resource;
+
+    void operator()(T *ptr) const noexcept {
+      if (!std::is_trivially_destructible<T>::value)
+        for (Size i = 0; i < n; ++i) ptr[i].~T();
+      resource->deallocate(ptr, capacity * sizeof(T));
+    }
+  };
+
+  using Buffer = std::unique_ptr<T[], Deleter>;
+
+  /// @brief Allocates memory for @c n elements without constructing them
+  static Buffer allocate(Size n) {
+    if (n == 0) return Buffer(nullptr, Deleter{0, 0, nullptr});
+    auto *resource = hostMemoryResource();
+    return Buffer(static_cast<T *>(resource->allocate(n * sizeof(T))),
+                  Deleter{0, n, resource});
+  }
+
+  /// @brief Constructs the elements slice by slice by calling
+  /// `init(first, count)`
+  ///
+  /// If @c parallel is true, large storage objects are initialized with
+  /// multiple threads. Otherwise the number of constructed elements is
+  /// updated after each slice, so they are destroyed if @c init throws.
+  template <class Init> void initialize(Init init, bool parallel) {
+    auto const slice = size_[0] * size_[1];
+    auto const slices = narrow<long>(size_[2]);
+    auto *const data = storage_.get();
+
+    if (parallel) {
+#pragma omp parallel for schedule(static)                                      \
+    if (linearSize() >= detail::kParallelInitThreshold)
+      for (long z = 0; z < slices; ++z)
+        init(data + static_cast<Size>(z) * slice, slice);
+      constructed();
+      return;
+    }
+
+    auto &n = storage_.get_deleter().n;
+    for (long z = 0; z < slices; ++z, n += slice) init(data + n, slice);
+  }
+
+  /// @brief Marks all elements as constructed
+  inline void constructed() noexcept {
+    storage_.get_deleter().n = linearSize();
+  }
+
   Size3 size_;
-  std::vector<T> storage_;
+  Buffer storage_;
 };
+#pragma clang diagnostic pop
 
 template <template <class> class T>
 struct IsHostStorage : public std::false_type {};
@@ -112,4 +246,15 @@ template <> struct IsHostStorage<HostStorage> : public std::true_type {};
 template <template <class> class T>
 constexpr bool isHostStorage_v = IsHostStorage<T>::value;
 
+/// @brief Type trait to check if a storage keeps its data out of core, i.e.
+/// in files, so that it may be larger than the physical memory
+///
+/// Images computed from such images (e.g. by Filter::filter) use the same
+/// storage instead of HostStorage.
+template <template <class> class T>
+struct IsOutOfCoreStorage : public std::false_type {};
+
+template <template <class> class T>
+constexpr bool isOutOfCoreStorage_v = IsOutOfCoreStorage<T>::value;
+
 } // namespace ImageStack
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "ByteSwap.h"
+#include "Types.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/// @file ISVFormat.h
+/// @brief Definitions shared by the reader and writer of the native,
+/// bricked and compressed ImageStack volume format (.isv)
+///
+/// All values are stored in little endian byte order. A file consists of
+///   - a fixed size header (see ISVHeader),
+///   - the brick index, i.e. offset and compressed size (both 64 bit) of each
+///     brick,
+///   - the compressed bricks.
+///
+/// The volume is split into bricks of a fixed size, the bricks at the upper
+/// border are clipped to the volume. Bricks are ordered x fastest, then y,
+/// then z. The voxels of a brick are ordered x fastest, then y, then z.
+/// Each brick is compressed independently with ISVCodec, a brick whose
+/// compressed size equals its raw size is stored uncompressed.
+
+namespace ImageStack {
+
+namespace detail {
+
+/// @brief Returns a code identifying the voxel type stored in an .isv file
+template <class T> constexpr std::uint32_t isvTypeCode() noexcept {
+  return (std::is_floating_point<T>::value
+              ? 2u
+              : std::is_integral<T>::value
+                    ? (std::is_signed<T>::value ? 1u : 0u)
+                    : 3u) << 16 |
+         static_cast<std::uint32_t>(sizeof(T));
+}
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Fixed size header of an .isv file
+struct ISVHeader {
+  static constexpr std::array<char, 4> magic() noexcept {
+    return {{'I', 'S', 'V', '1'}};
+  }
+  static constexpr std::uint32_t kVersion = 1;
+  /// @brief Size of the serialized header in bytes
+  static constexpr std::size_t kSize = 80;
+  /// @brief Size of one serialized brick index entry in bytes
+  static constexpr std::size_t kIndexEntrySize = 16;
+
+  std::uint32_t typeCode{0};
+  Size3 size{Size3::Zero()};
+  Eigen::Vector3d resolution{Eigen::Vector3d::Ones()};
+  Size3 brickSize{Size3::Zero()};
+
+  /// @brief Returns the number of bricks in each dimension
+  inline Size3 gridSize() const {
+    return Size3((size[0] + brickSize[0] - 1) / brickSize[0],
+                 (size[1] + brickSize[1] - 1) / brickSize[1],
+                 (size[2] + brickSize[2] - 1) / brickSize[2]);
+  }
+
+  /// @brief Returns the total number of bricks
+  inline Size numBricks() const { return indexProduct(gridSize()); }
+
+  /// @brief Returns the index of the first voxel of the given brick
+  inline Index3 brickOrigin(Index3 const &brick) const {
+    return brick.cwiseProduct(brickSize);
+  }
+
+  /// @brief Returns the size of the given brick, clipped to the volume
+  inline Size3 brickExtent(Index3 const &brick) const {
+    return brickSize.cwiseMin(size - brickOrigin(brick));
+  }
+
+  void write(std::ostream &out) const {
+    auto const m = magic();
+    out.write(m.data(), m.size());
+    detail::writeLE(out, kVersion);
+    detail::writeLE(out, typeCode);
+    detail::writeLE(out, std::uint32_t{0});
+    for (int i = 0; i < 3; ++i)
+      detail::writeLE(out, static_cast<std::uint64_t>(size[i]));
+    for (int i = 0; i < 3; ++i) detail::writeLE(out, resolution[i]);
+    for (int i = 0; i < 3; ++i)
+      detail::writeLE(out, narrow<std::uint32_t>(brickSize[i]));
+    // codec, currently only ISVCodec
+    detail::writeLE(out, std::uint32_t{1});
+  }
+
+  /// @throw std::runtime_error if the stream does not contain a valid header
+  void read(std::istream &in) {
+    std::array<char, 4> magic;
+    in.read(magic.data(), magic.size());
+    if (!in || magic != ISVHeader::magic())
+      throw std::runtime_error("Not an ImageStack volume file");
+    if (detail::readLE<std::uint32_t>(in) != kVersion)
+      throw std::runtime_error("Unsupported ImageStack volume file version");
+    typeCode = detail::readLE<std::uint32_t>(in);
+    detail::readLE<std::uint32_t>(in);
+    for (int i = 0; i < 3; ++i)
+      size[i] = narrow<Size>(detail::readLE<std::uint64_t>(in));
+    for (int i = 0; i < 3; ++i) resolution[i] = detail::readLE<double>(in);
+    for (int i = 0; i < 3; ++i)
+      brickSize[i] = detail::readLE<std::uint32_t>(in);
+    auto const codec = detail::readLE<std::uint32_t>(in);
+
+    if (!in || codec != 1 || size.minCoeff() == 0 || brickSize.minCoeff() == 0)
+      throw std::runtime_error("Corrupt ImageStack volume file header");
+  }
+};
+#pragma clang diagnostic pop
+
+/// @brief Fast codec for bricks
+///
+/// The bytes of the elements are first shuffled into planes (all first bytes,
+/// then all second bytes, ...), which turns slowly varying values into long
+/// runs of equal bytes. The planes are then run length encoded. Each token
+/// starts with a varint `(length << 1) | isRun`, followed by either the
+/// repeated byte or `length` literal bytes.
+struct ISVCodec {
+  /// @brief Minimum length of a run of equal bytes to be encoded as run
+  static constexpr std::size_t kMinRun = 4;
+
+  /// @brief Compresses @c n elements of size @c elementSize
+  /// @return compressed data, or an empty vector if the data is not
+  /// compressible
+  static std::vector<std::uint8_t> compress(void const *data, std::size_t n,
+                                            std::size_t elementSize) {
+    auto const bytes = n * elementSize;
+    std::vector<std::uint8_t> shuffled(bytes);
+    shuffle(static_cast<std::uint8_t const *>(data), n, elementSize,
+            shuffled.data());
+
+    std::vector<std::uint8_t> out;
+    out.reserve(bytes / 4);
+
+    auto const *d = shuffled.data();
+    std::size_t literal = 0;
+    std::size_t i = 0;
+    while (i < bytes) {
+      auto j = i + 1;
+      while (j < bytes && d[j] == d[i]) ++j;
+
+      if (j - i >= kMinRun) {
+        putLiteral(out, d + literal, i - literal);
+        putVarint(out, (j - i) << 1 | 1);
+        out.push_back(d[i]);
+        literal = j;
+      }
+      i = j;
+      // Give up early on incompressible data
+      if (out.size() >= bytes) return {};
+    }
+    putLiteral(out, d + literal, bytes - literal);
+
+    if (out.size() >= bytes) return {};
+    return out;
+  }
+
+  /// @brief Decompresses @c n elements of size @c elementSize
+  /// @throw std::runtime_error if the compressed data is corrupt
+  static void decompress(std::uint8_t const *src, std::size_t srcBytes,
+                         void *data, std::size_t n, std::size_t elementSize) {
+    auto const bytes = n * elementSize;
+    std::vector<std::uint8_t> shuffled(bytes);
+
+    auto const *end = src + srcBytes;
+    std::size_t pos = 0;
+    while (src < end) {
+      auto const token = getVarint(src, end);
+      auto const length = token >> 1;
+      if (length > bytes - pos) throw corrupt();
+
+      if (token & 1) {
+        if (src == end) throw corrupt();
+        std::memset(shuffled.data() + pos, *src++, length);
+      } else {
+        if (length > static_cast<std::size_t>(end - src)) throw corrupt();
+        std::memcpy(shuffled.data() + pos, src, length);
+        src += length;
+      }
+      pos += length;
+    }
+    if (pos != bytes) throw corrupt();
+
+    unshuffle(shuffled.data(), n, elementSize,
+              static_cast<std::uint8_t *>(data));
+  }
+
+private:
+  static std::runtime_error corrupt() {
+    return std::runtime_error("Corrupt brick in ImageStack volume file");
+  }
+
+  static void shuffle(std::uint8_t const *src, std::size_t n,
+                      std::size_t elementSize, std::uint8_t *dst) noexcept {
+    for (std::size_t k = 0; k < elementSize; ++k)
+      for (std::size_t i = 0; i < n; ++i)
+        dst[k * n + i] = src[i * elementSize + k];
+  }
+
+  static void unshuffle(std::uint8_t const *src, std::size_t n,
+                        std::size_t elementSize, std::uint8_t *dst) noexcept {
+    for (std::size_t k = 0; k < elementSize; ++k)
+      for (std::size_t i = 0; i < n; ++i)
+        dst[i * elementSize + k] = src[k * n + i];
+  }
+
+  static void putLiteral(std::vector<std::uint8_t> &out,
+                         std::uint8_t const *data, std::size_t length) {
+    if (length == 0) return;
+    putVarint(out, length << 1);
+    out.insert(out.end(), data, data + length);
+  }
+
+  static void putVarint(std::vector<std::uint8_t> &out, std::size_t v) {
+    while (v >= 0x80) {
+      out.push_back(static_cast<std::uint8_t>(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+  }
+
+  static std::size_t getVarint(std::uint8_t const *&src,
+                               std::uint8_t const *end) {
+    std::size_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (src == end) throw corrupt();
+      auto const b = *src++;
+      v |= static_cast<std::size_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) return v;
+    }
+    throw corrupt();
+  }
+};
+
+} // namespace ImageStack
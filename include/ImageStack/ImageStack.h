@@ -1,11 +1,13 @@
 #pragma once
 
+#include "Conversion.h"
 #include "HostStorage.h"
 #include "ImageStackLoader.h"
 #include "MultiIndex.h"
 #include "Types.h"
+#include "UniqueValues.h"
 
-#include <set>
+#include <utility>
 #include <vector>
 
 namespace ImageStack {
@@ -37,33 +39,56 @@ public:
   inline ImageStack(Size &&size, T const &init)
       : storage_(std::forward<Size>(size), init) {}
 
+  /// @brief Creates an image stack from a storage object and copies of the
+  /// decorators
+  ///
+  /// Used to create views of other image stacks, see ImageStackView.h.
+  explicit ImageStack(Storage storage, Decorators const &... decorators)
+      : Decorators(decorators)..., storage_(std::move(storage)) {}
+
   /// @brief Loads an image stack using the given loader
+  ///
+  /// If @c Storage can be constructed from the loader directly (e.g.
+  /// MappedFileStorage), the storage is responsible for loading the data.
+  /// Otherwise the data is read into a newly allocated storage object.
   template <class Loader, typename = std::enable_if_t<isLoader_v<Loader>>>
   explicit ImageStack(Loader &&loader)
-      : Decorators(std::forward<Loader>(loader))..., storage_(loader.size()) {
-
-    auto const size = loader.size();
-    Expects(indexProduct(size) > 0);
-
-    Storage store(size);
-    loader.template readData<StorageType>(store.map().begin());
-
-    storage_ = std::move(store);
+      : Decorators(std::forward<Loader>(loader))...,
+        storage_(loadStorage(
+            loader, std::is_constructible<Storage, std::decay_t<Loader> &>{})) {
   }
 
+  /// @brief Loads an image stack using the given loader, reading the data
+  /// with multiple threads
+  ///
+  /// Same as ImageStack(Loader &&), but uses the parallel @c readData
+  /// overload of the loader.
+  template <class Loader, typename = std::enable_if_t<isLoader_v<Loader>>>
+  ImageStack(Loader &&loader, ParallelTag)
+      : Decorators(std::forward<Loader>(loader))...,
+        storage_(loadStorage(
+            loader, std::is_constructible<Storage, std::decay_t<Loader> &>{},
+            ParallelTag{})) {}
+
   /// @brief Cast constructor
+  ///
+  /// Also converts between storage types, e.g. from HostStorage to
+  /// BrickedHostStorage. The voxels are converted with @c static_cast, in
+  /// parallel. Use convert() (see Conversion.h) for saturating or scaling
+  /// conversions.
   template <class ST, template <class> class S, class... Decs,
             typename = typename std::enable_if_t<
                 std::is_convertible<ST, StorageType>::value>>
-  ImageStack(ImageStack<ST, S, Decs...> const &stack) {
+  ImageStack(ImageStack<ST, S, Decs...> const &stack)
+      : storage_(stack.size()) {
+    if (stack.empty()) return;
 
-    Storage store(stack.size());
     auto const srcMap = stack.storage_.map();
-    auto destMap = store.map();
-    std::transform(srcMap.begin(), srcMap.end(), destMap.begin(),
-                   [](auto v) { return static_cast<StorageType>(v); });
-
-    storage_ = std::move(store);
+    auto destMap = storage_.map();
+    detail::transformMaps(srcMap, destMap, [](auto src, auto dest, Size n) {
+      for (Size i = 0; i < n; ++i, ++src, ++dest)
+        *dest = static_cast<StorageType>(*src);
+    });
   }
 
   /// @brief Returns the number of slices
@@ -74,21 +99,32 @@ public:
 
   /// @brief Returns a container of unique values in ascending order found
   /// inside the image stack.
-  /// @return container containing all unique values of the image in ascending
+  ///
+  /// The voxels are processed in parallel. Integral values with a small range
+  /// (e.g. labels) are collected in flag tables, other values are sorted.
+  /// @return vector containing all unique values of the image in ascending
   /// order
   /// @note This method requires to map the underlying storage.
   auto uniqueValues() const {
-    std::set<StorageType> values;
-
-    if (empty()) return values;
+    if (empty()) return std::vector<StorageType>{};
 
-    for (auto const &v : storage_.map()) values.insert(v);
+    auto values = detail::uniqueValues<StorageType>(storage_.map());
 
     Ensures(std::is_sorted(values.cbegin(), values.cend()));
 
     return values;
   }
 
+  /// @brief Returns the unique values in ascending order together with the
+  /// number of voxels having that value
+  /// @return vector of `(value, count)` pairs in ascending order of the
+  /// values
+  /// @note This method requires to map the underlying storage.
+  auto uniqueValuesWithCounts() const {
+    if (empty()) return std::vector<std::pair<StorageType, Size>>{};
+    return detail::valueCounts<StorageType>(storage_.map());
+  }
+
   /// @brief Returns true if the image is empty
   inline bool empty() const noexcept { return storage_.empty(); }
 
@@ -108,10 +144,54 @@ public:
     return storage_.map();
   }
 
+  /// @brief Returns the underlying storage object, e.g. to flush a
+  /// ScratchFileStorage
+  inline Storage const &storage() const noexcept { return storage_; }
+
+  /// @brief Returns the underlying storage object
+  inline Storage &storage() noexcept { return storage_; }
+
 private:
   template <class, template <class> class, class... Decs>
   friend class ImageStack;
 
+  /// @brief Let the storage load the data itself
+  template <class Loader>
+  static Storage loadStorage(Loader &loader, std::true_type) {
+    return Storage(loader);
+  }
+
+  /// @brief Read the data through the loader into a new storage object
+  template <class Loader>
+  static Storage loadStorage(Loader &loader, std::false_type) {
+    auto const size = loader.size();
+    Expects(indexProduct(size) > 0);
+
+    Storage store(size);
+    loader.template readData<StorageType>(store.map().data());
+
+    return store;
+  }
+
+  /// @brief Let the storage load the data itself
+  template <class Loader>
+  static Storage loadStorage(Loader &loader, std::true_type, ParallelTag) {
+    return Storage(loader);
+  }
+
+  /// @brief Read the data through the loader into a new storage object using
+  /// multiple threads
+  template <class Loader>
+  static Storage loadStorage(Loader &loader, std::false_type, ParallelTag) {
+    auto const size = loader.size();
+    Expects(indexProduct(size) > 0);
+
+    Storage store(size);
+    loader.template readData<StorageType>(store.map().data(), ParallelTag{});
+
+    return store;
+  }
+
   Storage storage_;
 };
 
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "Types.h"
+
 #include <type_traits>
+#include <utility>
 
 namespace ImageStack {
 
@@ -12,4 +15,20 @@ struct IsLoader : public std::is_base_of<ImageStackLoaderBase<std::decay_t<T>>,
 
 template <class T> constexpr bool isLoader_v = IsLoader<T>::value;
 
+namespace detail {
+
+/// @brief True if @c Loader can read a range of slices into a buffer, like
+/// ImageStackLoaderBST::readSlices()
+template <class Loader, class T, typename = void>
+struct HasReadSlices : public std::false_type {};
+
+template <class Loader, class T>
+struct HasReadSlices<
+    Loader, T,
+    decltype(std::declval<Loader &>().template readSlices<T>(
+                 Size{0}, Size{0}, std::declval<T *>()),
+             void())> : public std::true_type {};
+
+} // namespace detail
+
 } // namespace ImageStack
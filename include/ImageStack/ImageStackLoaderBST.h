@@ -1,15 +1,20 @@
 #pragma once
 
 #include "BinaryStream.h"
+#include "ByteSwap.h"
+#include "Conversion.h"
 #include "ImageStackLoader.h"
 #include "Types.h"
 
 #include <algorithm>
+#include <exception>
 #include <fstream>
 #include <iterator>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 // clang-format off
 #if defined(__APPLE__)
@@ -52,32 +57,71 @@ template <typename T> constexpr T ntohT(T value) noexcept {
 #pragma clang diagnostic ignored "-Wpadded"
 /// @brief Loader class for ImageStack for loading .bst files
 ///
+/// The voxel type stored in the file may differ from the voxel type of the
+/// image stack. In that case the voxels are converted (and optionally scaled,
+/// see @c setScaling()) block by block while they are read, so no second
+/// image sized buffer and no second pass over the data is needed.
+///
 /// Unit tests are in \ref testBSTLoader.cpp
 ///
 /// @tparam ImageStack_ ImageStack type to load the data for
 /// @tparam IsMask bool value indicating if the loader should load a mask
 ///(true) or an image (false).
-template <class ImageStack_, bool IsMask = false>
+/// @tparam FileType_ type of the voxels as stored in the file, defaults to the
+/// voxel type of @c ImageStack_
+template <class ImageStack_, bool IsMask = false,
+          class FileType_ = typename ImageStack_::StorageType>
 class ImageStackLoaderBST
-    : public ImageStackLoaderBase<ImageStackLoaderBST<ImageStack_, IsMask>> {
+    : public ImageStackLoaderBase<
+          ImageStackLoaderBST<ImageStack_, IsMask, FileType_>> {
   enum class State { Initialized, HeaderRead };
 
 public:
   using ImageStack = ImageStack_;
+  /// @brief Type of the voxels as stored in the file
+  using FileType = FileType_;
+
+  /// @brief Byte order of the voxel data in the file
+  static constexpr Endianness ByteOrder = Endianness::BigEndian;
 
   /// @brief Create a loader object for the given filename
   /// @param filename path to the file to load
   /// @throw std::runtime_error if the file could not be opened
-  explicit ImageStackLoaderBST(std::string filename) {
+  explicit ImageStackLoaderBST(std::string filename)
+      : filename_(std::move(filename)) {
     auto in = std::make_unique<std::ifstream>(
-        filename, std::ios_base::in | std::ios_base::binary);
+        filename_, std::ios_base::in | std::ios_base::binary);
 
     if (!*in)
-      throw std::runtime_error("Failed to open file '" + filename + "'");
+      throw std::runtime_error("Failed to open file '" + filename_ + "'");
 
     istream_ = std::move(in);
   }
 
+  /// @brief Create a loader object that only loads the given region of the
+  /// file
+  ///
+  /// Only the voxels inside the box [origin, origin + extent) are read, row by
+  /// row. All other methods refer to the region, e.g. @c size() returns
+  /// @c extent.
+  /// @param filename path to the file to load
+  /// @param origin index of the first voxel of the region
+  /// @param extent size of the region, all dimensions must be greater 0
+  /// @throw std::runtime_error if the file could not be opened
+  /// @note The region is checked against the size of the file when the header
+  /// is read, i.e. @c size() or @c readData() might throw std::out_of_range.
+  ImageStackLoaderBST(std::string filename, Index3 const &origin,
+                      Size3 const &extent)
+      : ImageStackLoaderBST(std::move(filename)) {
+    Expects(extent.minCoeff() > 0);
+
+    origin_ = origin;
+    extent_ = extent;
+  }
+
+  /// @brief Returns the path of the file to be read
+  inline std::string const &filename() const noexcept { return filename_; }
+
   /// @brief Returns the size of the image or mask to be read
   /// @note Calling this method may result in the header of the file beeing
   /// read, depending if it was read before. That is why this methid is not
@@ -87,9 +131,30 @@ public:
   inline auto size() {
     if (state_ != State::HeaderRead) readHeader();
 
+    return extent_;
+  }
+
+  /// @brief Returns the size of the whole volume stored in the file
+  /// @note Calling this method may result in the header of the file beeing
+  /// read, depending if it was read before. That is why this methid is not
+  /// const or noexcept.
+  inline auto volumeSize() {
+    if (state_ != State::HeaderRead) readHeader();
+
     return size_;
   }
 
+  /// @brief Returns the index of the first voxel to be read inside the volume
+  /// stored in the file, i.e. the offset of the region to be read
+  inline Index3 origin() const noexcept { return origin_; }
+
+  /// @brief Returns true if only a region of the volume is read
+  inline bool hasRegion() {
+    if (state_ != State::HeaderRead) readHeader();
+
+    return !indexEqual(extent_, size_);
+  }
+
   /// @brief Returns the resolution in mm of the file to be read
   /// @note Calling this method may result in the header of the file beeing
   /// read, depending if it was read before. That is why this methid is not
@@ -101,22 +166,247 @@ public:
     return resolution_;
   }
 
+  /// @brief Sets a linear transformation applied to each voxel while reading,
+  /// i.e. a voxel is read as `scale * fileValue + offset`
+  ///
+  /// Values converted to an integral type are rounded to the nearest integer
+  /// and clamped to the range of the type.
+  /// @param scale factor applied to each voxel
+  /// @param offset value added to each voxel after scaling
+  inline void setScaling(double scale, double offset = 0.0) noexcept {
+    scale_ = scale;
+    offset_ = offset;
+  }
+
+  /// @brief Returns the factor each voxel is multiplied with while reading
+  inline double scale() const noexcept { return scale_; }
+
+  /// @brief Returns the value added to each voxel while reading
+  inline double offset() const noexcept { return offset_; }
+
+  /// @brief Returns true if the voxels are read without any conversion, i.e.
+  /// @c T equals @c FileType and no scaling is set
+  template <class T> inline bool isIdentity() const noexcept {
+    return std::is_same<T, FileType>::value && scale_ == 1.0 &&
+           offset_ == 0.0;
+  }
+
+  /// @brief Returns the offset of the voxel data from the beginning of the
+  /// file in bytes
+  /// @note Calling this method may result in the header of the file beeing
+  /// read, depending if it was read before. That is why this methid is not
+  /// const or noexcept.
+  inline std::size_t dataOffset() {
+    if (state_ != State::HeaderRead) readHeader();
+
+    return static_cast<std::size_t>(startOfDtata_);
+  }
+
   /// @brief Read the data from the file into the given output iterator
+  ///
+  /// The data is read in large blocks into an intermediate buffer, converted
+  /// to host byte order and @c T and then copied to @c out.
   /// @tparam T data type to read
   /// @tparam OutIter output iterator
   /// @param out output iterator where the read data goes
+  /// @throw std::runtime_error if the file ends prematurely
   template <class T, class OutIter> void readData(OutIter out) {
-    using value_type = T;
-    using Iter =
-        std::istream_iterator<BinWrapper<value_type, Endianness::BigEndian>>;
+    if (state_ != State::HeaderRead) readHeader();
+
+    auto const sliceSize = extent_[0] * extent_[1];
+    auto const slabSize =
+        std::max<Size>(1, kBlockSize / (sliceSize * sizeof(T)));
+    std::vector<T> buffer(std::min(slabSize, extent_[2]) * sliceSize);
 
+    for (Size z = 0; z < extent_[2]; z += slabSize) {
+      auto const count = std::min(slabSize, extent_[2] - z);
+      readSlices(*istream_, z, count, buffer.data());
+      out = std::copy_n(buffer.cbegin(), count * sliceSize, out);
+    }
+  }
+
+  /// @brief Read the data from the file into the given contiguous memory
+  /// region
+  ///
+  /// The data is read in large blocks directly into @c out and converted to
+  /// host byte order in place while the block is still cached. If @c T
+  /// differs from @c FileType or a scaling is set, the data is read in cache
+  /// sized blocks into a staging buffer and converted into @c out.
+  /// @tparam T data type to read
+  /// @param out pointer to the first element of the destination, must be able
+  /// to hold `indexProduct(size())` elements
+  /// @throw std::runtime_error if the file ends prematurely
+  template <class T> void readData(T *out) {
     if (state_ != State::HeaderRead) readHeader();
 
-    istream_->seekg(startOfDtata_);
-    std::copy(Iter(*istream_), Iter(), out);
+    readSlices(*istream_, 0, extent_[2], out);
+  }
+
+  /// @brief Read the data from the file into the given contiguous memory
+  /// region using multiple threads
+  ///
+  /// The data region is split into slabs of consecutive slices. Each thread
+  /// opens its own stream, reads its slabs at their positions in the file and
+  /// converts them to host byte order. Slabs are distributed statically, so
+  /// each thread touches the same slices a parallel kernel iterating over the
+  /// slices would.
+  /// @tparam T data type to read
+  /// @param out pointer to the first element of the destination, must be able
+  /// to hold `indexProduct(size())` elements
+  /// @throw std::runtime_error if the file could not be opened or ends
+  /// prematurely
+  template <class T> void readData(T *out, ParallelTag) {
+    if (state_ != State::HeaderRead) readHeader();
+
+    auto const sliceSize = extent_[0] * extent_[1];
+    auto const slabSize =
+        std::max<Size>(1, kBlockSize / (sliceSize * sizeof(T)));
+    auto const numSlabs = narrow<long>((extent_[2] + slabSize - 1) / slabSize);
+
+    std::exception_ptr error;
+
+#pragma omp parallel
+    {
+      std::ifstream in(filename_, std::ios_base::in | std::ios_base::binary);
+
+#pragma omp for schedule(static)
+      for (long s = 0; s < numSlabs; ++s) {
+        try {
+          if (!in)
+            throw std::runtime_error("Failed to open file '" + filename_ +
+                                     "'");
+          auto const first = static_cast<Size>(s) * slabSize;
+          readSlices(in, first, std::min(slabSize, extent_[2] - first),
+                     out + first * sliceSize);
+        } catch (...) {
+#pragma omp critical
+          error = std::current_exception();
+        }
+      }
+    }
+
+    if (error) std::rethrow_exception(error);
+  }
+
+  /// @brief Read a range of slices from the file into the given contiguous
+  /// memory region
+  /// @tparam T data type to read
+  /// @param first index of the first slice to read
+  /// @param count number of slices to read
+  /// @param out pointer to the first element of the destination, must be able
+  /// to hold `count * size()[0] * size()[1]` elements
+  /// @throw std::runtime_error if the file ends prematurely
+  template <class T> void readSlices(Size first, Size count, T *out) {
+    if (state_ != State::HeaderRead) readHeader();
+    Expects(first + count <= extent_[2]);
+
+    readSlices(*istream_, first, count, out);
   }
 
 private:
+  /// @brief Size of the blocks read at once in bytes
+  static constexpr std::size_t kBlockSize = 4 << 20;
+  /// @brief Size of the staging buffer used for type conversions in bytes,
+  /// small enough to stay in the cache between reading and converting
+  static constexpr std::size_t kConversionBlockSize = 256 << 10;
+
+  /// @brief Reads the given range of slices of the region from the given
+  /// stream into contiguous memory and converts them to host byte order
+  ///
+  /// Rows, slices or whole slabs are read at once, depending on which of them
+  /// are contiguous in the file.
+  /// @param in stream to read from, must refer to the file of this loader
+  /// @param first index of the first slice to read, relative to the region
+  /// @param count number of slices to read
+  /// @param dest destination of the first voxel of slice @c first
+  template <class T>
+  void readSlices(std::istream &in, Size first, Size count, T *dest) const {
+    auto const offset = [this](Size y, Size z) {
+      Index3 const i = origin_ + Index3(0, y, z);
+      return startOfDtata_ + static_cast<std::streamoff>(toLinear(i, size_) *
+                                                         sizeof(FileType));
+    };
+    auto const sliceSize = extent_[0] * extent_[1];
+    bool const fullRows = extent_[0] == size_[0];
+    bool const fullSlices = fullRows && extent_[1] == size_[1];
+
+    // Staging buffer for conversions, shared by all rows or slices read
+    std::vector<FileType> staging;
+    if (!isIdentity<T>()) {
+      auto const longestRead = fullSlices ? count * sliceSize
+                                          : fullRows ? sliceSize : extent_[0];
+      staging.resize(std::min(
+          longestRead,
+          std::max<std::size_t>(1, kConversionBlockSize / sizeof(FileType))));
+    }
+
+    auto const read = [this, &in, &staging](T *d, std::size_t n) {
+      if (isIdentity<T>())
+        readBlocks(in, reinterpret_cast<FileType *>(d), n);
+      else
+        readConverted(in, d, n, staging);
+    };
+
+    if (fullSlices) {
+      in.seekg(offset(0, first));
+      read(dest, count * sliceSize);
+      return;
+    }
+
+    for (Size z = first; z < first + count; ++z) {
+      if (fullRows) {
+        in.seekg(offset(0, z));
+        read(dest, sliceSize);
+        dest += sliceSize;
+        continue;
+      }
+
+      for (Size y = 0; y < extent_[1]; ++y, dest += extent_[0]) {
+        in.seekg(offset(y, z));
+        read(dest, extent_[0]);
+      }
+    }
+  }
+
+  /// @brief Reads @c n consecutive elements from the current position in
+  /// blocks of at most @c kBlockSize bytes
+  template <class T>
+  void readBlocks(std::istream &in, T *dest, std::size_t n) const {
+    auto const blockSize = kBlockSize / sizeof(T);
+    for (std::size_t i = 0; i < n; i += blockSize) {
+      readBlock(in, dest + i, std::min(blockSize, n - i));
+    }
+  }
+
+  /// @brief Reads @c count elements from the current position and converts
+  /// them to host byte order
+  void readBlock(std::istream &in, FileType *dest, std::size_t count) const {
+    auto const bytes = static_cast<std::streamsize>(count * sizeof(FileType));
+    in.read(reinterpret_cast<char *>(dest), bytes);
+    if (in.gcount() != bytes)
+      throw std::runtime_error("Unexpected end of file '" + filename_ + "'");
+
+    convertByteOrder(dest, count, ByteOrder);
+  }
+
+  /// @brief Reads @c n consecutive elements from the current position and
+  /// converts them to @c T, applying the scaling
+  ///
+  /// Each block is read into the staging buffer, converted to host byte
+  /// order and then converted into @c dest while it is still cached.
+  /// @param staging buffer holding one block, must not be empty
+  template <class T>
+  void readConverted(std::istream &in, T *dest, std::size_t n,
+                     std::vector<FileType> &staging) const {
+    Expects(!staging.empty());
+    auto const blockSize = staging.size();
+    for (std::size_t i = 0; i < n; i += blockSize) {
+      auto const count = std::min(blockSize, n - i);
+      readBlock(in, staging.data(), count);
+      detail::convertValues(staging.data(), dest + i, count, scale_, offset_);
+    }
+  }
+
   void readHeader() {
     // the header should not be read twice
     Expects(state_ == State::Initialized);
@@ -145,8 +435,7 @@ private:
         resolution_[i] = detail::ntohT(tmp);
       }
 
-      size = static_cast<Size>(indexProduct(size_) *
-                               sizeof(typename ImageStack::StorageType));
+      size = static_cast<Size>(indexProduct(size_) * sizeof(FileType));
     } else {
       // Load header of mask file
       char dummy[1024];
@@ -172,8 +461,7 @@ private:
           sstream.get();
         }
       }
-      size = static_cast<std::size_t>(indexProduct(size_)) *
-             sizeof(typename ImageStack::StorageType);
+      size = static_cast<std::size_t>(indexProduct(size_)) * sizeof(FileType);
     }
     // set start of data
     istream_->seekg(-static_cast<long>(size), std::ios_base::end);
@@ -183,12 +471,22 @@ private:
     Ensures(istream_->tellg() - startOfDtata_ == static_cast<long>(size) &&
             "Size mismatch");
 
+    if (extent_.isZero()) extent_ = size_;
+    if (((origin_ + extent_).array() > size_.array()).any())
+      throw std::out_of_range("Region exceeds the volume of file '" +
+                              filename_ + "'");
+
     state_ = State::HeaderRead;
   }
 
   Eigen::Vector3d resolution_{Eigen::Vector3d::Zero()};
+  double scale_{1.0};
+  double offset_{0.0};
   Size3 size_{Size3::Zero()};
+  Index3 origin_{Index3::Zero()};
+  Size3 extent_{Size3::Zero()};
   State state_{State::Initialized};
+  std::string filename_;
   std::unique_ptr<std::ifstream> istream_;
   std::istream::pos_type startOfDtata_;
 };
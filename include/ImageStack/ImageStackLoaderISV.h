@@ -0,0 +1,240 @@
+#pragma once
+
+#include "ISVFormat.h"
+#include "ImageStackLoader.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Loader class for ImageStack for loading bricked, compressed .isv
+/// files
+///
+/// The whole volume is loaded by decompressing all bricks in parallel, each
+/// thread reading from its own stream. Single bricks can be loaded on demand
+/// using @c readBrick().
+///
+/// Unit tests are in \ref testISV.cpp
+///
+/// @tparam ImageStack_ ImageStack type to load the data for
+template <class ImageStack_>
+class ImageStackLoaderISV
+    : public ImageStackLoaderBase<ImageStackLoaderISV<ImageStack_>> {
+public:
+  using ImageStack = ImageStack_;
+  /// @brief Type of the voxels as stored in the file
+  using FileType = typename ImageStack::StorageType;
+
+  /// @brief Create a loader object for the given filename and read the header
+  /// and brick index
+  /// @param filename path to the file to load
+  /// @throw std::runtime_error if the file could not be opened, is not a valid
+  /// .isv file or stores a different voxel type
+  explicit ImageStackLoaderISV(std::string filename)
+      : filename_(std::move(filename)) {
+    std::ifstream in(filename_, std::ios_base::in | std::ios_base::binary);
+
+    if (!in) throw std::runtime_error("Failed to open file '" + filename_ + "'");
+
+    header_.read(in);
+    if (header_.typeCode != detail::isvTypeCode<FileType>())
+      throw std::runtime_error("Voxel type of file '" + filename_ +
+                               "' does not match");
+
+    auto const n = header_.numBricks();
+    offsets_.resize(n);
+    sizes_.resize(n);
+    for (Size i = 0; i < n; ++i) {
+      offsets_[i] = detail::readLE<std::uint64_t>(in);
+      sizes_[i] = detail::readLE<std::uint64_t>(in);
+    }
+
+    in.seekg(0, std::ios_base::end);
+    if (!in || !validIndex(static_cast<std::uint64_t>(in.tellg())))
+      throw std::runtime_error("Corrupt brick index in file '" + filename_ +
+                               "'");
+  }
+
+  /// @brief Returns the path of the file to be read
+  inline std::string const &filename() const noexcept { return filename_; }
+
+  /// @brief Returns the size of the image to be read
+  /// @return 3D size of the object to be loaded, the return type is a model of
+  ///  \ref MultiIndexConcept
+  inline auto size() const noexcept { return header_.size; }
+
+  /// @brief Returns the resolution in mm of the file to be read
+  inline auto resolution() const noexcept { return header_.resolution; }
+
+  /// @brief Returns the size of a brick
+  inline Size3 brickSize() const noexcept { return header_.brickSize; }
+
+  /// @brief Returns the number of bricks in each dimension
+  inline Size3 gridSize() const { return header_.gridSize(); }
+
+  /// @brief Returns the index of the first voxel of the given brick
+  inline Index3 brickOrigin(Index3 const &brick) const {
+    return header_.brickOrigin(brick);
+  }
+
+  /// @brief Returns the size of the given brick, clipped to the volume
+  inline Size3 brickExtent(Index3 const &brick) const {
+    return header_.brickExtent(brick);
+  }
+
+  /// @brief Read a single brick
+  /// @tparam T data type to read, must equal @c FileType
+  /// @param brick index of the brick inside the brick grid
+  /// @param out pointer to the first element of the destination, must be able
+  /// to hold `indexProduct(brickExtent(brick))` elements. The voxels are
+  /// stored x fastest, then y, then z.
+  /// @throw std::runtime_error if the brick could not be read
+  template <class T> void readBrick(Index3 const &brick, T *out) const {
+    static_assert(std::is_same<T, FileType>::value,
+                  "T must match the file type");
+    Expects((brick.array() < gridSize().array()).all());
+
+    std::ifstream in(filename_, std::ios_base::in | std::ios_base::binary);
+    if (!in) throw std::runtime_error("Failed to open file '" + filename_ + "'");
+
+    std::vector<std::uint8_t> buffer;
+    readBrick(in, toLinear(brick, gridSize()), buffer, out);
+  }
+
+  /// @brief Read the data from the file into the given output iterator
+  /// @tparam T data type to read
+  /// @tparam OutIter output iterator
+  /// @param out output iterator where the read data goes
+  /// @throw std::runtime_error if the file could not be read
+  template <class T, class OutIter> void readData(OutIter out) const {
+    std::vector<T> data(indexProduct(size()));
+    readData<T>(data.data());
+    std::copy(data.cbegin(), data.cend(), out);
+  }
+
+  /// @brief Read the data from the file into the given contiguous memory
+  /// region, decompressing the bricks in parallel
+  /// @tparam T data type to read, must equal @c FileType
+  /// @param out pointer to the first element of the destination, must be able
+  /// to hold `indexProduct(size())` elements
+  /// @throw std::runtime_error if the file could not be read
+  template <class T> void readData(T *out) const {
+    static_assert(std::is_same<T, FileType>::value,
+                  "T must match the file type");
+
+    auto const grid = gridSize();
+    auto const n = narrow<long>(header_.numBricks());
+    std::exception_ptr error;
+
+#pragma omp parallel
+    {
+      std::ifstream in(filename_, std::ios_base::in | std::ios_base::binary);
+      std::vector<std::uint8_t> buffer;
+      std::vector<T> brickData(indexProduct(brickSize()));
+
+#pragma omp for schedule(dynamic)
+      for (long b = 0; b < n; ++b) {
+        try {
+          if (!in)
+            throw std::runtime_error("Failed to open file '" + filename_ +
+                                     "'");
+
+          auto const i = static_cast<Size>(b);
+          Index3 const brick(i % grid[0], (i / grid[0]) % grid[1],
+                             i / (grid[0] * grid[1]));
+          readBrick(in, i, buffer, brickData.data());
+          scatter(brick, brickData.data(), out);
+        } catch (...) {
+#pragma omp critical
+          error = std::current_exception();
+        }
+      }
+    }
+
+    if (error) std::rethrow_exception(error);
+  }
+
+  /// @brief Same as readData(T *), the bricks are always decompressed in
+  /// parallel
+  template <class T> void readData(T *out, ParallelTag) const {
+    readData<T>(out);
+  }
+
+private:
+  /// @brief Returns true if each brick lies inside of a file of the given
+  /// size, after the index, and is not larger than its raw data
+  ///
+  /// Bricks that do not compress are stored raw, so no valid brick is larger
+  /// than its raw data.
+  bool validIndex(std::uint64_t fileSize) const {
+    auto const grid = gridSize();
+    auto const dataStart = static_cast<std::uint64_t>(
+        ISVHeader::kSize + offsets_.size() * ISVHeader::kIndexEntrySize);
+    for (Size b = 0; b < offsets_.size(); ++b) {
+      Index3 const brick(b % grid[0], (b / grid[0]) % grid[1],
+                         b / (grid[0] * grid[1]));
+      auto const rawBytes = static_cast<std::uint64_t>(
+          indexProduct(brickExtent(brick)) * sizeof(FileType));
+      if (sizes_[b] == 0 || sizes_[b] > rawBytes || offsets_[b] < dataStart ||
+          offsets_[b] > fileSize || sizes_[b] > fileSize - offsets_[b])
+        return false;
+    }
+    return true;
+  }
+
+  /// @brief Reads and decompresses the brick with the given linear index
+  template <class T>
+  void readBrick(std::istream &in, Size b, std::vector<std::uint8_t> &buffer,
+                 T *out) const {
+    auto const grid = gridSize();
+    Index3 const brick(b % grid[0], (b / grid[0]) % grid[1],
+                       b / (grid[0] * grid[1]));
+    auto const n = indexProduct(brickExtent(brick));
+    auto const rawBytes = n * sizeof(T);
+
+    buffer.resize(narrow<Size>(sizes_[b]));
+    in.seekg(static_cast<std::streamoff>(offsets_[b]));
+    in.read(reinterpret_cast<char *>(buffer.data()),
+            static_cast<std::streamsize>(buffer.size()));
+    if (static_cast<Size>(in.gcount()) != buffer.size())
+      throw std::runtime_error("Unexpected end of file '" + filename_ + "'");
+
+    if (buffer.size() == rawBytes) {
+      std::copy_n(buffer.data(), rawBytes, reinterpret_cast<std::uint8_t *>(out));
+    } else {
+      ISVCodec::decompress(buffer.data(), buffer.size(), out, n, sizeof(T));
+    }
+    convertByteOrder(out, n, Endianness::LittleEndian);
+  }
+
+  /// @brief Copies the rows of a brick to their position inside the volume
+  template <class T>
+  void scatter(Index3 const &brick, T const *src, T *out) const {
+    auto const origin = brickOrigin(brick);
+    auto const extent = brickExtent(brick);
+    for (Size z = 0; z < extent[2]; ++z) {
+      for (Size y = 0; y < extent[1]; ++y, src += extent[0]) {
+        std::copy_n(src, extent[0],
+                    out + toLinear(Index3(origin + Index3(0, y, z)), size()));
+      }
+    }
+  }
+
+  std::string filename_;
+  ISVHeader header_;
+  std::vector<std::uint64_t> offsets_;
+  std::vector<std::uint64_t> sizes_;
+};
+
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
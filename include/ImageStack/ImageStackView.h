@@ -0,0 +1,239 @@
+#pragma once
+
+#include "HostStorage.h"
+#include "ImageStack.h"
+#include "MappedStridedMemory.h"
+#include "OriginDecorator.h"
+#include "ResolutionDecorator.h"
+#include "Types.h"
+
+#include <type_traits>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Non-owning storage referring to a strided region of another
+/// storage
+///
+/// Copying the storage copies the reference, not the voxels. The referenced
+/// storage must outlive the view.
+///
+/// Unit tests are in \ref testImageStackView.cpp
+/// @tparam T type of stored elements
+template <class T> class ViewStorage {
+public:
+  using ValueType = T;
+  using Pointer = T *;
+  using ConstPointer = T const *;
+
+  /// @brief Creates a view of the given mapping
+  inline explicit ViewStorage(MappedStridedMemory<T> const &memory) noexcept
+      : memory_(memory) {}
+
+  /// @brief Returns the size of the viewed region
+  inline Size3 size() const noexcept { return memory_.extent(); }
+
+  /// @brief Returns the number of voxels of the viewed region
+  inline Size linearSize() const noexcept { return memory_.linearSize(); }
+
+  /// @brief Returns true if the viewed region is empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+  /// @brief Returns a mapping of the viewed region
+  inline auto map() noexcept { return memory_; }
+
+  /// @brief Returns a const mapping of the viewed region
+  inline auto map() const noexcept {
+    return MappedStridedMemory<T const>(memory_);
+  }
+
+private:
+  MappedStridedMemory<T> memory_;
+};
+
+/// @brief Non-owning read only storage referring to a strided region of
+/// another storage
+///
+/// Same as ViewStorage, but both @c map() overloads return const mappings.
+/// @tparam T type of stored elements
+template <class T> class ConstViewStorage {
+public:
+  using ValueType = T;
+  using Pointer = T const *;
+  using ConstPointer = T const *;
+
+  /// @brief Creates a view of the given mapping
+  inline explicit ConstViewStorage(
+      MappedStridedMemory<T const> const &memory) noexcept
+      : memory_(memory) {}
+
+  /// @brief Returns the size of the viewed region
+  inline Size3 size() const noexcept { return memory_.extent(); }
+
+  /// @brief Returns the number of voxels of the viewed region
+  inline Size linearSize() const noexcept { return memory_.linearSize(); }
+
+  /// @brief Returns true if the viewed region is empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+  /// @brief Returns a const mapping of the viewed region
+  inline auto map() const noexcept { return memory_; }
+
+private:
+  MappedStridedMemory<T const> memory_;
+};
+#pragma clang diagnostic pop
+
+template <> struct IsHostStorage<ViewStorage> : public std::true_type {};
+
+template <> struct IsHostStorage<ConstViewStorage> : public std::true_type {};
+
+/// @brief Mutable view of (a part of) an image stack
+template <class T, class... Decorators>
+using ImageStackView = ImageStack<T, ViewStorage, Decorators...>;
+
+/// @brief Read only view of (a part of) an image stack
+template <class T, class... Decorators>
+using ConstImageStackView = ImageStack<T, ConstViewStorage, Decorators...>;
+
+namespace detail {
+
+template <class T>
+inline auto toStrided(MappedHostMemory<T, 3> const &memory) {
+  return MappedStridedMemory<T>(memory);
+}
+
+template <class T>
+inline auto toStrided(MappedStridedMemory<T> const &memory) {
+  return memory;
+}
+
+/// @brief True if views of @c Img can be created, i.e. its storage is
+/// mapped to linear or strided host memory
+template <class Img, typename = void>
+struct IsViewable : public std::false_type {};
+
+template <class Img>
+struct IsViewable<Img, decltype(toStrided(std::declval<Img &>().map()),
+                                void())> : public std::true_type {};
+
+template <class T, template <class> class S, class... Decorators>
+inline auto makeView(ImageStack<T, S, Decorators...> const &img,
+                     MappedStridedMemory<T> const &memory) {
+  return ImageStackView<T, Decorators...>(
+      ViewStorage<T>(memory), static_cast<Decorators const &>(img)...);
+}
+
+template <class T, template <class> class S, class... Decorators>
+inline auto makeView(ImageStack<T, S, Decorators...> const &img,
+                     MappedStridedMemory<T const> const &memory) {
+  return ConstImageStackView<T, Decorators...>(
+      ConstViewStorage<T>(memory), static_cast<Decorators const &>(img)...);
+}
+
+template <class Img>
+inline void shiftOrigin(Img &img, Index3 const &offset, std::true_type) {
+  img.origin += offset;
+}
+
+template <class Img>
+inline void shiftOrigin(Img &, Index3 const &, std::false_type) {}
+
+template <class Img>
+inline void permuteOrigin(Img &img, Index3 const &axes, std::true_type) {
+  auto const origin = img.origin;
+  for (int d = 0; d < 3; ++d)
+    img.origin[d] = origin[narrow_cast<long>(axes[d])];
+}
+
+template <class Img>
+inline void permuteOrigin(Img &, Index3 const &, std::false_type) {}
+
+template <class Img>
+inline void permuteResolution(Img &img, Index3 const &axes, std::true_type) {
+  Eigen::Vector3d const resolution = img.resolution;
+  for (int d = 0; d < 3; ++d)
+    img.resolution[d] = resolution[narrow_cast<long>(axes[d])];
+}
+
+template <class Img>
+inline void permuteResolution(Img &, Index3 const &, std::false_type) {}
+
+template <class Img>
+inline void permuteDecorators(Img &img, Index3 const &axes) {
+  permuteOrigin(img, axes, HasDecorator<Img, OriginDecorator>{});
+  permuteResolution(img, axes, HasDecorator<Img, ResolutionDecorator>{});
+}
+
+template <class Img>
+inline void scaleResolution(Img &img, Size3 const &step, std::true_type) {
+  img.resolution = img.resolution.cwiseProduct(step.cast<double>());
+}
+
+template <class Img>
+inline void scaleResolution(Img &, Size3 const &, std::false_type) {}
+
+} // namespace detail
+
+/// @brief Returns a view of the whole image stack
+///
+/// A view of a const image stack is read only. All decorators are copied to
+/// the view.
+/// @pre `img.empty() == false`
+template <class Img,
+          typename = std::enable_if_t<detail::IsViewable<Img>::value>>
+inline auto view(Img &img) {
+  return detail::makeView(img, detail::toStrided(img.map()));
+}
+
+/// @brief Returns a view of the box of size @c size starting at @c origin
+///
+/// If the image stack has an OriginDecorator, the origin of the view is
+/// shifted by @c origin.
+/// @pre the box must be inside the image stack
+template <class Img,
+          typename = std::enable_if_t<detail::IsViewable<Img>::value>>
+inline auto subVolume(Img &img, Index3 const &origin, Size3 const &size) {
+  auto result = detail::makeView(
+      img, detail::toStrided(img.map()).subVolume(origin, size));
+  detail::shiftOrigin(result, origin,
+                      HasDecorator<decltype(result), OriginDecorator>{});
+  return result;
+}
+
+/// @brief Returns a view of the slice @c z, i.e. a stack of a single slice
+template <class Img,
+          typename = std::enable_if_t<detail::IsViewable<Img>::value>>
+inline auto slice(Img &img, Size z) {
+  auto const size = img.size();
+  return subVolume(img, Index3(0, 0, z), Size3(size[0], size[1], 1));
+}
+
+/// @brief Returns a view with permuted axes
+///
+/// Axis @c d of the view is axis @c axes[d] of the image stack, e.g.
+/// `{2, 1, 0}` swaps x and z. Origin and resolution are permuted as well.
+template <class Img,
+          typename = std::enable_if_t<detail::IsViewable<Img>::value>>
+inline auto permute(Img &img, Index3 const &axes) {
+  auto result =
+      detail::makeView(img, detail::toStrided(img.map()).permute(axes));
+  detail::permuteDecorators(result, axes);
+  return result;
+}
+
+/// @brief Returns a view of every @c step-th voxel along each axis
+///
+/// The resolution is multiplied by @c step.
+template <class Img,
+          typename = std::enable_if_t<detail::IsViewable<Img>::value>>
+inline auto subsample(Img &img, Size3 const &step) {
+  auto result =
+      detail::makeView(img, detail::toStrided(img.map()).subsample(step));
+  detail::scaleResolution(
+      result, step, HasDecorator<decltype(result), ResolutionDecorator>{});
+  return result;
+}
+
+} // namespace ImageStack
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "BinaryStream.h"
+#include "ByteSwap.h"
+#include "ResolutionDecorator.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <array>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Writer class for ImageStack for writing .bst files
+///
+/// Writes files in the format read by ImageStackLoaderBST. The voxel data is
+/// converted to big endian in blocks and streamed to the file, so writing
+/// never needs a second buffer of the size of the image.
+///
+/// Unit tests are in \ref testBSTWriter.cpp
+///
+/// @tparam ImageStack_ ImageStack type to write
+/// @tparam IsMask bool value indicating if the writer should write a mask
+///(true) or an image (false).
+template <class ImageStack_, bool IsMask = false> class ImageStackWriterBST {
+public:
+  using ImageStack = ImageStack_;
+  /// @brief Type of the voxels as stored in the file
+  using FileType = typename ImageStack::StorageType;
+
+  /// @brief Byte order of the voxel data in the file
+  static constexpr Endianness ByteOrder = Endianness::BigEndian;
+
+  /// @brief Create a writer object for the given filename
+  /// @param filename path to the file to write, an existing file is
+  /// overwritten
+  /// @throw std::runtime_error if the file could not be opened
+  explicit ImageStackWriterBST(std::string filename)
+      : filename_(std::move(filename)) {
+    auto out = std::make_unique<std::ofstream>(
+        filename_,
+        std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+    if (!*out)
+      throw std::runtime_error("Failed to open file '" + filename_ + "'");
+
+    ostream_ = std::move(out);
+  }
+
+  /// @brief Returns the path of the file to be written
+  inline std::string const &filename() const noexcept { return filename_; }
+
+  /// @brief Writes the given image using its resolution
+  ///
+  /// If the image has no ResolutionDecorator, a resolution of 1mm is written.
+  /// @param img image to write, must not be empty
+  /// @throw std::runtime_error if writing fails
+  void write(ImageStack const &img) { write(img, resolution(img)); }
+
+  /// @brief Writes the given image using the given resolution
+  /// @param img image to write, must not be empty
+  /// @param resolution resolution in mm to write to the header
+  /// @throw std::runtime_error if writing fails
+  void write(ImageStack const &img, Eigen::Vector3d const &resolution) {
+    Expects(!img.empty());
+
+    writeHeader(img.size(), resolution);
+    writeData(img.map());
+
+    ostream_->flush();
+    if (!*ostream_)
+      throw std::runtime_error("Failed to write file '" + filename_ + "'");
+  }
+
+private:
+  /// @brief Size of the blocks written at once in bytes
+  static constexpr std::size_t kBlockSize = 4 << 20;
+
+  template <class Size> void writeHeader(Size size, Eigen::Vector3d const &res) {
+    if (!IsMask) {
+      // xyz information, i.e. first and last index of each dimension
+      for (int i = 0; i < 3; ++i) {
+        writeBigEndian(std::int32_t{1});
+        writeBigEndian(narrow<std::int32_t>(size[i]));
+      }
+      // size
+      for (int i = 0; i < 3; ++i) writeBigEndian(narrow<std::int32_t>(size[i]));
+      // fuc
+      writeBigEndian(std::int32_t{1});
+      // resolution
+      static_assert(sizeof(double) == 8, "Unsupported double size.");
+      for (int i = 0; i < 3; ++i) writeBigEndian(res[i]);
+    } else {
+      std::array<char, 16> date;
+      auto const now = std::time(nullptr);
+      std::strftime(date.data(), date.size(), "%Y-%m-%d", std::localtime(&now));
+
+      std::ostringstream header;
+      // xyz
+      header << 1 << ';' << size[0] << ';' << 1 << ';' << size[1] << ';' << 1
+             << ';' << size[2] << '\n';
+      // size
+      header << size[0] << ';' << size[1] << ';' << size[2] << ";\n";
+      // measurement date
+      header << "Measurement date: " << date.data() << ";FUC: 1\n";
+      // resolution
+      header << std::fixed << std::setprecision(4) << res[0] << ';' << res[1]
+             << ';' << res[2] << '\n';
+
+      auto const str = header.str();
+      ostream_->write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+  }
+
+  /// @brief Writes the mapped data in blocks, converting each block to the
+  /// file byte order
+  template <class Map> void writeData(Map const &map) {
+    auto const n = static_cast<std::size_t>(map.linearSize());
+    std::vector<FileType> buffer(
+        std::min(n, std::max<std::size_t>(1, kBlockSize / sizeof(FileType))));
+
+    auto it = map.cbegin();
+    for (std::size_t i = 0; i < n; i += buffer.size()) {
+      auto const count = std::min(buffer.size(), n - i);
+      for (std::size_t j = 0; j < count; ++j, ++it)
+        buffer[j] = static_cast<FileType>(*it);
+      convertByteOrder(buffer.data(), count, ByteOrder);
+      ostream_->write(reinterpret_cast<char const *>(buffer.data()),
+                      static_cast<std::streamsize>(count * sizeof(FileType)));
+    }
+  }
+
+  template <class V> void writeBigEndian(V value) {
+    convertByteOrder(&value, 1, ByteOrder);
+    ostream_->write(reinterpret_cast<char const *>(&value), sizeof(V));
+  }
+
+  std::string filename_;
+  std::unique_ptr<std::ofstream> ostream_;
+};
+
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "ISVFormat.h"
+#include "Parallel.h"
+#include "ResolutionDecorator.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Writer class for ImageStack for writing bricked, compressed .isv
+/// files
+///
+/// The volume is split into bricks (see ISVFormat.h) which are compressed in
+/// parallel and streamed to the file, the brick index is written last.
+/// Files written by this class are read by ImageStackLoaderISV.
+///
+/// Unit tests are in \ref testISV.cpp
+///
+/// @tparam ImageStack_ ImageStack type to write
+template <class ImageStack_> class ImageStackWriterISV {
+public:
+  using ImageStack = ImageStack_;
+  /// @brief Type of the voxels as stored in the file
+  using FileType = typename ImageStack::StorageType;
+
+  /// @brief Create a writer object for the given filename
+  /// @param filename path to the file to write, an existing file is
+  /// overwritten
+  /// @param brickSize size of the bricks, must be greater than zero in each
+  /// dimension
+  /// @throw std::runtime_error if the file could not be opened
+  explicit ImageStackWriterISV(std::string filename,
+                               Size3 brickSize = Size3(32, 32, 32))
+      : filename_(std::move(filename)), brickSize_(std::move(brickSize)) {
+    Expects(brickSize_.minCoeff() > 0);
+
+    auto out = std::make_unique<std::ofstream>(
+        filename_,
+        std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+    if (!*out)
+      throw std::runtime_error("Failed to open file '" + filename_ + "'");
+
+    ostream_ = std::move(out);
+  }
+
+  /// @brief Returns the path of the file to be written
+  inline std::string const &filename() const noexcept { return filename_; }
+
+  /// @brief Returns the size of the bricks
+  inline Size3 brickSize() const noexcept { return brickSize_; }
+
+  /// @brief Writes the given image using its resolution
+  ///
+  /// If the image has no ResolutionDecorator, a resolution of 1mm is written.
+  /// @param img image to write, must not be empty
+  /// @throw std::runtime_error if writing fails
+  void write(ImageStack const &img) { write(img, resolution(img)); }
+
+  /// @brief Writes the given image using the given resolution
+  /// @param img image to write, must not be empty
+  /// @param resolution resolution in mm to write to the header
+  /// @throw std::runtime_error if writing fails
+  void write(ImageStack const &img, Eigen::Vector3d const &resolution) {
+    Expects(!img.empty());
+
+    ISVHeader header;
+    header.typeCode = detail::isvTypeCode<FileType>();
+    header.size = Size3(img.size()[0], img.size()[1], img.size()[2]);
+    header.resolution = resolution;
+    header.brickSize = brickSize_;
+
+    header.write(*ostream_);
+    // Placeholder for the brick index, written once all bricks are written
+    std::vector<std::uint64_t> offsets(header.numBricks());
+    std::vector<std::uint64_t> sizes(header.numBricks());
+    auto const index = ostream_->tellp();
+    writeIndex(offsets, sizes);
+
+    writeBricks(header, img.map(), offsets, sizes);
+
+    ostream_->seekp(index);
+    writeIndex(offsets, sizes);
+    ostream_->seekp(0, std::ios_base::end);
+
+    ostream_->flush();
+    if (!*ostream_)
+      throw std::runtime_error("Failed to write file '" + filename_ + "'");
+  }
+
+private:
+  /// @brief Writes the brick index
+  void writeIndex(std::vector<std::uint64_t> const &offsets,
+                  std::vector<std::uint64_t> const &sizes) {
+    for (Size i = 0; i < offsets.size(); ++i) {
+      detail::writeLE(*ostream_, offsets[i]);
+      detail::writeLE(*ostream_, sizes[i]);
+    }
+  }
+
+  /// @brief Gathers and compresses the bricks in parallel and writes them to
+  /// the file in order, storing their offsets and sizes
+  ///
+  /// The bricks are processed in batches of a few bricks per thread, so only
+  /// one batch of compressed bricks is held in memory.
+  template <class Map>
+  void writeBricks(ISVHeader const &header, Map const &map,
+                   std::vector<std::uint64_t> &offsets,
+                   std::vector<std::uint64_t> &sizes) {
+    auto const grid = header.gridSize();
+    auto const n = header.numBricks();
+    auto const batch = std::min(n, 4 * detail::maxThreads());
+    std::vector<std::vector<std::uint8_t>> bricks(batch);
+    auto offset = static_cast<std::uint64_t>(ostream_->tellp());
+    std::exception_ptr error;
+
+    for (Size first = 0; first < n; first += batch) {
+      auto const count = std::min(batch, n - first);
+
+#pragma omp parallel
+      {
+        std::vector<FileType> data(indexProduct(brickSize_));
+
+#pragma omp for schedule(dynamic)
+        for (long b = 0; b < narrow<long>(count); ++b) {
+          try {
+            auto const i = first + static_cast<Size>(b);
+            Index3 const brick(i % grid[0], (i / grid[0]) % grid[1],
+                               i / (grid[0] * grid[1]));
+            bricks[static_cast<Size>(b)] =
+                compressBrick(header, map, brick, data.data());
+          } catch (...) {
+#pragma omp critical
+            error = std::current_exception();
+          }
+        }
+      }
+
+      if (error) std::rethrow_exception(error);
+
+      for (Size b = 0; b < count; ++b) {
+        auto const &brick = bricks[b];
+        offsets[first + b] = offset;
+        sizes[first + b] = brick.size();
+        offset += brick.size();
+        ostream_->write(reinterpret_cast<char const *>(brick.data()),
+                        static_cast<std::streamsize>(brick.size()));
+      }
+    }
+  }
+
+  /// @brief Gathers the voxels of a brick into @c data and compresses them
+  template <class Map>
+  std::vector<std::uint8_t> compressBrick(ISVHeader const &header,
+                                          Map const &map, Index3 const &brick,
+                                          FileType *data) const {
+    auto const origin = header.brickOrigin(brick);
+    auto const extent = header.brickExtent(brick);
+    auto const count = indexProduct(extent);
+
+    auto *dst = data;
+    for (Size z = 0; z < extent[2]; ++z) {
+      for (Size y = 0; y < extent[1]; ++y) {
+        auto const start =
+            toLinear(Index3(origin + Index3(0, y, z)), header.size);
+        for (Size x = 0; x < extent[0]; ++x)
+          *dst++ = static_cast<FileType>(map[start + x]);
+      }
+    }
+    convertByteOrder(data, count, Endianness::LittleEndian);
+
+    auto compressed = ISVCodec::compress(data, count, sizeof(FileType));
+    if (compressed.empty()) {
+      auto const *raw = reinterpret_cast<std::uint8_t const *>(data);
+      compressed.assign(raw, raw + count * sizeof(FileType));
+    }
+    return compressed;
+  }
+
+  std::string filename_;
+  Size3 brickSize_;
+  std::unique_ptr<std::ofstream> ostream_;
+};
+
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
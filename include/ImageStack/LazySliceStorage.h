@@ -0,0 +1,406 @@
+#pragma once
+
+#include "HostStorage.h"
+#include "ImageStackLoader.h"
+#include "MultiIndex.h"
+#include "Types.h"
+
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ImageStack {
+
+/// @brief Counters of a cache
+struct CacheStatistics {
+  std::size_t hits{0};
+  std::size_t misses{0};
+  std::size_t evictions{0};
+};
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Thread safe LRU cache of decoded Z-slices with a bounded size in
+/// bytes
+///
+/// Slices are handed out as shared pointers, so a slice that is evicted while
+/// still in use stays valid until it is released. Missing slices are read
+/// without holding the lock of the cache, so threads missing different
+/// slices decode them concurrently.
+/// @tparam T type of the voxels
+template <class T> class SliceCache {
+public:
+  using Slice = std::shared_ptr<std::vector<T> const>;
+  /// @brief Function reading the slice with the given index into the given
+  /// memory, must be safe to call from multiple threads at once
+  using Reader = std::function<void(Size, T *)>;
+
+  /// @brief Creates a cache
+  /// @param sliceSize number of voxels per slice
+  /// @param capacity maximum number of bytes the cached slices may occupy. At
+  /// least one slice is always kept.
+  /// @param reader function used to read missing slices
+  SliceCache(Size sliceSize, Size capacity, Reader reader)
+      : sliceSize_(sliceSize), capacity_(capacity),
+        reader_(std::move(reader)) {}
+
+  /// @brief Returns the slice with the given index, reading it if it is not
+  /// cached
+  Slice slice(Size z) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto const it = index_.find(z);
+      if (it != index_.end()) {
+        ++statistics_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+      }
+      ++statistics_.misses;
+    }
+
+    auto data = std::make_shared<std::vector<T>>(sliceSize_);
+    reader_(z, data->data());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another thread might have read the same slice in the meantime
+    auto const it = index_.find(z);
+    if (it != index_.end()) return it->second->second;
+
+    lru_.emplace_front(z, std::move(data));
+    index_.emplace(z, lru_.begin());
+    evict();
+
+    return lru_.front().second;
+  }
+
+  /// @brief Returns a copy of the hit, miss and eviction counters
+  CacheStatistics statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+  }
+
+  /// @brief Resets the hit, miss and eviction counters
+  void resetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_ = CacheStatistics{};
+  }
+
+  /// @brief Returns the maximum number of bytes occupied by cached slices
+  Size capacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+  }
+
+  /// @brief Sets the maximum number of bytes occupied by cached slices,
+  /// evicting slices if necessary
+  void setCapacity(Size capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evict();
+  }
+
+  /// @brief Returns the number of cached slices
+  Size numCachedSlices() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+  }
+
+  /// @brief Removes all slices from the cache
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+  }
+
+private:
+  using Entry = std::pair<Size, Slice>;
+
+  /// @brief Evicts least recently used slices until the cache fits into its
+  /// capacity
+  /// @pre @c mutex_ is locked
+  void evict() {
+    auto const sliceBytes = sliceSize_ * sizeof(T);
+    while (lru_.size() > 1 && lru_.size() * sliceBytes > capacity_) {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+      ++statistics_.evictions;
+    }
+  }
+
+  Size sliceSize_;
+  Size capacity_;
+  Reader reader_;
+  std::list<Entry> lru_;
+  std::unordered_map<Size, typename std::list<Entry>::iterator> index_;
+  CacheStatistics statistics_;
+  mutable std::mutex mutex_;
+};
+
+namespace detail {
+
+/// @brief Pool of loaders of the same file
+///
+/// Loaders keep the position of their stream, so they can not be used by
+/// multiple threads at once. The pool hands out an idle loader to each
+/// caller of @c use() and creates a new one if all are in use, so there are
+/// at most as many loaders as threads reading concurrently.
+/// @tparam Loader loader type
+template <class Loader> class LoaderPool {
+public:
+  using Factory = std::function<std::unique_ptr<Loader>()>;
+
+  explicit LoaderPool(Factory create) : create_(std::move(create)) {}
+
+  /// @brief Calls @c f with a loader that no other thread uses meanwhile
+  template <class F> void use(F &&f) {
+    std::unique_ptr<Loader> loader;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        loader = std::move(idle_.back());
+        idle_.pop_back();
+      }
+    }
+    if (!loader) loader = create_();
+
+    // A loader that threw is dropped, its stream might be in a failed state
+    f(*loader);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(loader));
+  }
+
+private:
+  Factory create_;
+  std::vector<std::unique_ptr<Loader>> idle_;
+  std::mutex mutex_;
+};
+
+} // namespace detail
+
+/// @brief Read only mapping of a LazySliceStorage
+///
+/// Elements are returned by value, slices are read on first access.
+/// @tparam T type of stored elements
+template <class T> class MappedLazySlices {
+  using Cache = SliceCache<T>;
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  /// @brief Forward iterator over all voxels in linear order
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T const *;
+    using reference = T const &;
+
+    const_iterator() = default;
+
+    inline reference operator*() const {
+      if (!slice_) slice_ = cache_->slice(pos_ / sliceSize_);
+      return (*slice_)[pos_ % sliceSize_];
+    }
+
+    inline pointer operator->() const { return &**this; }
+
+    inline const_iterator &operator++() {
+      if (++pos_ % sliceSize_ == 0) slice_.reset();
+      return *this;
+    }
+
+    inline const_iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    inline bool operator==(const_iterator const &other) const noexcept {
+      return pos_ == other.pos_;
+    }
+
+    inline bool operator!=(const_iterator const &other) const noexcept {
+      return pos_ != other.pos_;
+    }
+
+  private:
+    friend class MappedLazySlices;
+
+    const_iterator(Cache *cache, Size sliceSize, Size pos)
+        : cache_(cache), sliceSize_(sliceSize), pos_(pos) {}
+
+    Cache *cache_{nullptr};
+    Size sliceSize_{1};
+    Size pos_{0};
+    mutable typename Cache::Slice slice_;
+  };
+
+  using iterator = const_iterator;
+
+  MappedLazySlices(std::shared_ptr<Cache> cache, Size3 const &size)
+      : cache_(std::move(cache)), size_(size) {}
+
+  /// @brief Access the mapped memory using a multi index
+  /// @tparam Idx model of \ref MultiIndexConcept
+  /// @param i multi index
+  /// @return copy of the element at @c i
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T operator[](Idx const &i) const {
+    auto const linIdx = toLinear(i, size_);
+    Expects(linIdx < linearSize());
+
+    auto const sliceSize = size_[0] * size_[1];
+    return (*cache_->slice(linIdx / sliceSize))[linIdx % sliceSize];
+  }
+
+  /// @brief Returns the linear size of the mapped volume
+  inline size_type linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns the size of the mapped volume
+  inline auto size() const noexcept {
+    return std::array<size_type, 3>{{size_[0], size_[1], size_[2]}};
+  }
+
+  inline const_iterator begin() const noexcept { return cbegin(); }
+  inline const_iterator end() const noexcept { return cend(); }
+  inline const_iterator cbegin() const noexcept {
+    return const_iterator(cache_.get(), size_[0] * size_[1], 0);
+  }
+  inline const_iterator cend() const noexcept {
+    return const_iterator(cache_.get(), size_[0] * size_[1], linearSize());
+  }
+
+  /// @brief Returns the slice cache backing the mapping, e.g. to query its
+  /// statistics or to change its capacity
+  inline Cache &cache() const noexcept { return *cache_; }
+
+private:
+  std::shared_ptr<Cache> cache_;
+  Size3 size_;
+};
+
+/// @brief Class representing a 3D data storage that reads Z-slices on demand
+///
+/// When constructed from a loader, no voxel data is read up front. Slices are
+/// read and decoded on first access through @c map() (and thus through a
+/// Sampler) and kept in a bounded LRU cache. This makes opening a volume
+/// almost free, which allows keeping many volumes open at once.
+///
+/// The storage is read only, @c map() always returns a read only mapping.
+/// Copies share the cache.
+///
+/// Unit tests are in \ref testLazySliceStorage.cpp
+/// @tparam T type of stored elements
+template <class T> class LazySliceStorage {
+public:
+  using ValueType = T;
+
+  /// @brief Default cache capacity in bytes
+  static constexpr Size kDefaultCacheCapacity = Size{64} << 20;
+
+  /// @brief Create a storage with all voxels set to a default constructed
+  /// value
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of the storage
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline explicit LazySliceStorage(Size size) : LazySliceStorage(size, T{}) {}
+
+  /// @brief Create a storage with all voxels set to the given value
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of the storage
+  /// @param init value of all voxels
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline LazySliceStorage(Size size, T const &init)
+      : size_(size[0], size[1], size[2]) {
+    if (empty()) return;
+
+    auto const sliceSize = size_[0] * size_[1];
+    cache_ = std::make_shared<SliceCache<T>>(
+        sliceSize, kDefaultCacheCapacity,
+        [sliceSize, init](::ImageStack::Size, T *out) {
+          std::fill_n(out, sliceSize, init);
+        });
+  }
+
+  /// @brief Create a storage reading its slices on demand from the file the
+  /// given loader points to
+  ///
+  /// The storage opens its own loaders for the same file and region, one per
+  /// thread reading concurrently, so @c loader does not need to outlive the
+  /// storage.
+  /// @tparam Loader loader type, must provide @c filename(), @c origin(),
+  /// @c size(), @c scale(), @c offset(), @c setScaling(), @c readSlices() and
+  /// a (filename, origin, extent) constructor
+  /// @param loader loader to get the file and region from
+  /// @param capacity capacity of the slice cache in bytes
+  template <class Loader, typename = std::enable_if_t<isLoader_v<Loader>>>
+  inline explicit LazySliceStorage(Loader &loader,
+                                   Size capacity = kDefaultCacheCapacity)
+      : size_(loader.size()) {
+    Expects(!empty());
+
+    using Source = std::decay_t<Loader>;
+    auto pool = std::make_shared<detail::LoaderPool<Source>>(
+        [filename = loader.filename(), origin = loader.origin(),
+         extent = loader.size(), scale = loader.scale(),
+         offset = loader.offset()]() {
+          auto source = std::make_unique<Source>(filename, origin, extent);
+          source->setScaling(scale, offset);
+          return source;
+        });
+    cache_ = std::make_shared<SliceCache<T>>(
+        size_[0] * size_[1], capacity, [pool](Size z, T *out) {
+          pool->use([z, out](Source &source) {
+            source.template readSlices<T>(z, 1, out);
+          });
+        });
+  }
+
+  /// @brief Returns the size of the storage
+  /// @return an instance of a model of \ref MultiIndexConcept represening the
+  /// size in each dimension
+  inline auto size() const noexcept { return size_; }
+
+  /// @brief Returns the linear size of the storage, i.e. the product of the
+  /// size of each dimension
+  /// @return linear size
+  inline Size linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns a read only mapping of the storage
+  /// @pre The storage object must not be empty
+  /// @return MappedLazySlices object representing the mapping
+  inline auto map() const noexcept {
+    Expects(!empty());
+    return MappedLazySlices<T>(cache_, size_);
+  }
+
+  /// @brief Returns true if the the storage is empty
+  /// @return true if empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+private:
+  Size3 size_;
+  std::shared_ptr<SliceCache<T>> cache_;
+};
+#pragma clang diagnostic pop
+
+template <class T> constexpr Size LazySliceStorage<T>::kDefaultCacheCapacity;
+
+/// LazySliceStorage can be read like host memory, but not written: its
+/// mappings return voxels by value. Writing functions reject it, see
+/// detail::IsWritableMapping.
+template <> struct IsHostStorage<LazySliceStorage> : public std::true_type {};
+
+} // namespace ImageStack
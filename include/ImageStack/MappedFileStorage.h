@@ -0,0 +1,157 @@
+#pragma once
+
+#include "ByteSwap.h"
+#include "HostStorage.h"
+#include "ImageStackLoader.h"
+#include "MappedMemory.h"
+#include "MemoryMap.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Class representing a 3D data storage backed by a memory mapped file
+///
+/// When constructed from a loader, the voxel data of the file is mapped
+/// directly into the address space instead of being copied. If the byte order
+/// of the file matches the host byte order (or the voxels are single bytes),
+/// @c map() is served straight from the page cache and the pages are shared
+/// with every other process mapping the same file. Otherwise the data is
+/// converted in place, which makes the touched pages private to this storage.
+///
+/// Writing to the mapping never modifies the file, pages are copied on
+/// write. When constructed from a size only, an anonymous mapping is used.
+///
+/// Unit tests are in \ref testMappedFileStorage.cpp
+/// @tparam T type of stored elements
+/// @note Only available on POSIX platforms.
+template <class T> class MappedFileStorage {
+public:
+  using ValueType = T;
+  using Pointer = T *;
+  using ConstPointer = T const *;
+
+  /// @brief Create storage backed by an anonymous, zero initialized mapping
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of storage to be allocated
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline explicit MappedFileStorage(Size size)
+      : size_(size[0], size[1], size[2]),
+        mapping_(MemoryMap::anonymous(indexProduct(size_) * sizeof(T))) {}
+
+  /// @brief Create storage backed by an anonymous mapping and initialize it
+  /// with the given value
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of storage to be allocated
+  /// @param init value to initialize the memory with
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline MappedFileStorage(Size size, T const &init) : MappedFileStorage(size) {
+    std::fill_n(data(), linearSize(), init);
+  }
+
+  /// @brief Create storage by mapping the voxel data of the file the given
+  /// loader points to
+  /// @tparam Loader loader type, must provide @c filename(), @c dataOffset(),
+  /// @c size(), @c hasRegion(), @c isIdentity(), @c FileType and
+  /// @c ByteOrder. @c FileType must equal @c T, otherwise ImageStack lets the
+  /// loader convert the data while reading.
+  /// @note If the loader only reads a region of the file or scales the voxels,
+  /// or if the data offset is not a multiple of `alignof(T)` (e.g. after the
+  /// text header of a mask), the data is read into an anonymous mapping
+  /// instead.
+  /// @param loader loader to get the file layout from
+  template <class Loader,
+            typename = std::enable_if_t<
+                isLoader_v<Loader> &&
+                std::is_same<typename Loader::FileType, T>::value>>
+  inline explicit MappedFileStorage(Loader &loader) : size_(loader.size()) {
+    Expects(linearSize() > 0);
+
+    // Only a region is requested, its rows are not contiguous in the file,
+    // the voxels have to be scaled or they would be misaligned
+    if (loader.hasRegion() || !loader.template isIdentity<T>() ||
+        loader.dataOffset() % alignof(T) != 0) {
+      mapping_ = MemoryMap::anonymous(linearSize() * sizeof(T));
+      loader.template readData<T>(data());
+      return;
+    }
+
+    mapping_ = MemoryMap::privateFile(loader.filename(), loader.dataOffset(),
+                                      linearSize() * sizeof(T));
+
+    if (sizeof(T) > 1 && Loader::ByteOrder != hostByteOrder()) {
+      swapBytes(data(), linearSize());
+    } else {
+      zeroCopy_ = true;
+    }
+  }
+
+  inline MappedFileStorage(MappedFileStorage const &other)
+      : MappedFileStorage(other.size_) {
+    if (!empty())
+      std::memcpy(mapping_.data(), other.mapping_.data(), mapping_.size());
+  }
+
+  inline MappedFileStorage &operator=(MappedFileStorage const &other) {
+    if (this != &other) *this = MappedFileStorage(other);
+    return *this;
+  }
+
+  MappedFileStorage(MappedFileStorage &&) noexcept = default;
+  MappedFileStorage &operator=(MappedFileStorage &&) noexcept = default;
+
+  /// @brief Returns the size of the storage
+  /// @return an instance of a model of \ref MultiIndexConcept represening the
+  /// size in each dimension
+  inline auto size() const noexcept { return size_; }
+
+  /// @brief Returns the linear size of the storage, i.e. the product of the
+  /// size of each dimension
+  /// @return linear size
+  inline Size linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns true if the storage shares its pages with the page cache,
+  /// i.e. the file content was not converted while mapping
+  inline bool zeroCopy() const noexcept { return zeroCopy_; }
+
+  /// @brief Maps to storage to host memory and returs a memory mapping
+  /// object
+  /// @pre The storage object must not be empty
+  /// @return MappedHostMemory object representing the mapping
+  inline auto map() noexcept {
+    Expects(!empty());
+    return MappedHostMemory<T, 3>(not_null<Pointer>(data()), size_);
+  }
+
+  /// @brief Maps to storage to host memory and returs a const memory mapping
+  /// object
+  /// @return const MappedHostMemory object representing the mapping
+  inline auto map() const noexcept {
+    return MappedHostMemory<T const, 3>(not_null<ConstPointer>(data()), size_);
+  }
+
+  /// @brief Returns true if the the storage is empty, i.e. no memory is
+  /// mapped
+  /// @return true if empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+private:
+  inline Pointer data() const noexcept {
+    return static_cast<Pointer>(mapping_.data());
+  }
+
+  Size3 size_;
+  MemoryMap mapping_;
+  bool zeroCopy_{false};
+};
+#pragma clang diagnostic pop
+
+template <> struct IsHostStorage<MappedFileStorage> : public std::true_type {};
+
+} // namespace ImageStack
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <ImageStack/MappedMemory.h>
+#include <ImageStack/MultiIndex.h>
+#include <ImageStack/Types.h>
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Non-owning 3D mapping with arbitrary strides
+///
+/// A strided mapping describes a sub-volume, a slice, an axis permutation or
+/// a subsampling of another mapping without copying. The voxel at `(x, y, z)`
+/// is located at `base() + x * strides()[0] + y * strides()[1] +
+/// z * strides()[2]`.
+///
+/// Multi index access and iteration work in logical (x-fastest) order, like
+/// MappedHostMemory. A linear index passed to @c operator[] refers to the
+/// logical order as well.
+///
+/// The mapped memory must outlive the mapping.
+///
+/// Test cases are in \ref testImageStackView.cpp
+///
+/// @tparam T type of elements stored in the memory region, const qualified
+/// for read only mappings
+template <class T> class MappedStridedMemory {
+  template <class V> class Iterator;
+
+public:
+  using value_type = T;
+  using reference = T &;
+  using const_reference = T const &;
+  using iterator = Iterator<T>;
+  using const_iterator = Iterator<T const>;
+  using difference_type = std::ptrdiff_t;
+  using size_type = std::size_t;
+  using pointer = T *;
+  using const_pointer = T const *;
+  using Strides = Eigen::Matrix<std::ptrdiff_t, 3, 1>;
+
+  /// @brief Creates a strided mapping
+  /// @param base pointer to the voxel at `(0, 0, 0)`
+  /// @param size size of the mapped volume
+  /// @param strides distance between neighboring voxels along each axis in
+  /// elements
+  inline MappedStridedMemory(not_null<T *> base, Size3 const &size,
+                             Strides const &strides) noexcept
+      : base_(base.get()), size_(size), strides_(strides) {}
+
+  /// @brief Creates a strided mapping of a contiguous mapping
+  template <class U,
+            typename = std::enable_if_t<std::is_convertible<U *, T *>::value>>
+  inline explicit MappedStridedMemory(MappedHostMemory<U, 3> const &memory)
+      : MappedStridedMemory(
+            not_null<T *>(const_cast<U *>(memory.data())),
+            Size3(memory.size()[0], memory.size()[1], memory.size()[2]),
+            Strides(1, narrow<std::ptrdiff_t>(memory.size()[0]),
+                    narrow<std::ptrdiff_t>(memory.size()[0] *
+                                           memory.size()[1]))) {}
+
+  /// @brief Converts a mutable mapping to a read only mapping
+  template <class U,
+            typename = std::enable_if_t<!std::is_same<U, T>::value &&
+                                        std::is_convertible<U *, T *>::value>>
+  inline MappedStridedMemory(MappedStridedMemory<U> const &other) noexcept
+      : base_(other.base()), size_(other.extent()), strides_(other.strides()) {
+  }
+
+  /// @brief Const access the mapped memory using a multi index or a linear
+  /// index in logical order
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T const &operator[](Idx const &i) const {
+    return base_[offset(i)];
+  }
+
+  /// @brief Access the mapped memory using a multi index or a linear index in
+  /// logical order
+  template <class Idx,
+            typename = std::enable_if_t<isModelOfMultiIndex_v<Idx> ||
+                                        std::is_convertible<Idx, Size>::value>>
+  inline T &operator[](Idx const &i) {
+    return base_[offset(i)];
+  }
+
+  /// @brief Returns the number of mapped voxels
+  inline size_type linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns the size of the mapped volume
+  inline auto size() const noexcept {
+    return std::array<size_type, 3>{{size_[0], size_[1], size_[2]}};
+  }
+
+  /// @brief Returns the size of the mapped volume as Size3
+  inline Size3 const &extent() const noexcept { return size_; }
+
+  /// @brief Returns the distance between neighboring voxels along each axis
+  inline Strides const &strides() const noexcept { return strides_; }
+
+  /// @brief Returns a pointer to the voxel at `(0, 0, 0)`
+  inline T *base() const noexcept { return base_; }
+
+  /// @brief Returns true if the voxels are stored contiguously in logical
+  /// order, i.e. the mapping can be used like a MappedHostMemory
+  inline bool isContiguous() const noexcept {
+    return strides_[0] == 1 &&
+           strides_[1] == narrow_cast<std::ptrdiff_t>(size_[0]) &&
+           strides_[2] == narrow_cast<std::ptrdiff_t>(size_[0] * size_[1]);
+  }
+
+  /// @brief Returns a mapping of the box of size @c size starting at
+  /// @c origin
+  /// @pre the box must be inside the mapped volume
+  inline MappedStridedMemory subVolume(Index3 const &origin,
+                                       Size3 const &size) const {
+    Expects(((origin + size).array() <= size_.array()).all());
+    return MappedStridedMemory(not_null<T *>(base_ + offset(origin)), size,
+                               strides_);
+  }
+
+  /// @brief Returns a mapping of the slice @c z, i.e. a volume with a single
+  /// slice
+  inline MappedStridedMemory slice(Size z) const {
+    return subVolume(Index3(0, 0, z), Size3(size_[0], size_[1], 1));
+  }
+
+  /// @brief Returns a mapping with permuted axes
+  ///
+  /// Axis @c d of the returned mapping is axis @c axes[d] of this mapping,
+  /// e.g. `{2, 1, 0}` swaps x and z.
+  /// @pre @c axes must be a permutation of `{0, 1, 2}`
+  inline MappedStridedMemory permute(Index3 const &axes) const {
+    Expects((axes.array() < 3).all() && axes[0] != axes[1] &&
+            axes[0] != axes[2] && axes[1] != axes[2]);
+    Size3 size;
+    Strides strides;
+    for (int d = 0; d < 3; ++d) {
+      auto const axis = narrow_cast<long>(axes[d]);
+      size[d] = size_[axis];
+      strides[d] = strides_[axis];
+    }
+    return MappedStridedMemory(not_null<T *>(base_), size, strides);
+  }
+
+  /// @brief Returns a mapping of every @c step-th voxel along each axis,
+  /// starting at the first voxel
+  /// @pre all steps must be greater 0
+  inline MappedStridedMemory subsample(Size3 const &step) const {
+    Expects((step.array() > 0).all());
+    Size3 size;
+    Strides strides;
+    for (int d = 0; d < 3; ++d) {
+      size[d] = (size_[d] + step[d] - 1) / step[d];
+      strides[d] = strides_[d] * narrow<std::ptrdiff_t>(step[d]);
+    }
+    return MappedStridedMemory(not_null<T *>(base_), size, strides);
+  }
+
+  /// @brief Returns an iterator to the first voxel in logical order
+  inline const_iterator begin() const noexcept { return cbegin(); }
+  inline const_iterator cbegin() const noexcept {
+    return const_iterator(this, 0);
+  }
+  /// @brief Returns an iterator past the last voxel in logical order
+  inline const_iterator end() const noexcept { return cend(); }
+  inline const_iterator cend() const noexcept {
+    return const_iterator(this, linearSize());
+  }
+
+  inline iterator begin() noexcept { return iterator(this, 0); }
+  inline iterator end() noexcept { return iterator(this, linearSize()); }
+
+private:
+  inline std::ptrdiff_t offset(Size x, Size y, Size z) const noexcept {
+    Expects(x < size_[0] && y < size_[1] && z < size_[2]);
+    return static_cast<std::ptrdiff_t>(x) * strides_[0] +
+           static_cast<std::ptrdiff_t>(y) * strides_[1] +
+           static_cast<std::ptrdiff_t>(z) * strides_[2];
+  }
+
+  template <class Idx>
+  inline std::enable_if_t<isModelOfMultiIndex_v<Idx>, std::ptrdiff_t>
+  offset(Idx const &i) const noexcept {
+    static_assert(dims_v<Idx> == 3, "Multi index must be 3 dimensional");
+    return offset(static_cast<Size>(i[0]), static_cast<Size>(i[1]),
+                  static_cast<Size>(i[2]));
+  }
+
+  template <class Idx>
+  inline std::enable_if_t<!isModelOfMultiIndex_v<Idx>, std::ptrdiff_t>
+  offset(Idx const &i) const noexcept {
+    auto const idx = static_cast<Size>(i);
+    auto const slice = size_[0] * size_[1];
+    return offset(idx % size_[0], (idx % slice) / size_[0], idx / slice);
+  }
+
+  /// @brief Random access iterator visiting the voxels in logical order
+  template <class V> class Iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::remove_const_t<V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = V *;
+    using reference = V &;
+
+    Iterator() = default;
+
+    inline reference operator*() const noexcept { return *ptr_; }
+    inline pointer operator->() const noexcept { return ptr_; }
+    inline reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
+
+    inline Iterator &operator++() noexcept {
+      ++i_;
+      if (++x_ == map_->size_[0]) {
+        x_ = 0;
+        if (++y_ == map_->size_[1]) {
+          y_ = 0;
+          ++z_;
+        }
+        update();
+      } else {
+        ptr_ += map_->strides_[0];
+      }
+      return *this;
+    }
+
+    inline Iterator operator++(int) noexcept {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    inline Iterator &operator--() noexcept { return *this -= 1; }
+
+    inline Iterator operator--(int) noexcept {
+      auto tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    inline Iterator &operator+=(difference_type n) noexcept {
+      seek(static_cast<Size>(static_cast<difference_type>(i_) + n));
+      return *this;
+    }
+
+    inline Iterator &operator-=(difference_type n) noexcept {
+      return *this += -n;
+    }
+
+    inline Iterator operator+(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp += n;
+    }
+
+    inline friend Iterator operator+(difference_type n,
+                                     Iterator const &it) noexcept {
+      return it + n;
+    }
+
+    inline Iterator operator-(difference_type n) const noexcept {
+      auto tmp = *this;
+      return tmp -= n;
+    }
+
+    inline difference_type operator-(Iterator const &other) const noexcept {
+      return static_cast<difference_type>(i_) -
+             static_cast<difference_type>(other.i_);
+    }
+
+    inline bool operator==(Iterator const &other) const noexcept {
+      return i_ == other.i_;
+    }
+    inline bool operator!=(Iterator const &other) const noexcept {
+      return i_ != other.i_;
+    }
+    inline bool operator<(Iterator const &other) const noexcept {
+      return i_ < other.i_;
+    }
+    inline bool operator>(Iterator const &other) const noexcept {
+      return i_ > other.i_;
+    }
+    inline bool operator<=(Iterator const &other) const noexcept {
+      return i_ <= other.i_;
+    }
+    inline bool operator>=(Iterator const &other) const noexcept {
+      return i_ >= other.i_;
+    }
+
+  private:
+    friend class MappedStridedMemory;
+
+    inline Iterator(MappedStridedMemory const *map, Size i) noexcept
+        : map_(map) {
+      seek(i);
+    }
+
+    inline void seek(Size i) noexcept {
+      i_ = i;
+      auto const slice = map_->size_[0] * map_->size_[1];
+      if (slice == 0) return;
+      x_ = i % map_->size_[0];
+      y_ = (i % slice) / map_->size_[0];
+      z_ = i / slice;
+      update();
+    }
+
+    /// @brief Recomputes the pointer from the position, the past-the-end
+    /// position has no valid pointer
+    inline void update() noexcept {
+      ptr_ = z_ < map_->size_[2] ? map_->base_ + map_->offset(x_, y_, z_)
+                                 : nullptr;
+    }
+
+    MappedStridedMemory const *map_{nullptr};
+    pointer ptr_{nullptr};
+    Size i_{0}, x_{0}, y_{0}, z_{0};
+  };
+
+  T *base_;
+  Size3 size_;
+  Strides strides_;
+};
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "Types.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ImageStack {
+
+/// @brief Expected access pattern of a mapping, see MemoryMap::advise()
+enum class AccessPattern {
+  /// @brief No special treatment
+  Normal,
+  /// @brief Pages are accessed in ascending order, read ahead aggressively
+  /// and free pages soon after they were accessed
+  Sequential,
+  /// @brief Pages are accessed in random order, do not read ahead
+  Random,
+  /// @brief Pages will be accessed soon, start reading them
+  WillNeed,
+  /// @brief Pages will not be accessed soon, they may be evicted. Changes to
+  /// shared file mappings are kept, changes to private and anonymous mappings
+  /// are lost.
+  DontNeed
+};
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief RAII wrapper around a POSIX memory mapping
+///
+/// A MemoryMap either maps a region of a file or an anonymous, zero
+/// initialized region. File offsets do not need to be page aligned, the
+/// mapping takes care of the alignment internally and @c data() always points
+/// to the first requested byte.
+///
+/// @note Only available on POSIX platforms.
+class MemoryMap {
+public:
+  /// @brief Creates an empty mapping
+  MemoryMap() noexcept = default;
+
+  MemoryMap(MemoryMap const &) = delete;
+  MemoryMap &operator=(MemoryMap const &) = delete;
+
+  inline MemoryMap(MemoryMap &&other) noexcept
+      : base_(std::exchange(other.base_, nullptr)),
+        length_(std::exchange(other.length_, 0)),
+        delta_(std::exchange(other.delta_, 0)) {}
+
+  inline MemoryMap &operator=(MemoryMap &&other) noexcept {
+    if (this != &other) {
+      unmap();
+      base_ = std::exchange(other.base_, nullptr);
+      length_ = std::exchange(other.length_, 0);
+      delta_ = std::exchange(other.delta_, 0);
+    }
+    return *this;
+  }
+
+  inline ~MemoryMap() { unmap(); }
+
+  /// @brief Creates an anonymous, zero initialized mapping
+  /// @param bytes size of the mapping in bytes
+  /// @throw std::runtime_error if the mapping could not be created
+  static MemoryMap anonymous(std::size_t bytes) {
+    MemoryMap m;
+    if (bytes == 0) return m;
+
+    auto *ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+      throw std::runtime_error("Failed to create anonymous mapping: " +
+                               std::string(std::strerror(errno)));
+
+    m.base_ = ptr;
+    m.length_ = bytes;
+    return m;
+  }
+
+  /// @brief Creates a private (copy-on-write) mapping of a file region
+  ///
+  /// Pages are shared with the page cache, and thus with all other processes
+  /// mapping the same file, until they are written to.
+  /// @param filename path to the file to map
+  /// @param offset offset of the region in bytes, need not be page aligned
+  /// @param bytes size of the region in bytes
+  /// @throw std::runtime_error if the file could not be opened or mapped
+  static MemoryMap privateFile(std::string const &filename, std::size_t offset,
+                               std::size_t bytes) {
+    if (bytes == 0) return MemoryMap();
+
+    auto const fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open file '" + filename + "'");
+
+    return mapFile(fd, filename, offset, bytes, MAP_PRIVATE);
+  }
+
+  /// @brief Creates a shared, writable mapping of a file region
+  ///
+  /// Writes to the mapping are written back to the file. The file is created
+  /// if it does not exist and enlarged if it is smaller than
+  /// `offset + bytes`.
+  /// @param filename path to the file to map
+  /// @param offset offset of the region in bytes, need not be page aligned
+  /// @param bytes size of the region in bytes
+  /// @throw std::runtime_error if the file could not be opened, resized or
+  /// mapped
+  static MemoryMap sharedFile(std::string const &filename, std::size_t offset,
+                              std::size_t bytes) {
+    if (bytes == 0) return MemoryMap();
+
+    auto const fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open file '" + filename + "'");
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 ||
+        (static_cast<std::size_t>(st.st_size) < offset + bytes &&
+         ::ftruncate(fd, static_cast<off_t>(offset + bytes)) != 0)) {
+      auto const err = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to resize file '" + filename +
+                               "': " + std::strerror(err));
+    }
+
+    return mapFile(fd, filename, offset, bytes, MAP_SHARED);
+  }
+
+  /// @brief Creates a shared, writable, zero initialized mapping of a new
+  /// temporary file in the given directory
+  ///
+  /// The file is unlinked right away, so it is removed when the mapping is
+  /// destroyed, even if the process terminates abnormally. Unlike anonymous
+  /// mappings, the pages can be written back to the file by the operating
+  /// system, so the mapping may be larger than the physical memory.
+  /// @param directory directory to create the file in
+  /// @param bytes size of the mapping in bytes
+  /// @throw std::runtime_error if the file could not be created or mapped
+  static MemoryMap scratchFile(std::string const &directory,
+                               std::size_t bytes) {
+    if (bytes == 0) return MemoryMap();
+
+    auto filename = directory + "/ImageStack-XXXXXX";
+    auto const fd = ::mkstemp(&filename[0]);
+    if (fd < 0)
+      throw std::runtime_error("Failed to create scratch file in '" +
+                               directory + "': " + std::strerror(errno));
+    ::unlink(filename.c_str());
+
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+      auto const err = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to resize scratch file in '" +
+                               directory + "': " + std::strerror(err));
+    }
+
+    return mapFile(fd, filename, 0, bytes, MAP_SHARED);
+  }
+
+  /// @brief Returns a pointer to the first requested byte of the mapping
+  inline void *data() const noexcept {
+    return base_ ? static_cast<char *>(base_) + delta_ : nullptr;
+  }
+
+  /// @brief Returns the size of the requested region in bytes
+  inline std::size_t size() const noexcept { return length_ - delta_; }
+
+  /// @brief Returns true if nothing is mapped
+  inline bool empty() const noexcept { return base_ == nullptr; }
+
+  /// @brief Writes modified pages of a shared file mapping back to the file
+  /// @param async if true, only schedules the writes and returns immediately
+  /// @throw std::runtime_error if the pages could not be written
+  inline void sync(bool async = false) const {
+    if (!base_) return;
+    if (::msync(base_, length_, async ? MS_ASYNC : MS_SYNC) != 0)
+      throw std::runtime_error("Failed to sync mapping: " +
+                               std::string(std::strerror(errno)));
+  }
+
+  /// @brief Tells the operating system how the mapping is going to be
+  /// accessed
+  ///
+  /// The advice is only a hint, failures are ignored.
+  inline void advise(AccessPattern pattern) const noexcept {
+    if (!base_) return;
+    ::madvise(base_, length_, toAdvice(pattern));
+  }
+
+private:
+  /// @brief Maps @c bytes bytes of the open file @c fd starting at @c offset
+  /// and closes the file descriptor
+  static MemoryMap mapFile(int fd, std::string const &filename,
+                           std::size_t offset, std::size_t bytes, int flags) {
+    auto const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto const delta = offset % page;
+
+    auto *ptr = ::mmap(nullptr, bytes + delta, PROT_READ | PROT_WRITE, flags,
+                       fd, static_cast<off_t>(offset - delta));
+    auto const err = errno;
+    ::close(fd);
+
+    if (ptr == MAP_FAILED)
+      throw std::runtime_error("Failed to map file '" + filename +
+                               "': " + std::strerror(err));
+
+    MemoryMap m;
+    m.base_ = ptr;
+    m.length_ = bytes + delta;
+    m.delta_ = delta;
+    return m;
+  }
+
+  /// @brief Converts the access pattern to the @c madvise constant
+  static int toAdvice(AccessPattern pattern) noexcept {
+    switch (pattern) {
+    case AccessPattern::Sequential:
+      return MADV_SEQUENTIAL;
+    case AccessPattern::Random:
+      return MADV_RANDOM;
+    case AccessPattern::WillNeed:
+      return MADV_WILLNEED;
+    case AccessPattern::DontNeed:
+      return MADV_DONTNEED;
+    case AccessPattern::Normal:
+      break;
+    }
+    return MADV_NORMAL;
+  }
+
+  inline void unmap() noexcept {
+    if (base_) ::munmap(base_, length_);
+    base_ = nullptr;
+    length_ = 0;
+    delta_ = 0;
+  }
+
+  void *base_{nullptr};
+  std::size_t length_{0};
+  std::size_t delta_{0};
+};
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "HostMemoryResource.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace ImageStack {
+
+/// @brief Placement of the pages of an allocation on the NUMA nodes
+enum class NumaPolicy {
+  /// @brief Each page is placed on the node of the thread touching it first.
+  /// HostStorage initializes large volumes in parallel, in the same slab
+  /// partitioning the parallel kernels use, so each thread finds its slab on
+  /// its own node.
+  FirstTouch,
+  /// @brief Pages are distributed round robin over all nodes
+  Interleave,
+  /// @brief All pages are placed on a single node
+  Bind
+};
+
+namespace detail {
+
+/// @brief Maximum number of NUMA nodes supported
+constexpr std::size_t kMaxNumaNodes = 1024;
+
+/// @brief Size of a memory page
+inline std::size_t pageSize() noexcept {
+#ifdef _WIN32
+  return 4096;
+#else
+  static auto const size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+#endif
+}
+
+/// @brief Returns @c bytes rounded up to a positive multiple of the page size
+inline std::size_t pageRounded(std::size_t bytes) noexcept {
+  auto const page = pageSize();
+  return std::max<std::size_t>((bytes + page - 1) / page, 1) * page;
+}
+
+} // namespace detail
+
+/// @brief Returns the number of NUMA nodes of the system, 1 if unknown
+inline std::size_t numaNodeCount() {
+  static auto const count = [] {
+    // The file contains a list of ranges, e.g. "0-1" or "0,2-3"
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string list;
+    if (!(in >> list)) return std::size_t{1};
+
+    std::size_t maxNode = 0;
+    auto const *p = list.c_str();
+    while (*p) {
+      char *end;
+      auto const n = std::strtoull(p, &end, 10);
+      if (end == p) break;
+      maxNode = std::max<std::size_t>(maxNode, n);
+      p = *end ? end + 1 : end;
+    }
+
+    return std::min(maxNode + 1, detail::kMaxNumaNodes);
+  }();
+
+  return count;
+}
+
+namespace detail {
+
+/// @brief Applies the given policy to the pages of @c [ptr, ptr + bytes)
+///
+/// The pages must not have been touched yet.
+/// @param ptr page aligned address
+/// @return false if the policy could not be applied, e.g. because the system
+/// does not support NUMA
+inline bool applyNumaPolicy(void *ptr, std::size_t bytes, NumaPolicy policy,
+                            int node) noexcept {
+  if (policy == NumaPolicy::FirstTouch) return true;
+
+#ifdef __linux__
+  constexpr int kMpolBind = 2;
+  constexpr int kMpolInterleave = 3;
+  constexpr auto kBits = sizeof(unsigned long) * CHAR_BIT;
+
+  std::array<unsigned long, kMaxNumaNodes / kBits> mask{};
+  auto const setNode = [&mask](std::size_t n) {
+    mask[n / kBits] |= 1ul << (n % kBits);
+  };
+
+  if (policy == NumaPolicy::Bind) {
+    if (node < 0 || static_cast<std::size_t>(node) >= kMaxNumaNodes)
+      return false;
+    setNode(static_cast<std::size_t>(node));
+  } else {
+    for (std::size_t n = 0; n < numaNodeCount(); ++n) setNode(n);
+  }
+
+  auto const mode = policy == NumaPolicy::Bind ? kMpolBind : kMpolInterleave;
+  return ::syscall(SYS_mbind, ptr, bytes, mode, mask.data(), kMaxNumaNodes,
+                   0) == 0;
+#else
+  (void)ptr;
+  (void)bytes;
+  (void)node;
+  return false;
+#endif
+}
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Memory resource placing its allocations on NUMA nodes according to
+/// a NumaPolicy
+///
+/// Allocations are fresh anonymous mappings, so the policy is applied before
+/// their pages are touched and does not outlive them. On systems without NUMA support the policy is ignored and the
+/// memory is placed by the operating system. Can be used as the upstream
+/// resource of a BufferPool, recycled buffers keep their placement.
+///
+/// Example: interleave all volumes over all nodes
+/// @code
+/// NumaMemoryResource numa(NumaPolicy::Interleave);
+/// setHostMemoryResource(&numa);
+/// @endcode
+///
+/// Unit tests are in \ref testHostMemoryResource.cpp
+class NumaMemoryResource : public HostMemoryResource {
+public:
+  /// @brief Creates the resource
+  /// @param policy placement policy
+  /// @param node node to bind the memory to if @c policy is NumaPolicy::Bind
+  explicit NumaMemoryResource(NumaPolicy policy, int node = 0)
+      : policy_(policy), node_(node) {
+    Expects(policy != NumaPolicy::Bind ||
+            (node >= 0 && static_cast<std::size_t>(node) < numaNodeCount()));
+  }
+
+  void *allocate(std::size_t bytes) override {
+    auto const rounded = detail::pageRounded(bytes);
+
+#ifdef _WIN32
+    auto *ptr = _aligned_malloc(rounded, detail::pageSize());
+    if (!ptr) throw std::bad_alloc();
+#else
+    // Heap memory may already be faulted in, and mbind() does not move such
+    // pages; the policy would also stay with the heap after deallocation
+    auto *ptr = ::mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) throw std::bad_alloc();
+#endif
+
+    applied_ = detail::applyNumaPolicy(ptr, rounded, policy_, node_);
+    return ptr;
+  }
+
+  void deallocate(void *ptr, std::size_t bytes) noexcept override {
+#ifdef _WIN32
+    (void)bytes;
+    _aligned_free(ptr);
+#else
+    ::munmap(ptr, detail::pageRounded(bytes));
+#endif
+  }
+
+  /// @brief Returns the placement policy
+  inline NumaPolicy policy() const noexcept { return policy_; }
+
+  /// @brief Returns the node memory is bound to if the policy is
+  /// NumaPolicy::Bind
+  inline int node() const noexcept { return node_; }
+
+  /// @brief Returns false if the policy could not be applied to the last
+  /// allocation
+  inline bool applied() const noexcept { return applied_; }
+
+private:
+  NumaPolicy policy_;
+  int node_;
+  std::atomic<bool> applied_{true};
+};
+#pragma clang diagnostic pop
+
+} // namespace ImageStack
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ImageStack.h"
+#include "Types.h"
+
+namespace ImageStack {
+
+namespace detail {
+
+template <class Loader>
+inline auto loaderOrigin(Loader &loader, int) -> decltype(loader.origin()) {
+  return loader.origin();
+}
+
+template <class Loader> inline Index3 loaderOrigin(Loader &, long) {
+  return Index3::Zero();
+}
+
+} // namespace detail
+
+/// @brief Decorator storing the position of an image inside the volume it was
+/// loaded from
+///
+/// If the loader only reads a region of a volume (e.g. ImageStackLoaderBST
+/// constructed with a region), @c origin is the index of the first voxel of
+/// that region. Otherwise it is zero.
+class OriginDecorator {
+public:
+  Index3 origin{0, 0, 0};
+
+protected:
+  OriginDecorator() = default;
+  template <class Loader> OriginDecorator(Loader &&loader) {
+    origin = detail::loaderOrigin(loader, 0);
+  }
+};
+
+template <class IS,
+          typename = std::enable_if_t<hasDecorator_v<IS, OriginDecorator>>>
+auto origin(IS const &is) {
+  return is.origin;
+}
+
+template <class IS,
+          typename = std::enable_if_t<!hasDecorator_v<IS, OriginDecorator>>>
+Index3 origin(IS const &) {
+  return Index3::Zero();
+}
+
+} // namespace ImageStack
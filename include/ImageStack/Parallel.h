@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Types.h"
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace ImageStack {
+namespace detail {
+
+/// @brief Minimum number of voxels processed by a single thread in chunked
+/// reductions
+constexpr Size kMinChunkSize = Size{1} << 16;
+
+/// @brief Returns the maximum number of threads of a parallel region
+inline Size maxThreads() noexcept {
+#ifdef _OPENMP
+  return static_cast<Size>(omp_get_max_threads());
+#else
+  return 1;
+#endif
+}
+
+/// @brief True if the mapping stores its voxels contiguously in logical order
+/// and provides a pointer to them through @c data()
+template <class Map, typename = void>
+struct HasContiguousData : public std::false_type {};
+
+template <class Map>
+struct HasContiguousData<
+    Map, std::enable_if_t<std::is_pointer<
+             decltype(std::declval<Map &>().data())>::value>>
+    : public std::true_type {};
+
+/// @brief True if the iterators of the mapping are random access iterators
+template <class Map>
+using HasRandomAccess = std::is_base_of<
+    std::random_access_iterator_tag,
+    typename std::iterator_traits<
+        decltype(std::declval<Map &>().begin())>::iterator_category>;
+
+/// @brief True if dereferencing an iterator of the mapping yields a real
+/// reference to a voxel
+///
+/// False for proxy mappings like MappedBitMask, where writing a voxel is a
+/// read-modify-write of a word shared with its neighbors. Such mappings must
+/// not be written by multiple threads at once.
+template <class Map>
+using HasReferenceAccess = std::is_lvalue_reference<decltype(
+    *std::declval<Map &>().begin())>;
+
+/// @brief True if the voxels of the mapping can be written through its
+/// iterators, either directly or through a proxy
+///
+/// False for read only mappings, e.g. of LazySliceStorage.
+template <class Map>
+using IsWritableMapping = std::is_assignable<
+    decltype(*std::declval<Map &>().begin()),
+    typename std::iterator_traits<decltype(
+        std::declval<Map &>().begin())>::value_type>;
+
+/// @brief Returns the number of chunks the voxels of @c map are split into
+/// for a reduction, one per thread unless the image is small or cannot be
+/// accessed randomly
+///
+/// The chunks are processed in parallel, each producing a partial result.
+template <class Map> inline Size numChunks(Map const &map) {
+  if (!HasRandomAccess<Map const>::value) return 1;
+
+  auto const n = map.linearSize();
+  return std::max<Size>(
+      1, std::min((n + kMinChunkSize - 1) / kMinChunkSize, maxThreads()));
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Calls `f(chunk, first, last)` for each of the @c chunks ranges of
+/// linear indices `[first, last)` of @c n voxels in parallel
+template <class F> inline void forEachIndexChunk(Size n, Size chunks, F f) {
+#pragma omp parallel for schedule(static)
+  for (long c = 0; c < narrow<long>(chunks); ++c) {
+    auto const chunk = static_cast<Size>(c);
+    f(chunk, n * chunk / chunks, n * (chunk + 1) / chunks);
+  }
+}
+#pragma clang diagnostic pop
+
+template <class Map>
+inline auto voxelIterator(Map &map, Size i, std::true_type) {
+  return map.data() + i;
+}
+
+template <class Map>
+inline auto voxelIterator(Map &map, Size i, std::false_type) {
+  using Diff = typename std::iterator_traits<decltype(
+      map.begin())>::difference_type;
+  return std::next(map.begin(), static_cast<Diff>(i));
+}
+
+/// @brief Returns an iterator to the voxel with the given linear index of a
+/// mapping, or a pointer if the mapping is contiguous
+template <class Map> inline auto voxelIterator(Map &map, Size i) {
+  return voxelIterator(map, i, HasContiguousData<Map>{});
+}
+
+/// @brief Calls `f(chunk, first, last)` for each of the @c chunks chunks of
+/// the voxels of @c map in parallel, with @c first and @c last being
+/// iterators
+template <class Map, class F>
+inline void forEachChunk(Map const &map, Size chunks, F f) {
+  forEachIndexChunk(map.linearSize(), chunks,
+                    [&map, &f](Size c, Size first, Size last) {
+                      auto const it = voxelIterator(map, first);
+                      f(c, it, std::next(it, narrow_cast<std::ptrdiff_t>(
+                                                 last - first)));
+                    });
+}
+
+} // namespace detail
+} // namespace ImageStack
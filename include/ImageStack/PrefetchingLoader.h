@@ -0,0 +1,257 @@
+#pragma once
+
+#include "ImageStack.h"
+#include "ImageStackLoaderBST.h"
+#include "Types.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Loads image stacks on a background thread ahead of their use
+///
+/// Files are enqueued in the order they are going to be processed. A
+/// background I/O thread loads them one after another while the caller
+/// processes the previously loaded stacks, which overlaps reading with
+/// computing.
+///
+/// The number of loaded stacks that have not been retrieved yet is bounded by
+/// a prefetch depth and by a memory budget. A stack counts against both from
+/// the moment its loading starts until @c Future::get() is called or the
+/// future is destroyed. A stack larger than the whole budget is still loaded
+/// once nothing else is in flight.
+///
+/// Unit tests are in \ref testPrefetchingLoader.cpp
+///
+/// @tparam ImageStack_ ImageStack type to load
+/// @tparam Loader loader type, must be constructible from a filename
+template <class ImageStack_, class Loader = ImageStackLoaderBST<ImageStack_>>
+class PrefetchingLoader {
+  /// @brief Accounting state of a single enqueued stack
+  struct Slot {
+    Size bytes{0};
+    bool accounted{false};
+    bool released{false};
+  };
+
+  /// @brief State shared with the I/O thread and the futures
+  struct Budget {
+    std::mutex mutex;
+    std::condition_variable changed;
+    Size bytes{0};
+    Size stacks{0};
+    bool stop{false};
+
+    /// @brief Releases the budget of the given slot, a slot that is released
+    /// before its stack is loaded is skipped by the I/O thread
+    void release(Slot &slot) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (slot.accounted && !slot.released) {
+          bytes -= slot.bytes;
+          --stacks;
+        }
+        slot.released = true;
+      }
+      changed.notify_all();
+    }
+  };
+
+public:
+  using ImageStack = ImageStack_;
+
+  /// @brief Handle to a stack that is loaded in the background
+  ///
+  /// Releases the memory budget of its stack on @c get() or when destroyed.
+  class Future {
+  public:
+    Future() = default;
+    Future(Future &&) noexcept = default;
+    Future &operator=(Future &&other) noexcept {
+      if (this != &other) {
+        release();
+        future_ = std::move(other.future_);
+        budget_ = std::move(other.budget_);
+        slot_ = std::move(other.slot_);
+      }
+      return *this;
+    }
+    ~Future() { release(); }
+
+    /// @brief Returns true if the future refers to a stack that was not
+    /// retrieved yet
+    inline bool valid() const noexcept { return future_.valid(); }
+
+    /// @brief Blocks until the stack is loaded
+    inline void wait() const { future_.wait(); }
+
+    /// @brief Returns true if the stack is loaded, i.e. @c get() does not
+    /// block
+    inline bool ready() const {
+      return future_.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready;
+    }
+
+    /// @brief Waits for the stack and returns it
+    /// @throw any exception thrown while loading the stack, e.g.
+    /// std::runtime_error if the file could not be opened
+    ImageStack get() {
+      Expects(valid());
+
+      auto const releaseBudget = finally([this] { release(); });
+      return future_.get();
+    }
+
+  private:
+    friend class PrefetchingLoader;
+
+    Future(std::future<ImageStack> future, std::shared_ptr<Budget> budget,
+           std::shared_ptr<Slot> slot)
+        : future_(std::move(future)), budget_(std::move(budget)),
+          slot_(std::move(slot)) {}
+
+    void release() {
+      if (!budget_) return;
+      budget_->release(*slot_);
+      budget_.reset();
+    }
+
+    std::future<ImageStack> future_;
+    std::shared_ptr<Budget> budget_;
+    std::shared_ptr<Slot> slot_;
+  };
+
+  /// @brief Unlimited memory budget
+  static constexpr Size kUnlimited = std::numeric_limits<Size>::max();
+
+  /// @brief Creates the loader and starts the I/O thread
+  /// @param depth maximum number of stacks loaded ahead, must be greater 0
+  /// @param memoryBudget maximum number of bytes of voxel data loaded ahead
+  explicit PrefetchingLoader(Size depth, Size memoryBudget = kUnlimited)
+      : depth_(depth), memoryBudget_(memoryBudget),
+        budget_(std::make_shared<Budget>()) {
+    Expects(depth > 0);
+
+    thread_ = std::thread([this] { run(); });
+  }
+
+  PrefetchingLoader(PrefetchingLoader const &) = delete;
+  PrefetchingLoader &operator=(PrefetchingLoader const &) = delete;
+
+  /// @brief Stops the I/O thread, stacks not yet loaded are abandoned
+  ///
+  /// Futures of abandoned stacks throw std::future_error on @c get().
+  ~PrefetchingLoader() {
+    {
+      std::lock_guard<std::mutex> lock(budget_->mutex);
+      budget_->stop = true;
+    }
+    budget_->changed.notify_all();
+    thread_.join();
+  }
+
+  /// @brief Enqueues a file to be loaded
+  ///
+  /// If the returned future is destroyed before the stack was loaded, the
+  /// file is skipped.
+  /// @param filename path of the file to load
+  /// @return future of the loaded stack
+  Future enqueue(std::string filename) {
+    Request request{std::move(filename), std::promise<ImageStack>(),
+                    std::make_shared<Slot>()};
+    Future future(request.promise.get_future(), budget_, request.slot);
+    {
+      std::lock_guard<std::mutex> lock(budget_->mutex);
+      queue_.push_back(std::move(request));
+    }
+    budget_->changed.notify_all();
+
+    return future;
+  }
+
+  /// @brief Returns the maximum number of stacks loaded ahead
+  inline Size depth() const noexcept { return depth_; }
+
+  /// @brief Returns the maximum number of bytes of voxel data loaded ahead
+  inline Size memoryBudget() const noexcept { return memoryBudget_; }
+
+  /// @brief Returns the number of bytes of voxel data of stacks currently
+  /// loaded or being loaded but not retrieved yet
+  Size bytesInFlight() const {
+    std::lock_guard<std::mutex> lock(budget_->mutex);
+    return budget_->bytes;
+  }
+
+private:
+  struct Request {
+    std::string filename;
+    std::promise<ImageStack> promise;
+    std::shared_ptr<Slot> slot;
+  };
+
+  /// @brief Main loop of the I/O thread
+  void run() {
+    auto &budget = *budget_;
+
+    for (;;) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(budget.mutex);
+        budget.changed.wait(lock,
+                            [&] { return budget.stop || !queue_.empty(); });
+        if (budget.stop) return;
+        request = std::move(queue_.front());
+        queue_.pop_front();
+        if (request.slot->released) continue;
+      }
+
+      try {
+        Loader loader(request.filename);
+        auto const bytes = indexProduct(loader.size()) *
+                           sizeof(typename ImageStack::StorageType);
+
+        {
+          auto &slot = *request.slot;
+          std::unique_lock<std::mutex> lock(budget.mutex);
+          budget.changed.wait(lock, [&] {
+            return budget.stop || slot.released || budget.stacks == 0 ||
+                   (budget.stacks < depth_ &&
+                    budget.bytes + bytes <= memoryBudget_);
+          });
+          if (budget.stop) return;
+          if (slot.released) continue;
+          budget.bytes += bytes;
+          ++budget.stacks;
+          slot.bytes = bytes;
+          slot.accounted = true;
+        }
+
+        request.promise.set_value(ImageStack(loader));
+      } catch (...) {
+        request.promise.set_exception(std::current_exception());
+      }
+    }
+  }
+
+  Size depth_;
+  Size memoryBudget_;
+  std::shared_ptr<Budget> budget_;
+  std::deque<Request> queue_;
+  std::thread thread_;
+};
+#pragma clang diagnostic pop
+
+template <class ImageStack_, class Loader>
+constexpr Size PrefetchingLoader<ImageStack_, Loader>::kUnlimited;
+
+} // namespace ImageStack
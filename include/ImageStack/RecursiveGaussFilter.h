@@ -0,0 +1,329 @@
+#pragma once
+
+#include "Filter.h"
+#include "ResolutionDecorator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace ImageStack {
+namespace Filter {
+
+namespace detail {
+
+/// @brief Number of neighboring lines filtered together, the recursion is
+/// vectorized across them
+constexpr Size kRecursiveLanes = 16;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Coefficients of the third order recursion
+/// `w[n] = B * x[n] + a1 * w[n - 1] + a2 * w[n - 2] + a3 * w[n - 3]`
+/// along one axis
+struct RecursiveCoefficients {
+  double B{1}, a1{0}, a2{0}, a3{0};
+  /// @brief Maps the deviation of the last three causal outputs from the last
+  /// input to the deviation of the first three anti-causal initial values,
+  /// row major
+  std::array<double, 9> M{};
+  /// @brief True if the axis is not filtered, i.e. sigma is 0
+  bool identity{true};
+};
+#pragma clang diagnostic pop
+
+/// @brief Computes the Young-van Vliet coefficients for the given sigma in
+/// voxels
+///
+/// The poles are taken from L. J. van Vliet, I. T. Young, P. W. Verbeek:
+/// Recursive Gaussian derivative filters, ICPR 1998, and scaled such that the
+/// standard deviation of the filter is exactly @c sigma. The initial values
+/// of the anti-causal pass follow B. Triggs, M. Sdika: Boundary conditions
+/// for Young-van Vliet recursive filtering, IEEE TSP 54 (2006), but the
+/// matrix is obtained by running the recursion on a constant continuation
+/// once, instead of evaluating the closed form.
+inline RecursiveCoefficients youngVanVliet(double sigma) {
+  RecursiveCoefficients c;
+  if (sigma <= 0) return c;
+
+  // Poles of the filter with sigma 2, the poles for other sigmas are
+  // d^(1 / q). The variance of the forward-backward filter is the sum of
+  // 2 d / (d - 1)^2 over its poles and grows with q.
+  std::complex<double> const d1(1.41650, 1.00829);
+  double const d3 = 1.86543;
+  auto const poles = [&](double q) {
+    return std::make_pair(std::pow(d1, 1 / q), std::pow(d3, 1 / q));
+  };
+  auto const variance = [&](double q) {
+    auto const p = poles(q);
+    auto const pair = 2.0 * p.first / ((p.first - 1.0) * (p.first - 1.0));
+    return 2 * pair.real() + 2 * p.second / ((p.second - 1) * (p.second - 1));
+  };
+
+  auto lower = 1e-3, upper = 1e4;
+  for (int i = 0; i < 100; ++i) {
+    auto const q = std::sqrt(lower * upper);
+    (variance(q) < sigma * sigma ? lower : upper) = q;
+  }
+
+  // 1 - a1 z^-1 - a2 z^-2 - a3 z^-3 = (1 - z^-1 / d1) (1 - z^-1 / conj(d1))
+  // (1 - z^-1 / d3)
+  auto const p = poles(std::sqrt(lower * upper));
+  auto const r = 1.0 / p.first;
+  auto const r3 = 1 / p.second;
+  c.a1 = r3 + 2 * r.real();
+  c.a2 = -(2 * r3 * r.real() + std::norm(r));
+  c.a3 = r3 * std::norm(r);
+  c.B = 1 - (c.a1 + c.a2 + c.a3);
+  c.identity = false;
+
+  // Beyond the last voxel the input continues with its value, so the
+  // deviations d of the causal output from it decay following the
+  // homogeneous recursion. The anti-causal pass over d, started far enough
+  // behind the line, yields the deviations of its initial values.
+  auto const n = static_cast<Size>(std::ceil(40 * sigma)) + 100;
+  std::vector<double> d(n + 3), e(n + 3);
+  for (Size j = 0; j < 3; ++j) {
+    std::fill(d.begin(), d.end(), 0.0);
+    std::fill(e.begin(), e.end(), 0.0);
+    // d[0], d[1], d[2] are the deviations at the voxels N - 3, N - 2, N - 1
+    d[2 - j] = 1;
+    for (Size i = 3; i < n; ++i)
+      d[i] = c.a1 * d[i - 1] + c.a2 * d[i - 2] + c.a3 * d[i - 3];
+    for (auto i = n; i-- > 3;)
+      e[i] = c.B * d[i] + c.a1 * e[i + 1] + c.a2 * e[i + 2] + c.a3 * e[i + 3];
+    for (Size i = 0; i < 3; ++i) c.M[3 * i + j] = e[3 + i];
+  }
+
+  return c;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Filters all lines of @c src along @c axis and writes them to
+/// @c dst, which may be the same mapping
+///
+/// Blocks of kRecursiveLanes neighboring lines are copied into an interleaved
+/// buffer, so the causal and the anti-causal recursions process all lines of
+/// a block with each step. Blocks are processed in parallel. The image is
+/// continued beyond its border by replicating the border voxels.
+template <class SrcMap, class DstMap>
+inline void recursiveLines(SrcMap const &src, DstMap &dst,
+                           RecursiveCoefficients const &c, int axis) {
+  using T = std::decay_t<decltype(*dst.begin())>;
+  constexpr auto L = kRecursiveLanes;
+
+  auto const size = src.size();
+  auto const a = static_cast<Size>(axis);
+  // Lines neighboring along x are adjacent in memory, so use x for the lanes
+  // unless the lines run along x
+  auto const a1 = a == 0 ? Size{1} : Size{0};
+  auto const a2 = 3 - a - a1;
+
+  auto const n = size[a];
+  auto const blocksPerRow = (size[a1] + L - 1) / L;
+  auto const blocks = narrow<long>(blocksPerRow * size[a2]);
+
+  auto const B = c.B, a1c = c.a1, a2c = c.a2, a3c = c.a3;
+
+#pragma omp parallel
+  {
+    std::vector<double> buffer(n * L);
+    std::array<double, L> last, p1, p2, p3;
+
+#pragma omp for schedule(static)
+    for (long b = 0; b < blocks; ++b) {
+      auto const first = static_cast<Size>(b) % blocksPerRow * L;
+      auto const lanes = std::min(L, size[a1] - first);
+
+      Index3 pos;
+      pos[narrow_cast<long>(a2)] = static_cast<Size>(b) / blocksPerRow;
+
+      for (Size i = 0; i < n; ++i) {
+        pos[axis] = i;
+        for (Size l = 0; l < lanes; ++l) {
+          pos[narrow_cast<long>(a1)] = first + l;
+          buffer[i * L + l] = static_cast<double>(src[pos]);
+        }
+      }
+      // Unused lanes hold zeros, they are never written back
+      for (Size i = 0; i < n; ++i)
+        for (Size l = lanes; l < L; ++l) buffer[i * L + l] = 0;
+
+      // Causal pass, the steady state of a constant input is the input itself
+      for (Size l = 0; l < L; ++l) {
+        last[l] = buffer[(n - 1) * L + l];
+        p1[l] = p2[l] = p3[l] = buffer[l];
+      }
+      for (Size i = 0; i < n; ++i) {
+        auto *line = buffer.data() + i * L;
+#pragma omp simd
+        for (Size l = 0; l < L; ++l) {
+          auto const w = B * line[l] + a1c * p1[l] + a2c * p2[l] + a3c * p3[l];
+          p3[l] = p2[l];
+          p2[l] = p1[l];
+          p1[l] = w;
+          line[l] = w;
+        }
+      }
+
+      // Anti-causal pass, p1, p2, p3 hold the causal outputs of the last
+      // three voxels and become the outputs following the last voxel
+      for (Size l = 0; l < L; ++l) {
+        auto const u0 = p1[l] - last[l];
+        auto const u1 = p2[l] - last[l];
+        auto const u2 = p3[l] - last[l];
+        p1[l] = last[l] + c.M[0] * u0 + c.M[1] * u1 + c.M[2] * u2;
+        p2[l] = last[l] + c.M[3] * u0 + c.M[4] * u1 + c.M[5] * u2;
+        p3[l] = last[l] + c.M[6] * u0 + c.M[7] * u1 + c.M[8] * u2;
+      }
+      for (auto i = n; i-- > 0;) {
+        auto *line = buffer.data() + i * L;
+#pragma omp simd
+        for (Size l = 0; l < L; ++l) {
+          auto const y = B * line[l] + a1c * p1[l] + a2c * p2[l] + a3c * p3[l];
+          p3[l] = p2[l];
+          p2[l] = p1[l];
+          p1[l] = y;
+          line[l] = y;
+        }
+      }
+
+      for (Size i = 0; i < n; ++i) {
+        pos[axis] = i;
+        for (Size l = 0; l < lanes; ++l) {
+          pos[narrow_cast<long>(a1)] = first + l;
+          dst[pos] = static_cast<T>(buffer[i * L + l]);
+        }
+      }
+    }
+  }
+}
+#pragma clang diagnostic pop
+
+} // namespace detail
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Recursive approximation of a Gaussian filter
+///
+/// Uses the third order recursive filter by Young and van Vliet, applied
+/// forward and backward along each axis. In contrast to GaussFilter, the
+/// cost per voxel does not depend on sigma, which makes it the better choice
+/// for large sigmas, e.g. for estimating smooth background fields. The
+/// standard deviation of the impulse response is exact, its maximum deviation
+/// from a sampled Gaussian is about 1.5 % of the peak for sigmas of 3 voxels
+/// and more, and 4 % for a sigma of 1 voxel. Use GaussFilter for smaller
+/// sigmas.
+///
+/// The image is continued beyond its border by replicating the border voxels
+/// instead of zero padding, so constant images stay constant.
+///
+/// Apply the filter with Filter::filter() for sigmas in voxels or
+/// recursiveGauss() for sigmas in the units of the image resolution.
+///
+/// Unit tests are in \ref testRecursiveGaussFilter.cpp
+class RecursiveGaussFilter {
+public:
+  /// @brief Creates the filter
+  /// @param sigma standard deviation along each axis in voxels, 0 to leave
+  /// an axis unfiltered
+  template <class Derived>
+  inline explicit RecursiveGaussFilter(Eigen::MatrixBase<Derived> const &sigma)
+      : sigma_{sigma.template cast<double>()} {
+    Expects((sigma_.array() >= 0).all());
+    for (int a = 0; a < 3; ++a)
+      coefficients_[static_cast<Size>(a)] = detail::youngVanVliet(sigma_[a]);
+  }
+
+  /// @brief Returns the standard deviation along each axis in voxels
+  inline Eigen::Vector3d const &sigma() const noexcept { return sigma_; }
+
+  /// @brief Returns the recursion coefficients along the given axis
+  inline detail::RecursiveCoefficients const &
+  coefficients(int axis) const noexcept {
+    return coefficients_[static_cast<Size>(axis)];
+  }
+
+private:
+  Eigen::Vector3d sigma_;
+  std::array<detail::RecursiveCoefficients, 3> coefficients_;
+};
+#pragma clang diagnostic pop
+
+/// @brief Applies the recursive Gaussian filter to the image
+///
+/// Each axis is filtered by one pass over all lines. Floating point images
+/// are filtered in the result image, other types in a temporary float image
+/// that is rounded and saturated at the end. The result and the temporary
+/// image are stored like those of Filter::filter() with a FilterBase, i.e. in
+/// the storage of the image if it is an out of core storage. The result has
+/// the size of the image.
+template <class T, template <class> class Storage, class... Decorators,
+          typename = std::enable_if_t<isHostStorage_v<Storage>>>
+auto filter(ImageStack<T, Storage, Decorators...> const &img,
+            RecursiveGaussFilter const &gauss) {
+
+  using Img = std::conditional_t<isOutOfCoreStorage_v<Storage>,
+                                 ImageStack<T, Storage, Decorators...>,
+                                 ImageStack<T, HostStorage, Decorators...>>;
+  using Work = std::conditional_t<std::is_floating_point<T>::value, T, float>;
+  using Tmp = std::conditional_t<isOutOfCoreStorage_v<Storage>, Storage<Work>,
+                                 HostStorage<Work>>;
+
+  Img dest{img.size(), T{0}};
+  if (img.empty()) return dest;
+
+  auto const mSrc = img.map();
+  auto mDest = dest.map();
+
+  auto const run = [&](auto &work) {
+    ::ImageStack::detail::transformMaps(mSrc, work, [](auto s, auto d,
+                                                       Size n) {
+      for (Size i = 0; i < n; ++i, ++s, ++d)
+        *d = static_cast<Work>(*s);
+    });
+    for (int a = 0; a < 3; ++a) {
+      auto const &c = gauss.coefficients(a);
+      if (!c.identity) detail::recursiveLines(work, work, c, a);
+    }
+  };
+
+  if (std::is_same<Work, T>::value) {
+    run(mDest);
+  } else {
+    Tmp tmp(img.size());
+    auto mTmp = tmp.map();
+    run(mTmp);
+    ::ImageStack::detail::convertMaps(mTmp, mDest, 1.0, 0.0);
+  }
+
+  return dest;
+}
+
+/// @brief Applies a recursive Gaussian filter with the standard deviation
+/// given in the units of the image resolution
+///
+/// The standard deviation in voxels along axis @c d is
+/// `sigma[d] / img.resolution[d]`, so anisotropic volumes are smoothed
+/// isotropically in physical space by passing the same sigma for all axes.
+/// @pre the image has a ResolutionDecorator with positive resolutions
+template <class T, template <class> class Storage, class... Decorators,
+          class Derived,
+          typename = std::enable_if_t<
+              isHostStorage_v<Storage> &&
+              hasDecorator_v<ImageStack<T, Storage, Decorators...>,
+                             ResolutionDecorator>>>
+auto recursiveGauss(ImageStack<T, Storage, Decorators...> const &img,
+                    Eigen::MatrixBase<Derived> const &sigma) {
+  Eigen::Vector3d const res = img.resolution;
+  Expects((res.array() > 0).all());
+  Eigen::Vector3d const voxels =
+      sigma.template cast<double>().cwiseQuotient(res);
+  return filter(img, RecursiveGaussFilter(voxels));
+}
+
+} // namespace Filter
+} // namespace ImageStack
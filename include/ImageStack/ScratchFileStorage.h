@@ -0,0 +1,197 @@
+#pragma once
+
+#include "HostStorage.h"
+#include "MappedMemory.h"
+#include "MemoryMap.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace ImageStack {
+
+/// @brief Returns the directory scratch files are created in
+///
+/// The directory is taken from the environment variable
+/// @c IMAGESTACK_SCRATCH_DIR, then @c TMPDIR, and defaults to @c /tmp.
+inline std::string scratchDirectory() {
+  for (auto const *var : {"IMAGESTACK_SCRATCH_DIR", "TMPDIR"}) {
+    auto const *dir = std::getenv(var);
+    if (dir && *dir) return dir;
+  }
+  return "/tmp";
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wsource-uses-openmp"
+/// @brief Class representing a 3D data storage backed by a writable, shared
+/// memory mapped file
+///
+/// The operating system writes modified pages back to the file and evicts
+/// them when memory gets low, so the storage may be larger than the physical
+/// memory. Since @c map() returns ordinary mappings of host memory,
+/// Filter::filter and Sampler work on such images unchanged; the result of
+/// Filter::filter is stored in a scratch file as well.
+///
+/// When constructed from a size only, the data is stored in an unnamed
+/// scratch file in scratchDirectory(), which is removed when the storage is
+/// destroyed. When constructed from a file name, the data is stored in that
+/// file and kept after the storage is destroyed.
+///
+/// Example: Gauss filter a volume larger than the memory
+/// @code
+/// using Img = ImageStack<float, ScratchFileStorage, ResolutionDecorator>;
+/// Img const img{ImageStackLoaderBST<Img>("huge.bst")};
+/// auto const smooth = Filter::filter(img, gauss);
+/// @endcode
+///
+/// Unit tests are in \ref testScratchFileStorage.cpp
+/// @tparam T type of stored elements, must be trivially copyable
+/// @note Only available on POSIX platforms.
+template <class T> class ScratchFileStorage {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ScratchFileStorage requires trivially copyable elements");
+
+public:
+  using ValueType = T;
+  using Pointer = T *;
+  using ConstPointer = T const *;
+
+  /// @brief Create storage backed by a zero initialized scratch file
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of storage to be allocated
+  /// @throw std::runtime_error if the scratch file could not be created
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline explicit ScratchFileStorage(Size size)
+      : size_(size[0], size[1], size[2]),
+        mapping_(MemoryMap::scratchFile(scratchDirectory(),
+                                        indexProduct(size_) * sizeof(T))) {}
+
+  /// @brief Create storage backed by a scratch file and initialize it with
+  /// the given value
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param size size of storage to be allocated
+  /// @param init value to initialize the memory with
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline ScratchFileStorage(Size size, T const &init)
+      : ScratchFileStorage(size) {
+    auto const slice = size_[0] * size_[1];
+    auto const slices = narrow<long>(size_[2]);
+    auto *const dest = data();
+
+#pragma omp parallel for schedule(static)
+    for (long z = 0; z < slices; ++z)
+      std::fill_n(dest + static_cast<std::size_t>(z) * slice, slice, init);
+  }
+
+  /// @brief Create storage backed by the given file
+  ///
+  /// The file is created if it does not exist and enlarged if it is too
+  /// small. Its content is used as initial data.
+  /// @tparam Size model of \ref MultiIndexConcept with at least 3 dimensions
+  /// @param filename file to store the data in
+  /// @param size size of the storage
+  /// @param offset offset of the data in the file in bytes, e.g. the size of
+  /// a header written separately
+  /// @pre @c offset is a multiple of `alignof(T)`, otherwise the voxels would
+  /// be misaligned
+  /// @throw std::runtime_error if the file could not be opened or mapped
+  template <class Size, typename = std::enable_if_t<
+                            isModelOfMultiIndex_v<Size> && (dims_v<Size> >= 3)>>
+  inline ScratchFileStorage(std::string filename, Size size,
+                            std::size_t offset = 0)
+      : size_(size[0], size[1], size[2]),
+        mapping_(MemoryMap::sharedFile(filename, alignedOffset(offset),
+                                       indexProduct(size_) * sizeof(T))),
+        filename_(std::move(filename)) {}
+
+  /// @brief Copies the data into a new scratch file
+  inline ScratchFileStorage(ScratchFileStorage const &other)
+      : ScratchFileStorage(other.size_) {
+    if (!empty())
+      std::memcpy(mapping_.data(), other.mapping_.data(), mapping_.size());
+  }
+
+  inline ScratchFileStorage &operator=(ScratchFileStorage const &other) {
+    if (this != &other) *this = ScratchFileStorage(other);
+    return *this;
+  }
+
+  ScratchFileStorage(ScratchFileStorage &&) noexcept = default;
+  ScratchFileStorage &operator=(ScratchFileStorage &&) noexcept = default;
+
+  /// @brief Returns the size of the storage
+  /// @return an instance of a model of \ref MultiIndexConcept represening the
+  /// size in each dimension
+  inline auto size() const noexcept { return size_; }
+
+  /// @brief Returns the linear size of the storage, i.e. the product of the
+  /// size of each dimension
+  /// @return linear size
+  inline Size linearSize() const noexcept { return indexProduct(size_); }
+
+  /// @brief Returns the name of the backing file, empty for scratch files
+  inline std::string const &filename() const noexcept { return filename_; }
+
+  /// @brief Writes all modified voxels back to the file
+  /// @param async if true, only schedules the writes and returns immediately
+  /// @throw std::runtime_error if the data could not be written
+  inline void flush(bool async = false) const { mapping_.sync(async); }
+
+  /// @brief Tells the operating system how the voxels are going to be
+  /// accessed, e.g. AccessPattern::Sequential before streaming through the
+  /// whole volume
+  inline void advise(AccessPattern pattern) const noexcept {
+    mapping_.advise(pattern);
+  }
+
+  /// @brief Maps to storage to host memory and returs a memory mapping
+  /// object
+  /// @pre The storage object must not be empty
+  /// @return MappedHostMemory object representing the mapping
+  inline auto map() noexcept {
+    Expects(!empty());
+    return MappedHostMemory<T, 3>(not_null<Pointer>(data()), size_);
+  }
+
+  /// @brief Maps to storage to host memory and returs a const memory mapping
+  /// object
+  /// @return const MappedHostMemory object representing the mapping
+  inline auto map() const noexcept {
+    return MappedHostMemory<T const, 3>(not_null<ConstPointer>(data()), size_);
+  }
+
+  /// @brief Returns true if the the storage is empty, i.e. no memory is
+  /// mapped
+  /// @return true if empty
+  inline bool empty() const noexcept { return linearSize() == 0; }
+
+private:
+  /// @brief Returns @c offset, checking that it is a multiple of `alignof(T)`
+  static inline std::size_t alignedOffset(std::size_t offset) noexcept {
+    Expects(offset % alignof(T) == 0);
+    return offset;
+  }
+
+  inline Pointer data() const noexcept {
+    return static_cast<Pointer>(mapping_.data());
+  }
+
+  Size3 size_;
+  MemoryMap mapping_;
+  std::string filename_;
+};
+#pragma clang diagnostic pop
+
+template <> struct IsHostStorage<ScratchFileStorage> : public std::true_type {};
+
+template <>
+struct IsOutOfCoreStorage<ScratchFileStorage> : public std::true_type {};
+
+} // namespace ImageStack
@@ -0,0 +1,409 @@
+#pragma once
+
+#include "ImageStack.h"
+#include "Parallel.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace ImageStack {
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Histogram of the voxel values of an image stack
+///
+/// The range `[lower, upper]` is divided into bins of equal width, values
+/// equal to @c upper are counted in the last bin.
+struct Histogram {
+  /// @brief Lower bound of the first bin
+  double lower{0};
+  /// @brief Upper bound of the last bin
+  double upper{0};
+  /// @brief Number of values in each bin
+  std::vector<Size> bins;
+  /// @brief Number of values less than @c lower
+  Size below{0};
+  /// @brief Number of values greater than @c upper
+  Size above{0};
+
+  /// @brief Returns the width of a bin
+  inline double binWidth() const noexcept {
+    return bins.empty() ? 0.0
+                        : (upper - lower) / static_cast<double>(bins.size());
+  }
+
+  /// @brief Returns the total number of values, including the ones outside
+  /// of the range
+  inline Size count() const noexcept {
+    Size n = below + above;
+    for (auto const b : bins) n += b;
+    return n;
+  }
+
+  /// @brief Returns an approximation of the @c p-th percentile
+  ///
+  /// The values are assumed to be distributed uniformly inside of each bin.
+  /// Percentiles among the values outside of the range are clamped to the
+  /// range.
+  /// @param p percentile in `[0, 100]`
+  /// @pre the histogram must not be empty
+  inline double percentile(double p) const {
+    Expects(p >= 0 && p <= 100 && !bins.empty());
+    auto const n = count();
+    Expects(n > 0);
+
+    auto const rank = p / 100.0 * static_cast<double>(n);
+    auto seen = static_cast<double>(below);
+    if (rank <= seen) return lower;
+
+    for (Size i = 0; i < bins.size(); ++i) {
+      auto const b = static_cast<double>(bins[i]);
+      if (b > 0 && rank <= seen + b) {
+        auto const fraction = (rank - seen) / b;
+        return lower + binWidth() * (static_cast<double>(i) + fraction);
+      }
+      seen += b;
+    }
+    return upper;
+  }
+};
+
+/// @brief Statistics of the voxel values of an image stack, see
+/// statistics()
+///
+/// NaN values are ignored. All members are 0 if no voxel was counted.
+struct Statistics {
+  /// @brief Number of voxels counted
+  Size count{0};
+  /// @brief Sum of the values
+  double sum{0};
+  /// @brief Arithmetic mean
+  double mean{0};
+  /// @brief Population variance
+  double variance{0};
+  /// @brief Skewness, 0 if the variance is 0
+  double skewness{0};
+  /// @brief Excess kurtosis, 0 if the variance is 0
+  double kurtosis{0};
+  /// @brief Minimum value
+  double min{0};
+  /// @brief Maximum value
+  double max{0};
+  /// @brief Position of the first voxel (in linear order) with the minimum
+  /// value
+  Index3 minPosition{Index3::Zero()};
+  /// @brief Position of the first voxel (in linear order) with the maximum
+  /// value
+  Index3 maxPosition{Index3::Zero()};
+  /// @brief Histogram of the values, empty if not requested
+  Histogram histogram;
+
+  /// @brief Returns the standard deviation
+  inline double standardDeviation() const noexcept {
+    return std::sqrt(variance);
+  }
+};
+#pragma clang diagnostic pop
+
+namespace detail {
+
+/// @brief Number of values processed at once by the statistics kernels
+constexpr Size kStatisticsBlockSize = 1024;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpadded"
+/// @brief Partial result of a chunk of voxels
+///
+/// The moments are stored as central moments, so partial results can be
+/// merged without loss of precision (see merge()).
+struct PartialStatistics {
+  double n{0};
+  double mean{0};
+  double m2{0}, m3{0}, m4{0};
+  double min{std::numeric_limits<double>::infinity()};
+  double max{-std::numeric_limits<double>::infinity()};
+  Size minIndex{0}, maxIndex{0};
+  std::vector<Size> bins;
+  Size below{0}, above{0};
+
+  /// @brief Merges the partial result of the chunk following this one
+  void merge(PartialStatistics const &b) {
+    if (b.n == 0) return;
+    if (n == 0) {
+      *this = b;
+      return;
+    }
+
+    auto const na = n;
+    auto const nb = b.n;
+    auto const total = na + nb;
+    auto const delta = b.mean - mean;
+    auto const d = delta / total;
+
+    m4 += b.m4 +
+          delta * d * d * d * na * nb * (na * na - na * nb + nb * nb) +
+          6 * d * d * (na * na * b.m2 + nb * nb * m2) +
+          4 * d * (na * b.m3 - nb * m3);
+    m3 += b.m3 + delta * d * d * na * nb * (na - nb) +
+          3 * d * (na * b.m2 - nb * m2);
+    m2 += b.m2 + delta * d * na * nb;
+    mean += nb * d;
+    n = total;
+
+    if (b.min < min) {
+      min = b.min;
+      minIndex = b.minIndex;
+    }
+    if (b.max > max) {
+      max = b.max;
+      maxIndex = b.maxIndex;
+    }
+
+    for (Size i = 0; i < bins.size(); ++i) bins[i] += b.bins[i];
+    below += b.below;
+    above += b.above;
+  }
+};
+#pragma clang diagnostic pop
+
+/// @brief Histogram configuration of a statistics computation
+struct HistogramSetup {
+  Size bins{0};
+  double lower{0}, upper{0};
+};
+
+/// @brief Accumulates a block of @c n values with the linear indices
+/// @c indices
+///
+/// The power sums and extrema are computed in a loop without control flow
+/// that is vectorized using OpenMP SIMD reductions.
+inline void accumulate(PartialStatistics &p, double shift,
+                       std::array<double, 4> &sums, double const *values,
+                       Size const *indices, Size n,
+                       HistogramSetup const &histogram) {
+  double s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+  double lo = p.min, hi = p.max;
+#pragma omp simd reduction(+ : s1, s2, s3, s4) reduction(min : lo)            \
+    reduction(max : hi)
+  for (Size i = 0; i < n; ++i) {
+    auto const d = values[i] - shift;
+    auto const d2 = d * d;
+    s1 += d;
+    s2 += d2;
+    s3 += d2 * d;
+    s4 += d2 * d2;
+    lo = std::min(lo, values[i]);
+    hi = std::max(hi, values[i]);
+  }
+  sums[0] += s1;
+  sums[1] += s2;
+  sums[2] += s3;
+  sums[3] += s4;
+  p.n += static_cast<double>(n);
+
+  // Locate the extrema only if they changed, which is rare after the first
+  // blocks
+  if (lo < p.min) {
+    p.min = lo;
+    p.minIndex = indices[std::find(values, values + n, lo) - values];
+  }
+  if (hi > p.max) {
+    p.max = hi;
+    p.maxIndex = indices[std::find(values, values + n, hi) - values];
+  }
+
+  if (histogram.bins == 0) return;
+  auto const scale = static_cast<double>(histogram.bins) /
+                     (histogram.upper - histogram.lower);
+  for (Size i = 0; i < n; ++i) {
+    auto const v = values[i];
+    if (v < histogram.lower) {
+      ++p.below;
+    } else if (v > histogram.upper) {
+      ++p.above;
+    } else {
+      auto const bin = static_cast<Size>((v - histogram.lower) * scale);
+      ++p.bins[std::min(bin, histogram.bins - 1)];
+    }
+  }
+}
+
+/// @brief Converts power sums relative to @c shift to central moments
+inline void toCentralMoments(PartialStatistics &p, double shift,
+                             std::array<double, 4> const &sums) noexcept {
+  if (p.n == 0) return;
+  auto const m = sums[0] / p.n;
+  auto const m2 = m * m;
+  p.mean = shift + m;
+  p.m2 = sums[1] - p.n * m2;
+  p.m3 = sums[2] - 3 * m * sums[1] + 2 * p.n * m2 * m;
+  p.m4 = sums[3] - 4 * m * sums[2] + 6 * m2 * sums[1] - 3 * p.n * m2 * m2;
+}
+
+/// @brief Returns true if the voxel is counted
+template <class MaskIt> inline bool isMasked(MaskIt const &it) {
+  return *it != 0;
+}
+
+/// @brief Dummy mask iterator counting every voxel
+struct NoMask {
+  inline NoMask &operator++() noexcept { return *this; }
+};
+
+inline bool isMasked(NoMask const &) noexcept { return true; }
+
+/// @brief Computes the partial statistics of @c n voxels starting at
+/// @c src with the linear index @c first
+template <class It, class MaskIt>
+inline PartialStatistics chunkStatistics(It src, MaskIt mask, Size first,
+                                         Size n,
+                                         HistogramSetup const &histogram) {
+  PartialStatistics p;
+  p.bins.assign(histogram.bins, 0);
+
+  std::array<double, kStatisticsBlockSize> values;
+  std::array<Size, kStatisticsBlockSize> indices;
+  std::array<double, 4> sums{};
+  auto shift = std::numeric_limits<double>::quiet_NaN();
+
+  Size i = 0;
+  while (i < n) {
+    Size count = 0;
+    for (; i < n && count < kStatisticsBlockSize; ++i, ++src, ++mask) {
+      auto const v = static_cast<double>(*src);
+      if (!isMasked(mask) || std::isnan(v)) continue;
+      values[count] = v;
+      indices[count] = first + i;
+      ++count;
+    }
+    if (count == 0) continue;
+
+    // Shift the power sums by the first value to avoid cancellation
+    if (std::isnan(shift)) shift = values[0];
+    accumulate(p, shift, sums, values.data(), indices.data(), count,
+               histogram);
+  }
+
+  toCentralMoments(p, shift, sums);
+  return p;
+}
+
+/// @brief Computes the statistics of a mapping in parallel chunks
+template <class Map, class MaskMap>
+inline Statistics computeStatistics(Map const &map, MaskMap const *mask,
+                                    HistogramSetup const &histogram) {
+  auto const n = map.linearSize();
+  auto const chunks =
+      mask ? std::min(numChunks(map), numChunks(*mask)) : numChunks(map);
+
+  std::vector<PartialStatistics> partials(chunks);
+  forEachIndexChunk(n, chunks, [&](Size c, Size first, Size last) {
+    auto const src = voxelIterator(map, first);
+    partials[c] =
+        mask ? chunkStatistics(src, voxelIterator(*mask, first), first,
+                               last - first, histogram)
+             : chunkStatistics(src, NoMask{}, first, last - first, histogram);
+  });
+
+  auto &total = partials.front();
+  for (Size c = 1; c < chunks; ++c) total.merge(partials[c]);
+
+  Statistics stats;
+  stats.histogram.lower = histogram.lower;
+  stats.histogram.upper = histogram.upper;
+  stats.histogram.bins = std::move(total.bins);
+  stats.histogram.below = total.below;
+  stats.histogram.above = total.above;
+  if (total.n == 0) return stats;
+
+  auto const size = map.size();
+  auto const position = [&size](Size i) {
+    return Index3(i % size[0], (i / size[0]) % size[1],
+                  i / (size[0] * size[1]));
+  };
+
+  stats.count = static_cast<Size>(total.n);
+  stats.mean = total.mean;
+  stats.sum = total.mean * total.n;
+  stats.variance = std::max(0.0, total.m2 / total.n);
+  if (stats.variance > 0) {
+    stats.skewness = (total.m3 / total.n) / std::pow(stats.variance, 1.5);
+    stats.kurtosis =
+        (total.m4 / total.n) / (stats.variance * stats.variance) - 3;
+  }
+  stats.min = total.min;
+  stats.max = total.max;
+  stats.minPosition = position(total.minIndex);
+  stats.maxPosition = position(total.maxIndex);
+  return stats;
+}
+
+/// @brief Computes the statistics, determining the histogram range in a
+/// first pass if it is not given
+template <class Map, class MaskMap>
+inline Statistics computeStatistics(Map const &map, MaskMap const *mask,
+                                    Size bins, double lower, double upper) {
+  if (bins > 0 && !(lower < upper)) {
+    auto const range = computeStatistics(map, mask, HistogramSetup{});
+    lower = range.count > 0 ? range.min : 0;
+    upper = range.max > lower ? range.max : lower + 1;
+  }
+  return computeStatistics(map, mask, HistogramSetup{bins, lower, upper});
+}
+
+} // namespace detail
+
+/// @brief Computes the statistics of the voxel values of an image stack
+///
+/// Moments, the extrema and their positions, and the histogram are computed
+/// in a single parallel pass: each thread accumulates a partial result of its
+/// chunk of voxels, the partial results are merged afterwards. If a
+/// histogram is requested without a range, the range is set to
+/// `[min, max]`, which takes an additional pass.
+///
+/// Example: 0.5% and 99.5% percentiles for windowing
+/// @code
+/// auto const stats = statistics(img, 1024);
+/// auto const lower = stats.histogram.percentile(0.5);
+/// auto const upper = stats.histogram.percentile(99.5);
+/// @endcode
+///
+/// Unit tests are in \ref testStatistics.cpp
+/// @param bins number of histogram bins, 0 to skip the histogram
+/// @param lower lower bound of the histogram range
+/// @param upper upper bound of the histogram range
+template <class T, template <class> class Storage, class... Decorators,
+          typename = std::enable_if_t<isHostStorage_v<Storage>>>
+Statistics statistics(ImageStack<T, Storage, Decorators...> const &img,
+                      Size bins = 0, double lower = 0, double upper = 0) {
+  if (img.empty()) return {};
+  auto const map = img.map();
+  return detail::computeStatistics(map, decltype(&map){nullptr}, bins, lower,
+                                   upper);
+}
+
+/// @brief Computes the statistics of the voxels of an image stack for which
+/// @c mask is not 0
+///
+/// Same as statistics(img, bins, lower, upper), but voxels outside of the
+/// mask are ignored. The mask may use any storage, e.g. BitMaskStorage.
+/// @pre `mask.size() == img.size()`
+template <class T, template <class> class Storage, class... Decorators,
+          class M, template <class> class MaskStorage, class... MaskDecorators,
+          typename = std::enable_if_t<isHostStorage_v<Storage> &&
+                                      isHostStorage_v<MaskStorage>>>
+Statistics statistics(ImageStack<T, Storage, Decorators...> const &img,
+                      ImageStack<M, MaskStorage, MaskDecorators...> const &mask,
+                      Size bins = 0, double lower = 0, double upper = 0) {
+  Expects(img.size() == mask.size());
+  if (img.empty()) return {};
+  auto const map = img.map();
+  auto const maskMap = mask.map();
+  return detail::computeStatistics(map, &maskMap, bins, lower, upper);
+}
+
+} // namespace ImageStack
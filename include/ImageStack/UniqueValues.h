@@ -0,0 +1,251 @@
+#pragma once
+
+#include "Parallel.h"
+#include "Types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ImageStack {
+namespace detail {
+
+/// @brief Maximum value range of integral images collected in flag tables,
+/// larger ranges are sorted
+constexpr std::uint64_t kMaxFlagRange = std::uint64_t{1} << 22;
+
+/// @brief Maximum value range of integral images collected in count tables,
+/// larger ranges are sorted
+constexpr std::uint64_t kMaxCountRange = std::uint64_t{1} << 18;
+
+/// @brief Marks a value as present in a flag table
+inline void addValue(std::uint8_t &flag) noexcept { flag = 1; }
+
+/// @brief Counts a value in a count table
+inline void addValue(Size &count) noexcept { ++count; }
+
+/// @brief Merges two entries of flag tables
+inline void mergeValue(std::uint8_t &a, std::uint8_t b) noexcept { a |= b; }
+
+/// @brief Merges two entries of count tables
+inline void mergeValue(Size &a, Size b) noexcept { a += b; }
+
+/// @brief Returns the position of @c v in a table starting at @c min
+template <class T> inline std::uint64_t tableIndex(T v, T min) noexcept {
+  return static_cast<std::uint64_t>(v) - static_cast<std::uint64_t>(min);
+}
+
+/// @brief Returns the minimum and maximum value of an integral image
+template <class T, class Map>
+inline std::pair<T, T> valueRange(Map const &map, Size chunks) {
+  std::vector<std::pair<T, T>> ranges(chunks);
+  forEachChunk(map, chunks, [&ranges](Size c, auto first, auto last) {
+    T const v0 = *first;
+    auto range = std::make_pair(v0, v0);
+    for (; first != last; ++first) {
+      T const v = *first;
+      range.first = std::min(range.first, v);
+      range.second = std::max(range.second, v);
+    }
+    ranges[c] = range;
+  });
+
+  auto range = ranges.front();
+  for (auto const &r : ranges) {
+    range.first = std::min(range.first, r.first);
+    range.second = std::max(range.second, r.second);
+  }
+  return range;
+}
+
+/// @brief Fills a table of @c range entries with one entry per value of an
+/// integral image starting at @c min
+///
+/// Each chunk fills its own table, the tables are merged in parallel.
+/// @tparam Entry @c std::uint8_t for flags, @c Size for counts
+template <class Entry, class T, class Map>
+inline std::vector<Entry> valueTable(Map const &map, Size chunks, T min,
+                                     Size range) {
+  std::vector<std::vector<Entry>> tables(chunks);
+  forEachChunk(map, chunks, [&](Size c, auto first, auto last) {
+    auto &table = tables[c];
+    table.assign(range, Entry{0});
+    for (; first != last; ++first) addValue(table[tableIndex<T>(*first, min)]);
+  });
+
+  auto &result = tables.front();
+
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < narrow<long>(range); ++i)
+    for (Size c = 1; c < chunks; ++c)
+      mergeValue(result[static_cast<Size>(i)], tables[c][static_cast<Size>(i)]);
+
+  return std::move(result);
+}
+
+/// @brief Returns the value of a table entry
+template <class T> inline T tableValue(T min, Size i) noexcept {
+  return static_cast<T>(static_cast<std::uint64_t>(min) + i);
+}
+
+/// @brief Merges sorted runs pairwise until a single sorted run is left
+/// @param runs offsets of the runs in @c values, including the end offset
+template <class T, class Compare>
+inline void mergeRuns(std::vector<T> &values, std::vector<Size> runs,
+                      Compare compare) {
+  using Diff = typename std::vector<T>::difference_type;
+
+  while (runs.size() > 2) {
+    std::vector<Size> merged;
+    auto const pairs = narrow<long>((runs.size() - 1) / 2);
+
+#pragma omp parallel for schedule(static)
+    for (long p = 0; p < pairs; ++p) {
+      auto const i = 2 * static_cast<Size>(p);
+      auto const begin = values.begin();
+      std::inplace_merge(begin + static_cast<Diff>(runs[i]),
+                         begin + static_cast<Diff>(runs[i + 1]),
+                         begin + static_cast<Diff>(runs[i + 2]), compare);
+    }
+
+    for (Size i = 0; i < runs.size(); i += 2) merged.push_back(runs[i]);
+    if (merged.back() != runs.back()) merged.push_back(runs.back());
+    runs = std::move(merged);
+  }
+}
+
+/// @brief Collects the sorted unique values of each chunk and merges them
+template <class T, class Map>
+inline std::vector<T> sortedUniqueValues(Map const &map, Size chunks) {
+  std::vector<std::vector<T>> local(chunks);
+  forEachChunk(map, chunks, [&local](Size c, auto first, auto last) {
+    auto &values = local[c];
+    values.assign(first, last);
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+  });
+
+  std::vector<T> values;
+  std::vector<Size> runs{0};
+  for (auto const &l : local) {
+    values.insert(values.end(), l.cbegin(), l.cend());
+    runs.push_back(values.size());
+  }
+
+  mergeRuns(values, std::move(runs), std::less<T>{});
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  return values;
+}
+
+/// @brief Collects the sorted unique values and their counts of each chunk
+/// and merges them
+template <class T, class Map>
+inline std::vector<std::pair<T, Size>> sortedValueCounts(Map const &map,
+                                                        Size chunks) {
+  using Entry = std::pair<T, Size>;
+
+  std::vector<std::vector<Entry>> local(chunks);
+  forEachChunk(map, chunks, [&local](Size c, auto first, auto last) {
+    std::vector<T> values(first, last);
+    std::sort(values.begin(), values.end());
+
+    auto &counts = local[c];
+    for (auto const &v : values) {
+      if (counts.empty() || counts.back().first != v)
+        counts.emplace_back(v, 0);
+      ++counts.back().second;
+    }
+  });
+
+  std::vector<Entry> counts;
+  std::vector<Size> runs{0};
+  for (auto const &l : local) {
+    counts.insert(counts.end(), l.cbegin(), l.cend());
+    runs.push_back(counts.size());
+  }
+
+  mergeRuns(counts, std::move(runs), [](auto const &a, auto const &b) {
+    return a.first < b.first;
+  });
+
+  std::vector<Entry> result;
+  for (auto const &c : counts) {
+    if (!result.empty() && result.back().first == c.first)
+      result.back().second += c.second;
+    else
+      result.push_back(c);
+  }
+  return result;
+}
+
+/// @brief True for integral types whose values can be collected in tables
+template <class T>
+using IsTableType =
+    std::integral_constant<bool, std::is_integral<T>::value &&
+                                     !std::is_same<T, bool>::value>;
+
+template <class T, class Map>
+inline std::vector<T> uniqueValues(Map const &map, Size chunks,
+                                   std::false_type) {
+  return sortedUniqueValues<T>(map, chunks);
+}
+
+template <class T, class Map>
+inline std::vector<T> uniqueValues(Map const &map, Size chunks,
+                                   std::true_type) {
+  auto const range = valueRange<T>(map, chunks);
+  auto const span = tableIndex(range.second, range.first);
+  if (span >= kMaxFlagRange) return sortedUniqueValues<T>(map, chunks);
+
+  auto const flags = valueTable<std::uint8_t>(map, chunks, range.first,
+                                              static_cast<Size>(span) + 1);
+  std::vector<T> values;
+  for (Size i = 0; i < flags.size(); ++i)
+    if (flags[i]) values.push_back(tableValue(range.first, i));
+  return values;
+}
+
+template <class T, class Map>
+inline std::vector<std::pair<T, Size>> valueCounts(Map const &map, Size chunks,
+                                                   std::false_type) {
+  return sortedValueCounts<T>(map, chunks);
+}
+
+template <class T, class Map>
+inline std::vector<std::pair<T, Size>> valueCounts(Map const &map, Size chunks,
+                                                   std::true_type) {
+  auto const range = valueRange<T>(map, chunks);
+  auto const span = tableIndex(range.second, range.first);
+  if (span >= kMaxCountRange) return sortedValueCounts<T>(map, chunks);
+
+  auto const counts =
+      valueTable<Size>(map, chunks, range.first, static_cast<Size>(span) + 1);
+  std::vector<std::pair<T, Size>> values;
+  for (Size i = 0; i < counts.size(); ++i)
+    if (counts[i]) values.emplace_back(tableValue(range.first, i), counts[i]);
+  return values;
+}
+
+/// @brief Returns the unique values of a mapping in ascending order
+///
+/// Integral values are collected in per thread flag tables if their range is
+/// small enough, other values are sorted per thread and merged.
+template <class T, class Map>
+inline std::vector<T> uniqueValues(Map const &map) {
+  if (map.linearSize() == 0) return {};
+  return uniqueValues<T>(map, numChunks(map), IsTableType<T>{});
+}
+
+/// @brief Returns the unique values of a mapping in ascending order together
+/// with the number of voxels having that value
+template <class T, class Map>
+inline std::vector<std::pair<T, Size>> valueCounts(Map const &map) {
+  if (map.linearSize() == 0) return {};
+  return valueCounts<T>(map, numChunks(map), IsTableType<T>{});
+}
+
+} // namespace detail
+} // namespace ImageStack